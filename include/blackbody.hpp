@@ -32,9 +32,45 @@
  * \f]
  * where \f$R\f$ is the radius, and \f$d\f$ is the distance to the star.
  *
+ * For spectra and model grids, `bb_flux(lam_nm, amp, teff_K)` evaluates a
+ * full (temperature x wavelength) grid in one call with the vectorized
+ * `expm1` of `cphot/vectormath.hpp` and precomputed constants.
+ *
  */
 #pragma once
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+#include <xtensor/xarray.hpp>
 #include "cphot/rquantities.hpp"
+#include "cphot/vectormath.hpp"
+
+namespace blackbody {
+    constexpr double kB = 1.380649e-23;     ///< Boltzmann constant, Unit("J/K")
+    constexpr double c = 299792458.0;       ///< speed of light, Unit("m/s")
+    constexpr double h = 6.62607015e-34;    ///< Planck constant, Unit('m**2 * kg / s')
+    /// 2 h c^2 scaled to flam (erg/s/cm2/AA) for wavelengths in nm
+    constexpr double c1 = 2. * h * c * c * 1e+38;
+    /// h c / k in nm K
+    constexpr double c2 = h * c / (1e-9 * kB);
+}
+
+/**
+ * default units blackbody as a flux distribution as function of wavelength,
+ * temperature and amplitude.
+ *
+ * @param lam:   wavelength in nm
+ * @param amp:   dimensionless normalization factor
+ * @param teff: temperature in Kelvins
+ * @return evaluation of the blackbody radiation in flam units (erg/s/cm2/AA)
+ *
+ */
+double bb_flux_function(double lam_nm, double amp, double teff_K){
+    const double lam2 = lam_nm * lam_nm;
+    return amp * blackbody::c1 / (lam2 * lam2 * lam_nm
+                                  * std::expm1(blackbody::c2 / (lam_nm * teff_K)));
+}
 
 /**
  * Blackbody as a flux distribution as function
@@ -52,38 +88,146 @@
 QSpectralFluxDensity bb_flux_function(QLength lam,
                                       Number amp,
                                       QTemperature teff){
-    // Natural constants.
-    double kB = (1.380649e-23 * joule / kelvin).getValue();
-    double c = speed_of_light.Convert(meter / second);
-    double h = (6.62607015e-34 * metre2 * kg / second).getValue();
-    double lam_nm = lam.Convert(nanometre);
-    double teff_K = teff.Convert(kelvin);
-    double amp_ = amp.getValue();
+    return bb_flux_function(lam.Convert(nanometre), amp.getValue(),
+                            teff.Convert(kelvin)) * flam;
+}
 
-    double v = (amp_ * 2 * h * std::pow(c, 2) / (std::pow(lam_nm, 5) *
-            (std::exp(h * c / (lam_nm * 1e-9 * kB * teff_K)) - 1)));
+/**
+ * default units blackbody fluxes over a grid of wavelengths and temperatures
+ *
+ * Row `t` of the output is the spectrum of temperature `teff_K[t]` and
+ * amplitude `amp[t]`. The wavelength terms are computed once for all the
+ * temperatures, and every row is a vectorized `expm1` followed by a scaling.
+ *
+ * @param lam_nm:   wavelengths in nm (n_lam)
+ * @param n_lam:    number of wavelengths
+ * @param amp:      dimensionless normalization factors (n_teff), nullptr for 1
+ * @param teff_K:   temperatures in Kelvins (n_teff)
+ * @param n_teff:   number of temperatures
+ * @param out:      fluxes in flam (n_teff, n_lam), row major
+ */
+void bb_flux(const double * lam_nm, std::size_t n_lam,
+             const double * amp, const double * teff_K, std::size_t n_teff,
+             double * out){
+    std::vector<double> inv_lam(n_lam);
+    std::vector<double> prefactor(n_lam);
+    #pragma omp simd
+    for (std::size_t i = 0; i < n_lam; ++i) {
+        const double lam2 = lam_nm[i] * lam_nm[i];
+        inv_lam[i] = 1. / lam_nm[i];
+        prefactor[i] = blackbody::c1 / (lam2 * lam2 * lam_nm[i]);
+    }
+    for (std::size_t t = 0; t < n_teff; ++t) {
+        double * row = out + t * n_lam;
+        const double a = (amp == nullptr) ? 1. : amp[t];
+        // row = expm1(hc / (lam k T)), overflows to inf (null flux) in the Wien tail
+        cphot::vexpm1(inv_lam.data(), row, n_lam, blackbody::c2 / teff_K[t]);
+        #pragma omp simd
+        for (std::size_t i = 0; i < n_lam; ++i) {
+            row[i] = a * prefactor[i] / row[i];
+        }
+    }
+}
 
-    return v * 1e+38 * flam;
+/**
+ * default units blackbody fluxes over a grid of wavelengths and temperatures
+ *
+ * All the overloads take the amplitude before the temperature.
+ *
+ * @param lam_nm:   wavelengths in nm (n_lam)
+ * @param amp:      dimensionless normalization factors, one per temperature
+ *                  or a single value broadcast to all temperatures
+ * @param teff_K:   temperatures in Kelvins (n_teff)
+ * @return fluxes in flam (n_teff, n_lam)
+ * @throw std::runtime_error if amp cannot be broadcast to teff_K
+ */
+xt::xarray<double, xt::layout_type::row_major> bb_flux(
+        const xt::xarray<double, xt::layout_type::row_major>& lam_nm,
+        const xt::xarray<double, xt::layout_type::row_major>& amp,
+        const xt::xarray<double, xt::layout_type::row_major>& teff_K){
+    const std::size_t n_lam = lam_nm.size();
+    const std::size_t n_teff = teff_K.size();
+    if ((amp.size() != 1) && (amp.size() != n_teff)) {
+        throw std::runtime_error("bb_flux: amp must have 1 or teff_K.size() values");
+    }
+    std::vector<double> amps(n_teff, (amp.size() == 1) ? amp.data()[0] : 1.);
+    if (amp.size() != 1) { amps.assign(amp.begin(), amp.end()); }
+    xt::xarray<double, xt::layout_type::row_major> flux =
+        xt::xarray<double, xt::layout_type::row_major>::from_shape({n_teff, n_lam});
+    bb_flux(lam_nm.data(), n_lam, amps.data(), teff_K.data(), n_teff, flux.data());
+    return flux;
+}
+
+/**
+ * default units blackbody spectrum
+ *
+ * @param lam_nm:   wavelengths in nm (n)
+ * @param amp:      dimensionless normalization factor
+ * @param teff_K:   temperature in Kelvins
+ * @return fluxes in flam (n)
+ */
+xt::xarray<double, xt::layout_type::row_major> bb_flux(
+        const xt::xarray<double, xt::layout_type::row_major>& lam_nm,
+        double amp, double teff_K){
+    const std::size_t n = lam_nm.size();
+    xt::xarray<double, xt::layout_type::row_major> flux =
+        xt::xarray<double, xt::layout_type::row_major>::from_shape({n});
+    bb_flux(lam_nm.data(), n, &amp, &teff_K, 1, flux.data());
+    return flux;
 }
 
 
 /**
- * default units blackbody as a flux distribution as function of wavelength,
- * temperature and amplitude.
+ * default units blackbody and its derivatives with respect to the amplitude
+ * and the temperature.
  *
- * @param lam:   wavelength in nm
- * @param amp:   dimensionless normalization factor
- * @param teff: temperature in Kelvins
+ * With \f$x = hc / \lambda k T\f$,
+ * \f{eqnarray*}{
+ *      \frac{\partial f_\lambda}{\partial a} &=& \frac{f_\lambda}{a}, \\
+ *      \frac{\partial f_\lambda}{\partial T} &=& \frac{f_\lambda}{T}\,\frac{x e^x}{e^x - 1}.
+ * \f}
+ *
+ * @param lam_nm:      wavelength in nm
+ * @param amp:         dimensionless normalization factor
+ * @param teff_K:      temperature in Kelvins
+ * @param df_damp:     set to the derivative with respect to amp (flam)
+ * @param df_dteff:    set to the derivative with respect to teff (flam / K)
  * @return evaluation of the blackbody radiation in flam units (erg/s/cm2/AA)
+ */
+double bb_flux_gradient(double lam_nm, double amp, double teff_K,
+                        double& df_damp, double& df_dteff){
+    const double x = blackbody::c2 / (lam_nm * teff_K);
+    const double em1 = std::expm1(x);
+    // amp = 1 blackbody in flam
+    const double lam2 = lam_nm * lam_nm;
+    const double b = blackbody::c1 / (lam2 * lam2 * lam_nm * em1);
+    df_damp = b;
+    df_dteff = amp * b / teff_K * x * (em1 + 1.) / em1;
+    return amp * b;
+}
+
+/**
+ * default units blackbody spectrum and its derivatives with respect to the
+ * amplitude and the temperature.
  *
+ * @param lam_nm:      wavelengths in nm (n)
+ * @param amp:         dimensionless normalization factor
+ * @param teff_K:      temperature in Kelvins
+ * @param gradient:    set to the derivatives (2, n): d/damp and d/dteff
+ * @return evaluation of the blackbody radiation in flam units (n)
  */
-double bb_flux_function(double lam_nm, double amp, double teff_K){
-    // Natural constants.
-    double kB = 1.380649e-23;   // Unit("J/K")
-    double c = 299792458.0;     // Unit("m/s")
-    double h = 6.62607015e-34;  // Unit('m**2 * kg / s')
-    double v = (amp * 2 * h * std::pow(c, 2) / (std::pow(lam_nm, 5) *
-            (std::exp(h * c / (lam_nm * 1e-9 * kB * teff_K)) - 1)));
-    std::cout << lam_nm << " " << amp << " " << teff_K << "\n";
-    return v * 1e+38;  // flam = erg/s/cm2/AA
-}
\ No newline at end of file
+xt::xarray<double, xt::layout_type::row_major> bb_flux_gradient(
+        const xt::xarray<double, xt::layout_type::row_major>& lam_nm,
+        double amp, double teff_K,
+        xt::xarray<double, xt::layout_type::row_major>& gradient){
+    const std::size_t n = lam_nm.size();
+    xt::xarray<double, xt::layout_type::row_major> flux =
+        xt::xarray<double, xt::layout_type::row_major>::from_shape({n});
+    gradient = xt::xarray<double, xt::layout_type::row_major>::from_shape({2, n});
+    double * d_amp = gradient.data();
+    double * d_teff = gradient.data() + n;
+    for (std::size_t i = 0; i < n; ++i) {
+        flux[i] = bb_flux_gradient(lam_nm[i], amp, teff_K, d_amp[i], d_teff[i]);
+    }
+    return flux;
+}
@@ -0,0 +1,488 @@
+/**
+ * @defgroup BBFIT Blackbody fits
+ * @brief Least squares fits of (Teff, amp) to catalog photometry.
+ *
+ * The model band flux of a blackbody is \f$ a\,F_m(T) \f$ with \f$F_m\f$ the
+ * band flux of a unit blackbody, evaluated with a `BlackbodyTable` together
+ * with its temperature derivative. A `BlackbodyFitter` minimizes
+ *
+ * \f[
+ * \chi^2 = \sum_m \left(\frac{f_m - a F_m(T)}{\sigma_m}\right)^2
+ * \f]
+ *
+ * over \f$(\log T, \log a)\f$, which keeps both parameters positive, with the
+ * analytic Jacobian
+ * \f$ \partial \mu_m / \partial \log a = \mu_m \f$,
+ * \f$ \partial \mu_m / \partial \log T = \mu_m \, d\log F_m / d\log T \f$.
+ * The start point is the best temperature of a coarse scan of the table with
+ * the amplitude profiled out (linear least squares).
+ *
+ * The model is linear in \f$a\f$: at fixed temperature the best amplitude
+ * and chi2 are
+ *
+ * \f[
+ * a^*(T) = \frac{\sum_m f_m F_m / \sigma_m^2}{\sum_m F_m^2 / \sigma_m^2},
+ * \qquad
+ * \chi^2(T) = \sum_m \frac{f_m^2}{\sigma_m^2}
+ *            - \frac{(\sum_m f_m F_m / \sigma_m^2)^2}{\sum_m F_m^2 / \sigma_m^2}.
+ * \f]
+ *
+ * `BlackbodyFitMethod::VariableProjection` minimizes this profile over
+ * \f$\log T\f$ with Brent's method, bracketed by the neighbours of the best
+ * scan node. It needs no step control and cannot stall on the valley of
+ * faint stars where \f$a\f$ and \f$T\f$ are strongly correlated.
+ *
+ * Catalog values are converted to flam with `BandConverter` (any
+ * `PhotometricUnit` per band). Bands with a non finite value or a non
+ * positive uncertainty are ignored. Stars are independent and split over
+ * worker threads (`cphot::parallel_for`).
+ *
+ * ```cpp
+ * cphot::BlackbodyFitter fitter(table, filters, units);
+ * cphot::DMatrix values, errors;
+ * cphot::read_catalog_photometry("data/blackbody-stars-clean.csv", columns, values, errors);
+ * std::vector<cphot::BlackbodyFit> fits = fitter.fit(values, errors);
+ * ```
+ */
+#pragma once
+#include "blackbody_table.hpp"
+#include "conversions.hpp"
+#include "filter.hpp"
+#include "parallel.hpp"
+#include <rapidcsv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup BBFIT
+ * @brief Result of a blackbody fit
+ *
+ * Uncertainties are the square roots of the diagonal of the inverse Hessian
+ * \f$(J^T J)^{-1}\f$ at the solution (not rescaled by the reduced chi2).
+ */
+struct BlackbodyFit {
+    double teff = std::numeric_limits<double>::quiet_NaN();          ///< temperature in K
+    double teff_error = std::numeric_limits<double>::quiet_NaN();    ///< uncertainty on teff in K
+    double amp = std::numeric_limits<double>::quiet_NaN();           ///< amplitude (bb_flux units)
+    double amp_error = std::numeric_limits<double>::quiet_NaN();     ///< uncertainty on amp
+    double chi2 = std::numeric_limits<double>::quiet_NaN();          ///< chi2 at the solution
+    std::size_t n_bands = 0;                                         ///< number of bands used
+    std::size_t n_iter = 0;                                          ///< number of iterations
+    std::size_t n_eval = 0;                                          ///< number of chi2 evaluations
+    bool converged = false;                                          ///< convergence flag
+    bool at_bound = false;                                           ///< teff on an edge of the table
+
+    /** @brief degrees of freedom (bands - 2) */
+    std::size_t dof() const { return (this->n_bands > 2) ? this->n_bands - 2 : 0; }
+};
+
+/**
+ * @ingroup BBFIT
+ * @brief Minimization methods of `BlackbodyFitter`
+ */
+enum class BlackbodyFitMethod {
+    LevenbergMarquardt,     ///< 2D Levenberg-Marquardt on (log T, log a)
+    VariableProjection      ///< Brent on log T with the amplitude profiled out
+};
+
+/**
+ * @ingroup BBFIT
+ * @brief Brent minimization of a 1D function on a bracket
+ *
+ * Golden section search accelerated by parabolic interpolation
+ * (Brent 1973). The bracket (a, x, b) must satisfy f(x) <= f(a), f(b).
+ *
+ * @param func        function to minimize
+ * @param a           lower end of the bracket
+ * @param x           inner point of the bracket
+ * @param b           upper end of the bracket
+ * @param tol         absolute tolerance on the abscissa (at least sqrt(eps) |x|)
+ * @param max_iter    maximum number of iterations
+ * @param fmin        set to the function value at the minimum
+ * @param n_iter      set to the number of iterations
+ * @param converged   set if the tolerance was reached
+ * @return abscissa of the minimum
+ */
+template <typename Func>
+double brent_minimize(Func&& func, double a, double x, double b,
+                      double tol, std::size_t max_iter,
+                      double& fmin, std::size_t& n_iter, bool& converged){
+    const double golden = 0.3819660112501051;
+    const double sqrt_eps = 1.4901161193847656e-08;
+    double w = x, v = x;
+    double fx = func(x), fw = fx, fv = fx;
+    double d = 0, e = 0;
+    converged = false;
+    for (n_iter = 0; n_iter < max_iter; ++n_iter) {
+        const double m = 0.5 * (a + b);
+        const double tol1 = tol + sqrt_eps * std::abs(x);
+        const double tol2 = 2. * tol1;
+        if (std::abs(x - m) <= tol2 - 0.5 * (b - a)) {
+            converged = true;
+            break;
+        }
+        bool parabolic = false;
+        if (std::abs(e) > tol1) {
+            // parabola through (v, w, x)
+            const double r = (x - w) * (fx - fv);
+            double q = (x - v) * (fx - fw);
+            double p = (x - v) * q - (x - w) * r;
+            q = 2. * (q - r);
+            if (q > 0) { p = -p; } else { q = -q; }
+            if ((std::abs(p) < std::abs(0.5 * q * e)) && (p > q * (a - x)) && (p < q * (b - x))) {
+                e = d;
+                d = p / q;
+                parabolic = true;
+                if ((x + d - a < tol2) || (b - x - d < tol2)) { d = (m >= x) ? tol1 : -tol1; }
+            }
+        }
+        if (! parabolic) {
+            e = (x >= m) ? a - x : b - x;
+            d = golden * e;
+        }
+        const double u = (std::abs(d) >= tol1) ? x + d : ((d > 0) ? x + tol1 : x - tol1);
+        const double fu = func(u);
+        if (fu <= fx) {
+            if (u >= x) { a = x; } else { b = x; }
+            v = w; fv = fw;
+            w = x; fw = fx;
+            x = u; fx = fu;
+        } else {
+            if (u < x) { a = u; } else { b = u; }
+            if ((fu <= fw) || (w == x)) {
+                v = w; fv = fw;
+                w = u; fw = fu;
+            } else if ((fu <= fv) || (v == x) || (v == w)) {
+                v = u; fv = fu;
+            }
+        }
+    }
+    fmin = fx;
+    return x;
+}
+
+/**
+ * @ingroup BBFIT
+ * @brief Blackbody fitter on a set of bands
+ */
+class BlackbodyFitter {
+    private:
+        BlackbodyTable table;                       ///< band fluxes of unit blackbodies
+        std::vector<BandConverter> converters;      ///< conversions of the inputs to flam
+        std::vector<PhotometricUnit> units;         ///< units of the inputs
+        BlackbodyFitMethod method;                  ///< minimization method
+        std::size_t max_iter;                       ///< maximum number of iterations
+        double tol;                                 ///< convergence on the log parameters
+
+    public:
+        BlackbodyFitter(const BlackbodyTable& table,
+                        const std::vector<Filter>& filters,
+                        const std::vector<PhotometricUnit>& units,
+                        BlackbodyFitMethod method = BlackbodyFitMethod::LevenbergMarquardt,
+                        std::size_t max_iter = 100,
+                        double tol = 1e-8);
+
+        void to_flux(const double * values, const double * errors,
+                     double * flux, double * flux_error) const;
+        BlackbodyFit fit_flux(const double * flux, const double * flux_error) const;
+        BlackbodyFit fit(const double * values, const double * errors) const;
+        std::vector<BlackbodyFit> fit(const DMatrix& values, const DMatrix& errors,
+                                      std::size_t n_threads = 0) const;
+
+        std::size_t size() const { return this->units.size(); }
+        const BlackbodyTable& get_table() const { return this->table; }
+};
+
+/**
+ * @brief Construct a new Blackbody Fitter object
+ *
+ * @param table      band fluxes of the filters (same order)
+ * @param filters    filters of the catalog bands
+ * @param units      unit of the catalog values of each band
+ * @param method     minimization method
+ * @param max_iter   maximum number of iterations per star
+ * @param tol        convergence threshold on log(teff) (and log(amp))
+ * @throw std::runtime_error if the table, filters and units do not match
+ */
+BlackbodyFitter::BlackbodyFitter(const BlackbodyTable& table,
+                                 const std::vector<Filter>& filters,
+                                 const std::vector<PhotometricUnit>& units,
+                                 BlackbodyFitMethod method,
+                                 std::size_t max_iter,
+                                 double tol)
+    : table(table), units(units), method(method), max_iter(max_iter), tol(tol) {
+    if ((filters.size() != units.size()) || (filters.size() != table.size())) {
+        throw std::runtime_error("BlackbodyFitter: table, filters and units must have the same size");
+    }
+    for (std::size_t m = 0; m < filters.size(); ++m) {
+        if (filters[m].get_name() != table.get_filter_names()[m]) {
+            throw std::runtime_error("BlackbodyFitter: table built for "
+                                     + table.get_filter_names()[m] + " not " + filters[m].get_name());
+        }
+        this->converters.emplace_back(filters[m]);
+    }
+}
+
+/**
+ * @brief Fit one star from fluxes in flam
+ *
+ * @param flux         band fluxes in flam (n_bands)
+ * @param flux_error   uncertainties in flam (n_bands)
+ * @return BlackbodyFit (NaN and not converged with less than 2 valid bands;
+ *         not converged and at_bound when teff ends on an edge of the table)
+ */
+BlackbodyFit BlackbodyFitter::fit_flux(const double * flux, const double * flux_error) const {
+    const std::size_t nb = this->size();
+    BlackbodyFit result;
+
+    // valid bands: y = f / sigma, w = 1 / sigma
+    std::vector<std::size_t> bands;
+    std::vector<double> y, w;
+    for (std::size_t m = 0; m < nb; ++m) {
+        if (std::isfinite(flux[m]) && std::isfinite(flux_error[m]) && (flux_error[m] > 0)) {
+            bands.push_back(m);
+            y.push_back(flux[m] / flux_error[m]);
+            w.push_back(1. / flux_error[m]);
+        }
+    }
+    const std::size_t n = bands.size();
+    result.n_bands = n;
+    if (n < 2) { return result; }
+    std::vector<double> mu(n), slope(n);
+
+    // model mu = a F(T) / sigma and d log F / d log T at (log T, log a)
+    auto evaluate = [&](double log_teff, double log_amp){
+        const double teff = std::exp(log_teff);
+        const double amp = std::exp(log_amp);
+        double chi2 = 0;
+        for (std::size_t k = 0; k < n; ++k) {
+            double dflux;
+            mu[k] = this->table.get_flux(bands[k], teff, amp, dflux) * w[k];
+            slope[k] = dflux * w[k] * teff / mu[k];
+            const double r = y[k] - mu[k];
+            chi2 += r * r;
+        }
+        ++result.n_eval;
+        return chi2;
+    };
+
+    // profiled chi2: best amplitude at fixed T in closed form (a >= 0)
+    auto profile = [&](double log_teff, double& log_amp){
+        const double teff = std::exp(log_teff);
+        double yf = 0, ff = 0, yy = 0;
+        for (std::size_t k = 0; k < n; ++k) {
+            const double f = this->table.get_flux(bands[k], teff) * w[k];
+            yf += y[k] * f;
+            ff += f * f;
+            yy += y[k] * y[k];
+        }
+        ++result.n_eval;
+        if (yf <= 0) {
+            log_amp = -std::numeric_limits<double>::infinity();
+            return yy;
+        }
+        log_amp = std::log(yf / ff);
+        return yy - yf * yf / ff;
+    };
+
+    // start: coarse scan in temperature with the amplitude profiled out
+    const double log_teff_min = std::log(this->table.get_teff_min());
+    const double log_teff_max = std::log(this->table.get_teff_max());
+    const std::size_t n_scan = 25;
+    const double scan_step = (log_teff_max - log_teff_min) / (n_scan - 1);
+    double log_teff = log_teff_min;
+    double log_amp = 0;
+    double best = std::numeric_limits<double>::infinity();
+    for (std::size_t s = 0; s < n_scan; ++s) {
+        const double lt = log_teff_min + scan_step * s;
+        double la;
+        const double chi2 = profile(lt, la);
+        if (std::isfinite(la) && (chi2 < best)) {
+            best = chi2;
+            log_teff = lt;
+            log_amp = la;
+        }
+    }
+    if (! std::isfinite(best)) { return result; }
+
+    if (this->method == BlackbodyFitMethod::VariableProjection) {
+        // 1D minimization of the profiled chi2 around the best scan node
+        double chi2;
+        log_teff = brent_minimize([&](double lt){ double la; return profile(lt, la); },
+                                  std::max(log_teff - scan_step, log_teff_min), log_teff,
+                                  std::min(log_teff + scan_step, log_teff_max),
+                                  this->tol, this->max_iter, chi2,
+                                  result.n_iter, result.converged);
+        profile(log_teff, log_amp);
+    } else {
+        // Levenberg-Marquardt on (log T, log a)
+        double chi2 = evaluate(log_teff, log_amp);
+        double lambda = 1e-3;
+        for (result.n_iter = 0; result.n_iter < this->max_iter; ++result.n_iter) {
+            double a00 = 0, a01 = 0, a11 = 0, g0 = 0, g1 = 0;
+            for (std::size_t k = 0; k < n; ++k) {
+                const double j0 = mu[k] * slope[k];
+                const double j1 = mu[k];
+                const double r = y[k] - mu[k];
+                a00 += j0 * j0;
+                a01 += j0 * j1;
+                a11 += j1 * j1;
+                g0 += j0 * r;
+                g1 += j1 * r;
+            }
+            bool improved = false;
+            double d0 = 0, d1 = 0;
+            while (lambda < 1e12) {
+                const double b00 = a00 * (1. + lambda);
+                const double b11 = a11 * (1. + lambda);
+                const double det = b00 * b11 - a01 * a01;
+                d0 = (b11 * g0 - a01 * g1) / det;
+                d1 = (b00 * g1 - a01 * g0) / det;
+                const double lt = std::min(std::max(log_teff + d0, log_teff_min), log_teff_max);
+                d0 = lt - log_teff;
+                const double trial = evaluate(log_teff + d0, log_amp + d1);
+                if (trial <= chi2) {
+                    log_teff += d0;
+                    log_amp += d1;
+                    chi2 = trial;
+                    lambda = std::max(lambda * 0.1, 1e-12);
+                    improved = true;
+                    break;
+                }
+                lambda *= 10.;
+            }
+            if (! improved) {
+                // no downhill step: a minimum only if the gradient vanishes
+                // (cosine between the residuals and the Jacobian columns)
+                const double gtol = 1e-6;
+                result.converged = (std::abs(g0) <= gtol * std::sqrt(a00 * chi2))
+                                   && (std::abs(g1) <= gtol * std::sqrt(a11 * chi2));
+                break;
+            }
+            if ((std::abs(d0) < this->tol) && (std::abs(d1) < this->tol)) {
+                result.converged = true;
+                break;
+            }
+        }
+    }
+
+    // a minimum on the temperature range of the table is not a solution
+    const double edge = 1e-9 * (log_teff_max - log_teff_min);
+    result.at_bound = (log_teff <= log_teff_min + edge) || (log_teff >= log_teff_max - edge);
+    result.converged = result.converged && (! result.at_bound);
+
+    // covariance of (log T, log a) at the solution
+    const double chi2 = evaluate(log_teff, log_amp);
+    double a00 = 0, a01 = 0, a11 = 0;
+    for (std::size_t k = 0; k < n; ++k) {
+        a00 += mu[k] * slope[k] * mu[k] * slope[k];
+        a01 += mu[k] * slope[k] * mu[k];
+        a11 += mu[k] * mu[k];
+    }
+    const double det = a00 * a11 - a01 * a01;
+    result.teff = std::exp(log_teff);
+    result.amp = std::exp(log_amp);
+    result.teff_error = result.teff * std::sqrt(a11 / det);
+    result.amp_error = result.amp * std::sqrt(a00 / det);
+    result.chi2 = chi2;
+    return result;
+}
+
+/**
+ * @brief Convert the catalog values of one star to flam
+ *
+ * @param values       catalog values in the units of the bands (n_bands)
+ * @param errors       catalog uncertainties (n_bands)
+ * @param flux         set to the fluxes in flam (n_bands)
+ * @param flux_error   set to the uncertainties in flam (n_bands)
+ */
+void BlackbodyFitter::to_flux(const double * values, const double * errors,
+                              double * flux, double * flux_error) const {
+    for (std::size_t m = 0; m < this->size(); ++m) {
+        this->converters[m].convert(values + m, errors + m, 1, this->units[m],
+                                    PhotometricUnit::flam, flux + m, flux_error + m);
+    }
+}
+
+/**
+ * @brief Fit one star from catalog values
+ *
+ * @param values   catalog values in the units of the bands (n_bands)
+ * @param errors   catalog uncertainties (n_bands)
+ * @return BlackbodyFit
+ */
+BlackbodyFit BlackbodyFitter::fit(const double * values, const double * errors) const {
+    std::vector<double> flux(this->size()), flux_error(this->size());
+    this->to_flux(values, errors, flux.data(), flux_error.data());
+    return this->fit_flux(flux.data(), flux_error.data());
+}
+
+/**
+ * @brief Fit a catalog
+ *
+ * The stars are distributed over worker threads.
+ *
+ * @param values      catalog values (n_stars, n_bands)
+ * @param errors      catalog uncertainties (n_stars, n_bands)
+ * @param n_threads   number of threads (0 for the hardware concurrency)
+ * @return fits of every star
+ * @throw std::runtime_error if the shapes do not match the bands
+ */
+std::vector<BlackbodyFit> BlackbodyFitter::fit(const DMatrix& values, const DMatrix& errors,
+                                               std::size_t n_threads) const {
+    const std::size_t nb = this->size();
+    if ((values.dimension() != 2) || (values.shape()[1] != nb) || (errors.shape() != values.shape())) {
+        throw std::runtime_error("BlackbodyFitter: values and errors must be of shape (n_stars, "
+                                 + std::to_string(nb) + ")");
+    }
+    const std::size_t n_stars = values.shape()[0];
+    std::vector<BlackbodyFit> results(n_stars);
+    parallel_for(n_stars, [&](std::size_t i){
+        results[i] = this->fit(values.data() + i * nb, errors.data() + i * nb);
+    }, n_threads);
+    return results;
+}
+
+/**
+ * @ingroup BBFIT
+ * @brief Read photometry columns from a CSV catalog
+ *
+ * Each band `name` is read from the column `name` and its uncertainty from
+ * `name_error`. Empty or non numerical entries are set to NaN.
+ *
+ * @param path      CSV file with a header line
+ * @param columns   band column names
+ * @param values    set to the values (n_stars, n_bands)
+ * @param errors    set to the uncertainties (n_stars, n_bands)
+ * @throw std::out_of_range if a column is missing
+ */
+void read_catalog_photometry(const std::string& path,
+                             const std::vector<std::string>& columns,
+                             DMatrix& values, DMatrix& errors){
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    rapidcsv::Document doc(path, rapidcsv::LabelParams(0, -1), rapidcsv::SeparatorParams(),
+                           rapidcsv::ConverterParams(true, nan));
+    const std::size_t n_stars = doc.GetRowCount();
+    const std::size_t nb = columns.size();
+    values = DMatrix::from_shape({n_stars, nb});
+    errors = DMatrix::from_shape({n_stars, nb});
+    for (std::size_t m = 0; m < nb; ++m) {
+        const std::vector<double> v = doc.GetColumn<double>(columns[m]);
+        const std::vector<double> e = doc.GetColumn<double>(columns[m] + "_error");
+        for (std::size_t i = 0; i < n_stars; ++i) {
+            values(i, m) = v[i];
+            errors(i, m) = e[i];
+        }
+    }
+}
+
+} // namespace cphot
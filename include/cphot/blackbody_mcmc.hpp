@@ -0,0 +1,433 @@
+/**
+ * @defgroup MCMC Blackbody posteriors
+ * @brief Affine-invariant ensemble sampling of (Teff, amp) posteriors.
+ *
+ * `BlackbodyFit` reports symmetric uncertainties from the curvature of the
+ * chi2 at the best fit. A `BlackbodySampler` samples the full posterior
+ *
+ * \f[
+ * \log p(\log T, \log a) = -\chi^2(T, a) / 2
+ * \f]
+ *
+ * with flat priors in \f$\log T\f$ over the temperature range of the
+ * `BlackbodyTable` and in \f$\log a\f$, using the stretch move of Goodman &
+ * Weare (2010): a walker \f$X_j\f$ moves to
+ * \f$Y = X_p + z (X_j - X_p)\f$ with \f$X_p\f$ a walker of the complementary
+ * half of the ensemble and \f$z \sim 1/\sqrt{z}\f$ on \f$[1/s, s]\f$, and is
+ * accepted with probability \f$\min(1, z\,p(Y)/p(X_j))\f$.
+ *
+ * - The walkers are stored as arrays of log T, log amp and log probability
+ *   (structure of arrays); each half of the ensemble is proposed, evaluated
+ *   and accepted as one batch, with the arithmetic in `#pragma omp simd`
+ *   loops and the logarithms from `vlog`.
+ * - Random numbers come from the counter based Philox4x32-10 generator keyed
+ *   by the seed and indexed by (star, step, walker): the chains of a star do
+ *   not depend on the number of threads or on the other stars.
+ * - The walkers start in a small ball around the best fit of the fitter.
+ * - Stars are sampled concurrently over worker threads.
+ *
+ * Posteriors are summarized by the 16, 50 and 84 percentiles of teff and amp
+ * and can be written with their chains (float32) in a compact binary file
+ * (`write_posteriors`, `read_posteriors`).
+ *
+ * ```cpp
+ * cphot::BlackbodySampler sampler(fitter, 32, 2000, 500);
+ * std::vector<cphot::BlackbodyPosterior> posteriors = sampler.sample(values, errors);
+ * cphot::write_posteriors("posteriors.bin", posteriors);
+ * ```
+ */
+#pragma once
+#include "blackbody_fit.hpp"
+#include "parallel.hpp"
+#include "vectormath.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+namespace rng {
+
+/**
+ * @brief Philox4x32-10 counter based generator (Salmon et al. 2011)
+ *
+ * @param counter   128 bit counter
+ * @param key       64 bit key
+ * @return 4 random 32 bit words
+ */
+inline std::array<std::uint32_t, 4> philox4x32(std::array<std::uint32_t, 4> counter,
+                                               std::array<std::uint32_t, 2> key){
+    for (int round = 0; round < 10; ++round) {
+        const std::uint64_t p0 = std::uint64_t(0xD2511F53) * counter[0];
+        const std::uint64_t p1 = std::uint64_t(0xCD9E8D57) * counter[2];
+        counter = {std::uint32_t(p1 >> 32) ^ counter[1] ^ key[0], std::uint32_t(p1),
+                   std::uint32_t(p0 >> 32) ^ counter[3] ^ key[1], std::uint32_t(p0)};
+        key[0] += 0x9E3779B9;
+        key[1] += 0xBB67AE85;
+    }
+    return counter;
+}
+
+/**
+ * @brief Uniform double in (0, 1) from two 32 bit words (53 bits)
+ */
+inline double uniform(std::uint32_t hi, std::uint32_t lo){
+    const std::uint64_t bits = ((std::uint64_t(hi) << 32) | lo) >> 11;
+    return (double(bits) + 0.5) * 1.1102230246251565e-16;
+}
+
+} // namespace rng
+
+/**
+ * @ingroup MCMC
+ * @brief Posterior samples and summary of one star
+ */
+struct BlackbodyPosterior {
+    std::array<double, 3> teff = {{std::nan(""), std::nan(""), std::nan("")}};  ///< teff percentiles 16, 50, 84
+    std::array<double, 3> amp = {{std::nan(""), std::nan(""), std::nan("")}};   ///< amp percentiles 16, 50, 84
+    double acceptance = 0;       ///< fraction of accepted moves
+    std::vector<float> chain;    ///< samples (n_samples, 2): teff, amp
+};
+
+/**
+ * @ingroup MCMC
+ * @brief Parallel ensemble sampler of blackbody posteriors
+ */
+class BlackbodySampler {
+    private:
+        BlackbodyFitter fitter;     ///< likelihood and start points
+        std::size_t n_walkers;      ///< number of walkers (even)
+        std::size_t n_steps;        ///< number of steps after burn-in
+        std::size_t n_burn;         ///< number of burn-in steps
+        std::size_t thin;           ///< keep one step every thin
+        std::uint64_t seed;         ///< key of the random streams
+        bool keep_chains;           ///< store the chains in the posteriors
+        double stretch = 2.;        ///< scale parameter of the stretch move
+
+    public:
+        BlackbodySampler(const BlackbodyFitter& fitter,
+                         std::size_t n_walkers = 32,
+                         std::size_t n_steps = 1000,
+                         std::size_t n_burn = 500,
+                         std::size_t thin = 1,
+                         std::uint64_t seed = 42,
+                         bool keep_chains = true);
+
+        BlackbodyPosterior sample_flux(const double * flux, const double * flux_error,
+                                       std::uint64_t stream) const;
+        std::vector<BlackbodyPosterior> sample(const DMatrix& values, const DMatrix& errors,
+                                               std::size_t n_threads = 0) const;
+
+        std::size_t n_samples() const { return this->n_walkers * (this->n_steps / this->thin); }
+};
+
+/**
+ * @brief Construct a new Blackbody Sampler object
+ *
+ * @param fitter        fitter of the bands (likelihood and start points)
+ * @param n_walkers     number of walkers (even, at least 4)
+ * @param n_steps       number of steps after burn-in
+ * @param n_burn        number of burn-in steps
+ * @param thin          keep one step every thin
+ * @param seed          seed of the random streams
+ * @param keep_chains   store the chains (otherwise only the summaries)
+ * @throw std::runtime_error on an invalid ensemble
+ */
+BlackbodySampler::BlackbodySampler(const BlackbodyFitter& fitter,
+                                   std::size_t n_walkers,
+                                   std::size_t n_steps,
+                                   std::size_t n_burn,
+                                   std::size_t thin,
+                                   std::uint64_t seed,
+                                   bool keep_chains)
+    : fitter(fitter), n_walkers(n_walkers), n_steps(n_steps), n_burn(n_burn),
+      thin(std::max<std::size_t>(thin, 1)), seed(seed), keep_chains(keep_chains) {
+    if ((n_walkers < 4) || (n_walkers % 2 != 0)) {
+        throw std::runtime_error("BlackbodySampler: the number of walkers must be even and at least 4");
+    }
+}
+
+/**
+ * @brief Sample the posterior of one star from fluxes in flam
+ *
+ * @param flux         band fluxes in flam (n_bands)
+ * @param flux_error   uncertainties in flam (n_bands)
+ * @param stream       index of the random stream (e.g. the star index)
+ * @return BlackbodyPosterior (NaN summaries if the best fit fails)
+ */
+BlackbodyPosterior BlackbodySampler::sample_flux(const double * flux, const double * flux_error,
+                                                 std::uint64_t stream) const {
+    BlackbodyPosterior posterior;
+    const BlackbodyFit start = this->fitter.fit_flux(flux, flux_error);
+    if (!(std::isfinite(start.teff) && std::isfinite(start.amp))) { return posterior; }
+
+    // valid bands: y = f / sigma, w = 1 / sigma
+    const BlackbodyTable& table = this->fitter.get_table();
+    std::vector<std::size_t> bands;
+    std::vector<double> y, w;
+    for (std::size_t m = 0; m < this->fitter.size(); ++m) {
+        if (std::isfinite(flux[m]) && std::isfinite(flux_error[m]) && (flux_error[m] > 0)) {
+            bands.push_back(m);
+            y.push_back(flux[m] / flux_error[m]);
+            w.push_back(1. / flux_error[m]);
+        }
+    }
+    const double log_teff_min = std::log(table.get_teff_min());
+    const double log_teff_max = std::log(table.get_teff_max());
+    auto log_prob = [&](double log_teff, double log_amp){
+        if (!((log_teff >= log_teff_min) && (log_teff <= log_teff_max))) {
+            return -std::numeric_limits<double>::infinity();
+        }
+        const double teff = std::exp(log_teff);
+        const double amp = std::exp(log_amp);
+        double chi2 = 0;
+        for (std::size_t k = 0; k < bands.size(); ++k) {
+            const double r = y[k] - table.get_flux(bands[k], teff, amp) * w[k];
+            chi2 += r * r;
+        }
+        return -0.5 * chi2;
+    };
+
+    const std::array<std::uint32_t, 2> key = {{std::uint32_t(this->seed), std::uint32_t(this->seed >> 32)}};
+    const std::uint32_t stream_lo = std::uint32_t(stream);
+    const std::uint32_t stream_hi = std::uint32_t(stream >> 32);
+
+    // walkers (structure of arrays) in a ball around the best fit
+    const std::size_t nw = this->n_walkers;
+    const std::size_t nh = nw / 2;
+    std::vector<double> lt(nw), la(nw), lp(nw);
+    // a tenth of the relative uncertainties, the floor when the fit has none
+    auto spread = [](double error, double value){
+        const double scale = 0.1 * error / value;
+        return std::isfinite(scale) ? std::max(scale, 1e-4) : 1e-4;
+    };
+    const double scale_t = spread(start.teff_error, start.teff);
+    const double scale_a = spread(start.amp_error, start.amp);
+    const double two_pi = 6.283185307179586;
+    for (std::size_t j = 0; j < nw; ++j) {
+        const auto r = rng::philox4x32({{std::uint32_t(j), 0xFFFFFFFFu, stream_lo, stream_hi}}, key);
+        const double radius = std::sqrt(-2. * std::log(rng::uniform(r[0], r[1])));
+        const double angle = two_pi * rng::uniform(r[2], r[3]);
+        lt[j] = std::min(std::max(std::log(start.teff) + scale_t * radius * std::cos(angle),
+                                  log_teff_min), log_teff_max);
+        la[j] = std::log(start.amp) + scale_a * radius * std::sin(angle);
+        lp[j] = log_prob(lt[j], la[j]);
+    }
+
+    // batches of the proposals of one half of the ensemble
+    std::vector<double> z(nh), u(nh), pt(nh), pa(nh), plp(nh), log_z(nh), log_u(nh);
+    std::vector<std::size_t> partner(nh);
+    const double a = this->stretch;
+    const std::size_t n_total = this->n_burn + this->n_steps;
+    std::size_t n_accepted = 0;
+    // the samples are needed for the percentiles even without keep_chains
+    posterior.chain.reserve(2 * this->n_samples());
+
+    for (std::size_t step = 0; step < n_total; ++step) {
+        for (std::size_t half = 0; half < 2; ++half) {
+            const std::size_t first = half * nh;
+            const std::size_t other = (1 - half) * nh;
+            // draws: stretch factor, acceptance and partner in the other half
+            for (std::size_t j = 0; j < nh; ++j) {
+                const std::uint32_t walker = std::uint32_t(2 * (first + j));
+                const auto r0 = rng::philox4x32({{walker, std::uint32_t(step), stream_lo, stream_hi}}, key);
+                const auto r1 = rng::philox4x32({{walker + 1, std::uint32_t(step), stream_lo, stream_hi}}, key);
+                const double g = (a - 1.) * rng::uniform(r0[0], r0[1]) + 1.;
+                z[j] = g * g / a;
+                u[j] = rng::uniform(r0[2], r0[3]);
+                partner[j] = other + std::min(nh - 1, std::size_t(rng::uniform(r1[0], r1[1]) * nh));
+            }
+            // proposals
+            #pragma omp simd
+            for (std::size_t j = 0; j < nh; ++j) {
+                const std::size_t p = partner[j];
+                pt[j] = lt[p] + z[j] * (lt[first + j] - lt[p]);
+                pa[j] = la[p] + z[j] * (la[first + j] - la[p]);
+            }
+            for (std::size_t j = 0; j < nh; ++j) { plp[j] = log_prob(pt[j], pa[j]); }
+            // acceptance: log u < (d - 1) log z + log p(Y) - log p(X) with d = 2
+            vlog(z.data(), log_z.data(), nh);
+            vlog(u.data(), log_u.data(), nh);
+            std::size_t accepted = 0;
+            #pragma omp simd reduction(+:accepted)
+            for (std::size_t j = 0; j < nh; ++j) {
+                const bool accept = log_u[j] < log_z[j] + plp[j] - lp[first + j];
+                lt[first + j] = accept ? pt[j] : lt[first + j];
+                la[first + j] = accept ? pa[j] : la[first + j];
+                lp[first + j] = accept ? plp[j] : lp[first + j];
+                accepted += accept;
+            }
+            if (step >= this->n_burn) { n_accepted += accepted; }
+        }
+        if ((step >= this->n_burn) && ((step - this->n_burn) % this->thin == this->thin - 1)) {
+            for (std::size_t j = 0; j < nw; ++j) {
+                posterior.chain.push_back(static_cast<float>(std::exp(lt[j])));
+                posterior.chain.push_back(static_cast<float>(std::exp(la[j])));
+            }
+        }
+    }
+    posterior.acceptance = (this->n_steps > 0) ? double(n_accepted) / (nw * this->n_steps) : 0.;
+
+    // percentiles of the finite samples
+    const std::size_t n_chain = posterior.chain.size() / 2;
+    std::vector<double> values;
+    values.reserve(n_chain);
+    for (std::size_t p = 0; p < 2; ++p) {
+        values.clear();
+        for (std::size_t i = 0; i < n_chain; ++i) {
+            const double v = posterior.chain[2 * i + p];
+            if (std::isfinite(v)) { values.push_back(v); }
+        }
+        const std::size_t n = values.size();
+        if (n > 0) {
+            std::array<double, 3>& q = (p == 0) ? posterior.teff : posterior.amp;
+            const std::array<double, 3> levels = {{0.16, 0.5, 0.84}};
+            for (std::size_t l = 0; l < 3; ++l) {
+                const std::size_t rank = std::min(n - 1, std::size_t(levels[l] * n));
+                std::nth_element(values.begin(), values.begin() + rank, values.end());
+                q[l] = values[rank];
+            }
+        }
+    }
+    if (! this->keep_chains) {
+        std::vector<float>().swap(posterior.chain);
+    }
+    return posterior;
+}
+
+/**
+ * @brief Sample the posteriors of a catalog
+ *
+ * Star i uses the random stream i, so that the results do not depend on the
+ * number of threads.
+ *
+ * @param values      catalog values in the units of the bands (n_stars, n_bands)
+ * @param errors      catalog uncertainties (n_stars, n_bands)
+ * @param n_threads   number of threads (0 for the hardware concurrency)
+ * @return posteriors of every star
+ * @throw std::runtime_error if the shapes do not match the bands
+ */
+std::vector<BlackbodyPosterior> BlackbodySampler::sample(const DMatrix& values, const DMatrix& errors,
+                                                         std::size_t n_threads) const {
+    const std::size_t nb = this->fitter.size();
+    if ((values.dimension() != 2) || (values.shape()[1] != nb) || (errors.shape() != values.shape())) {
+        throw std::runtime_error("BlackbodySampler: values and errors must be of shape (n_stars, "
+                                 + std::to_string(nb) + ")");
+    }
+    const std::size_t n_stars = values.shape()[0];
+    std::vector<BlackbodyPosterior> posteriors(n_stars);
+    parallel_for(n_stars, [&](std::size_t i){
+        std::vector<double> flux(nb), flux_error(nb);
+        this->fitter.to_flux(values.data() + i * nb, errors.data() + i * nb,
+                             flux.data(), flux_error.data());
+        posteriors[i] = this->sample_flux(flux.data(), flux_error.data(), i);
+    }, n_threads);
+    return posteriors;
+}
+
+/**
+ * @ingroup MCMC
+ * @brief Write posteriors to a binary file
+ *
+ * Layout (little endian on the usual platforms): the 8 bytes "CPHOTBB1",
+ * the number of stars and of samples per star (uint64), then per star 7
+ * doubles (teff and amp percentiles, acceptance) followed by the chain as
+ * (n_samples, 2) float32. The number of samples is 0 without chains.
+ *
+ * @param path          output file
+ * @param posteriors    posteriors (all with the same number of samples)
+ * @param with_chains   write the chains
+ * @throw std::runtime_error if the file cannot be written or chains differ in size
+ */
+void write_posteriors(const std::string& path,
+                      const std::vector<BlackbodyPosterior>& posteriors,
+                      bool with_chains = true){
+    std::uint64_t n_samples = 0;
+    for (const auto& p : posteriors) {
+        n_samples = std::max<std::uint64_t>(n_samples, p.chain.size() / 2);
+    }
+    if (! with_chains) { n_samples = 0; }
+    std::ofstream out(path, std::ios::binary);
+    if (! out) {
+        throw std::runtime_error("write_posteriors: cannot write " + path);
+    }
+    const std::uint64_t n_stars = posteriors.size();
+    out.write("CPHOTBB1", 8);
+    out.write(reinterpret_cast<const char*>(&n_stars), sizeof(n_stars));
+    out.write(reinterpret_cast<const char*>(&n_samples), sizeof(n_samples));
+    const std::vector<float> missing(2 * n_samples, std::nanf(""));
+    for (const auto& p : posteriors) {
+        const double summary[7] = {p.teff[0], p.teff[1], p.teff[2],
+                                   p.amp[0], p.amp[1], p.amp[2], p.acceptance};
+        out.write(reinterpret_cast<const char*>(summary), sizeof(summary));
+        if (n_samples == 0) { continue; }
+        // stars without samples (failed fits) are padded with NaN
+        if ((p.chain.size() != 0) && (p.chain.size() != 2 * n_samples)) {
+            throw std::runtime_error("write_posteriors: chains must have the same length");
+        }
+        const std::vector<float>& chain = p.chain.empty() ? missing : p.chain;
+        out.write(reinterpret_cast<const char*>(chain.data()), chain.size() * sizeof(float));
+    }
+    if (! out) {
+        throw std::runtime_error("write_posteriors: cannot write " + path);
+    }
+}
+
+/**
+ * @ingroup MCMC
+ * @brief Read posteriors written by `write_posteriors`
+ *
+ * @param path   input file
+ * @return posteriors
+ * @throw std::runtime_error if the file is not a posterior file or if its size
+ *        does not match the star and sample counts of its header
+ */
+std::vector<BlackbodyPosterior> read_posteriors(const std::string& path){
+    std::ifstream in(path, std::ios::binary);
+    char magic[8];
+    std::uint64_t n_stars = 0, n_samples = 0;
+    in.read(magic, 8);
+    in.read(reinterpret_cast<char*>(&n_stars), sizeof(n_stars));
+    in.read(reinterpret_cast<char*>(&n_samples), sizeof(n_samples));
+    if ((! in) || (std::memcmp(magic, "CPHOTBB1", 8) != 0)) {
+        throw std::runtime_error("read_posteriors: " + path + " is not a posterior file");
+    }
+    // check the counts against the file size before allocating
+    const std::streamoff header = in.tellg();
+    in.seekg(0, std::ios::end);
+    const std::uint64_t payload = static_cast<std::uint64_t>(in.tellg() - header);
+    in.seekg(header);
+    const std::uint64_t chain_bytes = 2 * sizeof(float);
+    const std::uint64_t record = 7 * sizeof(double) + chain_bytes * n_samples;
+    if ((n_samples > payload / chain_bytes) || (n_stars != payload / record)
+        || (payload % record != 0)) {
+        throw std::runtime_error("read_posteriors: the size of " + path
+                                 + " does not match its header");
+    }
+    std::vector<BlackbodyPosterior> posteriors(n_stars);
+    for (auto& p : posteriors) {
+        double summary[7];
+        in.read(reinterpret_cast<char*>(summary), sizeof(summary));
+        p.teff = {{summary[0], summary[1], summary[2]}};
+        p.amp = {{summary[3], summary[4], summary[5]}};
+        p.acceptance = summary[6];
+        p.chain.resize(2 * n_samples);
+        in.read(reinterpret_cast<char*>(p.chain.data()), p.chain.size() * sizeof(float));
+    }
+    if (! in) {
+        throw std::runtime_error("read_posteriors: truncated file " + path);
+    }
+    return posteriors;
+}
+
+} // namespace cphot
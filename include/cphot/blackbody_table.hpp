@@ -0,0 +1,439 @@
+/**
+ * @defgroup BBTABLE Blackbody lookup tables
+ * @brief Band fluxes of unit blackbodies tabulated in temperature.
+ *
+ * The band flux of a blackbody is \f$ a\,F_m(T) \f$ where the amplitude
+ * \f$a\f$ is a scale factor, so fitting temperatures only ever needs the
+ * one dimensional functions \f$F_m(T)\f$ of every filter \f$m\f$. A
+ * `BlackbodyTable` tabulates \f$\log F_m\f$ and its exact derivative
+ * \f$d \log F_m / d \log T\f$ (from `Filter::get_flux` with gradients) on a
+ * uniform grid in \f$\log T\f$, and evaluates them with cubic Hermite
+ * splines: a lookup is an index computation and a few multiplications.
+ *
+ * The grid is refined by halving its step until the interpolation error,
+ * measured at the midpoints against direct integrations, is below the
+ * requested relative tolerance. The measured error of the last coarser grid
+ * is kept as a (conservative) bound of the final table (`get_max_error`).
+ * A tolerance that 8193 nodes cannot reach is an error: the constructor
+ * throws instead of returning (and `load_or_build` caching) a coarser table.
+ *
+ * Tables are built over worker threads and can be cached in a text file;
+ * `load_or_build` rebuilds the table when the filters or settings changed.
+ *
+ * ```cpp
+ * cphot::BlackbodyTable table = cphot::BlackbodyTable::load_or_build(filters, "bb_table.txt");
+ * double f = table.get_flux(m, 5800., amp);   // flam
+ * ```
+ */
+#pragma once
+#include "filter.hpp"
+#include "parallel.hpp"
+#include "rquantities.hpp"
+#include <blackbody.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup BBTABLE
+ * @brief Tabulated band fluxes of unit blackbodies over log temperature
+ */
+class BlackbodyTable {
+    private:
+        std::vector<std::string> names;      ///< filter names in order
+        std::vector<std::uint64_t> hashes;   ///< hash of each filter definition
+        std::vector<double> max_error;       ///< relative error bound per filter
+        double rel_tol = 0;                  ///< requested tolerance
+        double log_teff_min = 0;             ///< log of the first node
+        double log_teff_max = 0;             ///< log of the last node
+        double step = 0;                     ///< node spacing in log T
+        std::size_t n_nodes = 0;             ///< number of temperature nodes
+        std::vector<double> log_flux;        ///< log F (n_nodes, n_filters)
+        std::vector<double> slope;           ///< d log F / d log T (n_nodes, n_filters)
+
+        BlackbodyTable() = default;
+        static std::uint64_t filter_hash(const Filter& filter);
+        static void evaluate(const std::vector<Filter>& filters, double log_teff,
+                             double * log_flux, double * slope);
+        void locate(double teff, std::size_t& i, double& t) const;
+
+    public:
+        BlackbodyTable(const std::vector<Filter>& filters,
+                       double rel_tol = 1e-6,
+                       double teff_min = 1000.,
+                       double teff_max = 200000.,
+                       std::size_t n_threads = 0);
+
+        static BlackbodyTable load(const std::string& path);
+        static BlackbodyTable load_or_build(const std::vector<Filter>& filters,
+                                            const std::string& path,
+                                            double rel_tol = 1e-6,
+                                            double teff_min = 1000.,
+                                            double teff_max = 200000.,
+                                            std::size_t n_threads = 0);
+        void save(const std::string& path) const;
+
+        double get_flux(std::size_t m, double teff, double amp = 1.) const;
+        double get_flux(std::size_t m, double teff, double amp, double& dflux_dteff) const;
+        DMatrix get_fluxes(double teff, double amp = 1.) const;
+
+        std::size_t size() const { return this->names.size(); }
+        std::size_t n_teff() const { return this->n_nodes; }
+        double get_teff_min() const { return std::exp(this->log_teff_min); }
+        double get_teff_max() const { return std::exp(this->log_teff_max); }
+        double get_rel_tol() const { return this->rel_tol; }
+        const std::vector<double>& get_max_error() const { return this->max_error; }
+        const std::vector<std::string>& get_filter_names() const { return this->names; }
+};
+
+/**
+ * @brief FNV-1a hash of a filter definition (wavelength, transmission, type)
+ */
+std::uint64_t BlackbodyTable::filter_hash(const Filter& filter){
+    std::uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const DMatrix& values){
+        for (double v : values) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            hash = (hash ^ bits) * 1099511628211ULL;
+        }
+    };
+    add(filter.get_wavelength());
+    add(filter.get_transmission());
+    hash = (hash ^ (filter.is_photon_type() ? 1ULL : 2ULL)) * 1099511628211ULL;
+    return hash;
+}
+
+/**
+ * @brief Exact log band fluxes and log slopes of a unit blackbody
+ *
+ * @param filters    filters
+ * @param log_teff   log of the temperature
+ * @param log_flux   set to log F_m (n_filters)
+ * @param slope      set to d log F_m / d log T (n_filters)
+ * @throw std::runtime_error if a band flux is not positive
+ */
+void BlackbodyTable::evaluate(const std::vector<Filter>& filters, double log_teff,
+                              double * log_flux, double * slope){
+    const double teff = std::exp(log_teff);
+    for (std::size_t m = 0; m < filters.size(); ++m) {
+        const Filter& filter = filters[m];
+        const DMatrix& wave = filter.get_wavelength();
+        DMatrix flux_gradient;
+        DMatrix flux = bb_flux_gradient(wave, 1., teff, flux_gradient);
+        DMatrix gradient;
+        const double f = filter.get_flux(wave, flux, flux_gradient, nm, flam, gradient).to(flam);
+        if (!(f > 0)) {
+            throw std::runtime_error("BlackbodyTable: null band flux in " + filter.get_name()
+                                     + " at " + std::to_string(teff) + " K");
+        }
+        log_flux[m] = std::log(f);
+        slope[m] = teff * gradient[1] / f;
+    }
+}
+
+/**
+ * @brief Build the table
+ *
+ * Starts from 33 nodes and halves the step until the midpoint error is below
+ * rel_tol for all the filters, with at most 8193 nodes.
+ *
+ * @param filters     filters in the order of the outputs
+ * @param rel_tol     relative tolerance on the band fluxes
+ * @param teff_min    lowest temperature in K
+ * @param teff_max    highest temperature in K
+ * @param n_threads   number of threads (0 for the hardware concurrency)
+ * @throw std::runtime_error on invalid ranges, null band fluxes, or if rel_tol
+ *        is not reached with 8193 nodes
+ */
+BlackbodyTable::BlackbodyTable(const std::vector<Filter>& filters,
+                               double rel_tol,
+                               double teff_min,
+                               double teff_max,
+                               std::size_t n_threads)
+    : rel_tol(rel_tol) {
+    if (!((teff_min > 0) && (teff_max > teff_min))) {
+        throw std::runtime_error("BlackbodyTable: invalid temperature range");
+    }
+    const std::size_t n_filters = filters.size();
+    for (const auto& filter : filters) {
+        this->names.push_back(filter.get_name());
+        this->hashes.push_back(filter_hash(filter));
+    }
+    this->log_teff_min = std::log(teff_min);
+    this->log_teff_max = std::log(teff_max);
+
+    const std::size_t max_nodes = 8193;
+    this->n_nodes = 33;
+    this->step = (this->log_teff_max - this->log_teff_min) / (this->n_nodes - 1);
+    this->log_flux.resize(this->n_nodes * n_filters);
+    this->slope.resize(this->n_nodes * n_filters);
+    parallel_for(this->n_nodes, [&](std::size_t i){
+        evaluate(filters, this->log_teff_min + i * this->step,
+                 &this->log_flux[i * n_filters], &this->slope[i * n_filters]);
+    }, n_threads);
+
+    while (true) {
+        // exact values at the midpoints, compared to the interpolation
+        const std::size_t n_mid = this->n_nodes - 1;
+        std::vector<double> mid_flux(n_mid * n_filters);
+        std::vector<double> mid_slope(n_mid * n_filters);
+        parallel_for(n_mid, [&](std::size_t i){
+            evaluate(filters, this->log_teff_min + (i + 0.5) * this->step,
+                     &mid_flux[i * n_filters], &mid_slope[i * n_filters]);
+        }, n_threads);
+
+        this->max_error.assign(n_filters, 0.);
+        for (std::size_t i = 0; i < n_mid; ++i) {
+            for (std::size_t m = 0; m < n_filters; ++m) {
+                // Hermite interpolation at t = 1/2
+                const double y0 = this->log_flux[i * n_filters + m];
+                const double y1 = this->log_flux[(i + 1) * n_filters + m];
+                const double d0 = this->slope[i * n_filters + m];
+                const double d1 = this->slope[(i + 1) * n_filters + m];
+                const double y = 0.5 * (y0 + y1) + 0.125 * this->step * (d0 - d1);
+                const double error = std::abs(std::expm1(y - mid_flux[i * n_filters + m]));
+                this->max_error[m] = std::max(this->max_error[m], error);
+            }
+        }
+        const double worst = *std::max_element(this->max_error.begin(), this->max_error.end());
+
+        // interleave the midpoints: the refined grid is already evaluated
+        std::vector<double> flux(n_filters * (2 * n_mid + 1));
+        std::vector<double> slope(n_filters * (2 * n_mid + 1));
+        for (std::size_t i = 0; i < this->n_nodes; ++i) {
+            std::copy_n(&this->log_flux[i * n_filters], n_filters, &flux[2 * i * n_filters]);
+            std::copy_n(&this->slope[i * n_filters], n_filters, &slope[2 * i * n_filters]);
+            if (i < n_mid) {
+                std::copy_n(&mid_flux[i * n_filters], n_filters, &flux[(2 * i + 1) * n_filters]);
+                std::copy_n(&mid_slope[i * n_filters], n_filters, &slope[(2 * i + 1) * n_filters]);
+            }
+        }
+        this->log_flux.swap(flux);
+        this->slope.swap(slope);
+        this->n_nodes = 2 * n_mid + 1;
+        this->step *= 0.5;
+
+        if (worst <= rel_tol) { break; }
+        if (2 * this->n_nodes - 1 > max_nodes) {
+            std::ostringstream msg;
+            msg << "BlackbodyTable: relative tolerance " << rel_tol << " not reached with "
+                << this->n_nodes << " nodes (error bound " << worst
+                << "), increase rel_tol or narrow the temperature range";
+            throw std::runtime_error(msg.str());
+        }
+    }
+}
+
+/**
+ * @brief Interval and position of a temperature on the grid
+ *
+ * @param teff   temperature in K
+ * @param i      set to the interval index
+ * @param t      set to the position in the interval [0, 1]
+ * @throw std::runtime_error if teff is outside the table
+ */
+void BlackbodyTable::locate(double teff, std::size_t& i, double& t) const {
+    const double s = (std::log(teff) - this->log_teff_min) / this->step;
+    if (!((s >= -1e-9) && (s <= (this->n_nodes - 1) + 1e-9))) {
+        throw std::runtime_error("BlackbodyTable: temperature " + std::to_string(teff)
+                                 + " K outside the table");
+    }
+    const double sc = std::min(std::max(s, 0.), double(this->n_nodes - 1));
+    i = std::min(static_cast<std::size_t>(sc), this->n_nodes - 2);
+    t = sc - i;
+}
+
+/**
+ * @brief Band flux of a blackbody
+ *
+ * @param m      filter index
+ * @param teff   temperature in K
+ * @param amp    amplitude
+ * @return band flux in flam
+ */
+double BlackbodyTable::get_flux(std::size_t m, double teff, double amp) const {
+    double unused;
+    return this->get_flux(m, teff, amp, unused);
+}
+
+/**
+ * @brief Band flux of a blackbody and its derivative with respect to teff
+ *
+ * @param m              filter index
+ * @param teff           temperature in K
+ * @param amp            amplitude
+ * @param dflux_dteff    set to the derivative in flam / K
+ * @return band flux in flam (the derivative with respect to amp is flux / amp)
+ */
+double BlackbodyTable::get_flux(std::size_t m, double teff, double amp,
+                                double& dflux_dteff) const {
+    std::size_t i;
+    double t;
+    this->locate(teff, i, t);
+    const std::size_t nf = this->names.size();
+    const double h = this->step;
+    const double y0 = this->log_flux[i * nf + m];
+    const double y1 = this->log_flux[(i + 1) * nf + m];
+    const double d0 = this->slope[i * nf + m] * h;
+    const double d1 = this->slope[(i + 1) * nf + m] * h;
+    const double t2 = t * t;
+    const double t3 = t2 * t;
+    const double y = (2 * t3 - 3 * t2 + 1) * y0 + (t3 - 2 * t2 + t) * d0
+                   + (-2 * t3 + 3 * t2) * y1 + (t3 - t2) * d1;
+    const double dy = ((6 * t2 - 6 * t) * (y0 - y1) + (3 * t2 - 4 * t + 1) * d0
+                      + (3 * t2 - 2 * t) * d1) / h;
+    const double flux = amp * std::exp(y);
+    dflux_dteff = flux * dy / teff;
+    return flux;
+}
+
+/**
+ * @brief Band fluxes of a blackbody in all the filters
+ *
+ * @param teff   temperature in K
+ * @param amp    amplitude
+ * @return band fluxes in flam (n_filters)
+ */
+DMatrix BlackbodyTable::get_fluxes(double teff, double amp) const {
+    const std::size_t nf = this->names.size();
+    DMatrix result = DMatrix::from_shape({nf});
+    for (std::size_t m = 0; m < nf; ++m) { result[m] = this->get_flux(m, teff, amp); }
+    return result;
+}
+
+/**
+ * @brief Write the table to a text file
+ *
+ * @param path   output file
+ * @throw std::runtime_error if the file cannot be written
+ */
+void BlackbodyTable::save(const std::string& path) const {
+    std::ofstream out(path);
+    if (! out) {
+        throw std::runtime_error("BlackbodyTable: cannot write " + path);
+    }
+    const std::size_t nf = this->names.size();
+    out << std::setprecision(17);
+    out << "cphot_blackbody_table 1\n";
+    out << this->log_teff_min << " " << this->log_teff_max << " "
+        << this->n_nodes << " " << this->rel_tol << " " << nf << "\n";
+    for (std::size_t m = 0; m < nf; ++m) {
+        out << this->names[m] << "\n" << this->hashes[m] << " " << this->max_error[m] << "\n";
+    }
+    for (std::size_t k = 0; k < this->n_nodes * nf; ++k) {
+        out << this->log_flux[k] << " " << this->slope[k] << "\n";
+    }
+    if (! out) {
+        throw std::runtime_error("BlackbodyTable: cannot write " + path);
+    }
+}
+
+/**
+ * @brief Read a table written by `save`
+ *
+ * @param path   input file
+ * @return BlackbodyTable
+ * @throw std::runtime_error if the file cannot be read, is not a table, or
+ *        its header does not match its size
+ */
+BlackbodyTable BlackbodyTable::load(const std::string& path){
+    std::ifstream in(path);
+    std::string magic;
+    int version = 0;
+    if (!(in >> magic >> version) || (magic != "cphot_blackbody_table") || (version != 1)) {
+        throw std::runtime_error("BlackbodyTable: " + path + " is not a blackbody table");
+    }
+    BlackbodyTable table;
+    std::size_t nf = 0;
+    in >> table.log_teff_min >> table.log_teff_max >> table.n_nodes >> table.rel_tol >> nf;
+    if ((! in) || (table.n_nodes < 2) || !(table.log_teff_max > table.log_teff_min)
+        || !std::isfinite(table.log_teff_max - table.log_teff_min)) {
+        throw std::runtime_error("BlackbodyTable: corrupted header in " + path);
+    }
+    // check the counts against the file size before allocating: every value
+    // takes at least 2 characters (a digit and a separator)
+    const std::streamoff header = in.tellg();
+    in.seekg(0, std::ios::end);
+    const std::size_t remaining = static_cast<std::size_t>(in.tellg() - header);
+    in.seekg(header);
+    const std::size_t max_values = remaining / 2;
+    if ((nf > max_values / 2) || ((nf > 0) && (table.n_nodes > max_values / (2 * nf)))) {
+        throw std::runtime_error("BlackbodyTable: the size of " + path + " does not match its header");
+    }
+    table.step = (table.log_teff_max - table.log_teff_min) / (table.n_nodes - 1);
+    table.names.resize(nf);
+    table.hashes.resize(nf);
+    table.max_error.resize(nf);
+    for (std::size_t m = 0; m < nf; ++m) {
+        in >> std::ws;
+        std::getline(in, table.names[m]);
+        in >> table.hashes[m] >> table.max_error[m];
+    }
+    table.log_flux.resize(table.n_nodes * nf);
+    table.slope.resize(table.n_nodes * nf);
+    for (std::size_t k = 0; k < table.n_nodes * nf; ++k) {
+        in >> table.log_flux[k] >> table.slope[k];
+    }
+    if (! in) {
+        throw std::runtime_error("BlackbodyTable: truncated table in " + path);
+    }
+    return table;
+}
+
+/**
+ * @brief Load a cached table, or build it and update the cache
+ *
+ * The cache is used only if it was built for the same filter definitions
+ * (in the same order), temperature range and tolerance. A missing or
+ * corrupted cache is rebuilt.
+ *
+ * @param filters     filters in the order of the outputs
+ * @param path        cache file
+ * @param rel_tol     relative tolerance on the band fluxes
+ * @param teff_min    lowest temperature in K
+ * @param teff_max    highest temperature in K
+ * @param n_threads   number of threads (0 for the hardware concurrency)
+ * @return BlackbodyTable
+ * @throw std::runtime_error if the table cannot be built or the cache cannot
+ *        be written
+ */
+BlackbodyTable BlackbodyTable::load_or_build(const std::vector<Filter>& filters,
+                                             const std::string& path,
+                                             double rel_tol,
+                                             double teff_min,
+                                             double teff_max,
+                                             std::size_t n_threads){
+    try {
+        BlackbodyTable table = load(path);
+        bool valid = (table.size() == filters.size())
+                     && (table.rel_tol == rel_tol)
+                     && (std::abs(table.get_teff_min() / teff_min - 1.) < 1e-12)
+                     && (std::abs(table.get_teff_max() / teff_max - 1.) < 1e-12);
+        for (std::size_t m = 0; valid && (m < filters.size()); ++m) {
+            valid = (table.names[m] == filters[m].get_name())
+                    && (table.hashes[m] == filter_hash(filters[m]));
+        }
+        if (valid) { return table; }
+    } catch (const std::exception&) {
+        // missing or invalid cache: rebuild below
+    }
+    BlackbodyTable table(filters, rel_tol, teff_min, teff_max, n_threads);
+    table.save(path);
+    return table;
+}
+
+} // namespace cphot
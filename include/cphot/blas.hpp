@@ -0,0 +1,67 @@
+/**
+ * @file blas.hpp
+ * @brief Minimal declarations of the BLAS/LAPACK routines used by cphot.
+ *
+ * We only rely on the Fortran symbols that every BLAS/LAPACK implementation
+ * exports (reference, OpenBLAS, MKL, Accelerate), so that no specific
+ * `cblas.h` or `lapacke.h` header is required. The project links them through
+ * `find_package(BLAS)` and `find_package(LAPACK)`.
+ *
+ * \note Fortran BLAS is column-major. A row-major matrix `A (m, n)` is seen by
+ * BLAS as its transpose, `A^T (n, m)` with leading dimension `n`.
+ */
+#pragma once
+
+extern "C" {
+    /**
+     * @brief General matrix-matrix product C = alpha * op(A) * op(B) + beta * C
+     *
+     * Fortran interface (column-major, all arguments passed by address).
+     */
+    void dgemm_(const char* transa, const char* transb,
+                const int* m, const int* n, const int* k,
+                const double* alpha, const double* a, const int* lda,
+                const double* b, const int* ldb,
+                const double* beta, double* c, const int* ldc);
+
+    /**
+     * @brief Eigenvalues and eigenvectors of a real symmetric tridiagonal matrix
+     *
+     * Fortran interface (LAPACK). On exit `d` contains the eigenvalues in
+     * ascending order and `z` the orthonormal eigenvectors (column-major).
+     */
+    void dstev_(const char* jobz, const int* n, double* d, double* e,
+                double* z, const int* ldz, double* work, int* info);
+}
+
+namespace cphot {
+namespace blas {
+
+/**
+ * @brief Row-major matrix product with the second operand transposed.
+ *
+ * Computes `C (m, n) = A (m, k) * B(n, k)^T` where all matrices are stored
+ * contiguously in row-major order.
+ *
+ * @param m   number of rows of A and C
+ * @param n   number of rows of B and columns of C
+ * @param k   number of columns of A and B
+ * @param A   pointer to A data (m x k)
+ * @param B   pointer to B data (n x k)
+ * @param C   pointer to C data (m x n), overwritten
+ */
+inline void gemm_abt(int m, int n, int k,
+                     const double* A, const double* B, double* C){
+    // Row-major C (m, n) is column-major C^T (n, m) = B * A^T
+    // with B^T (k, n) and A^T (k, m) as seen by BLAS.
+    const char transa = 'T';
+    const char transb = 'N';
+    const double alpha = 1.;
+    const double beta = 0.;
+    dgemm_(&transa, &transb, &n, &m, &k,
+           &alpha, B, &k, A, &k,
+           &beta, C, &n);
+}
+
+} // namespace blas
+} // namespace cphot
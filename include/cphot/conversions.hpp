@@ -0,0 +1,280 @@
+/**
+ * @defgroup CONVERSION Bulk conversions
+ * @brief Column conversions between magnitudes and fluxes with uncertainties.
+ *
+ * Catalogs store one column per band (`SDSS_u`, `SDSS_u_error`, ...), in
+ * magnitudes (AB, Vega or ST) or in fluxes. A `BandConverter` looks up the
+ * zero points and the pivot wavelength of a filter once, and maps whole
+ * columns between
+ *
+ * - magnitudes: AB, Vega and ST (\f$ m = -2.5 \log_{10} f_\lambda - zp \f$),
+ * - flux densities: flam (erg/s/cm2/AA), fnu (erg/s/cm2/Hz) and Jy, related
+ *   through the pivot wavelength of the filter.
+ *
+ * Conversions between magnitudes and fluxes are a single affine exponential
+ * or logarithm per value, evaluated with the vectorized kernels of
+ * `vectormath.hpp`. Uncertainties follow the first order propagation
+ * \f$ \sigma_f = 0.4 \ln(10) f \sigma_m \f$.
+ *
+ * ```cpp
+ * cphot::BandConverter sdss_u(filter);
+ * cphot::DMatrix flux_err;
+ * cphot::DMatrix flux = sdss_u.convert(mag, mag_err,
+ *                                      cphot::PhotometricUnit::ABmag,
+ *                                      cphot::PhotometricUnit::Jy, flux_err);
+ * ```
+ */
+#pragma once
+#include "filter.hpp"
+#include "photometric_system.hpp"
+#include "rquantities.hpp"
+#include "vectormath.hpp"
+#include <helpers.hpp>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup CONVERSION
+ * @brief Units of catalog columns
+ */
+enum class PhotometricUnit { ABmag, Vegamag, STmag, flam, fnu, Jy };
+
+/**
+ * @ingroup CONVERSION
+ * @brief Parse a column unit name (case insensitive)
+ *
+ * Magnitudes: "AB", "ABmag", "Vega", "Vegamag", "ST", "STmag";
+ * fluxes: "flam", "fnu", "Jy".
+ *
+ * @param name   name of the unit
+ * @return PhotometricUnit
+ * @throw std::runtime_error if the name is not recognized
+ */
+PhotometricUnit parse_photometric_unit(const std::string& name){
+    std::string lower = tolower(name);
+    if ((lower == "ab") || (lower == "abmag")) { return PhotometricUnit::ABmag; }
+    if ((lower == "vega") || (lower == "vegamag")) { return PhotometricUnit::Vegamag; }
+    if ((lower == "st") || (lower == "stmag")) { return PhotometricUnit::STmag; }
+    if (lower == "flam") { return PhotometricUnit::flam; }
+    if (lower == "fnu") { return PhotometricUnit::fnu; }
+    if ((lower == "jy") || (lower == "jansky")) { return PhotometricUnit::Jy; }
+    throw std::runtime_error("Unknown photometric unit: " + name);
+}
+
+/**
+ * @ingroup CONVERSION
+ * @brief Whether a unit is a magnitude
+ */
+inline bool is_magnitude(PhotometricUnit unit){
+    return (unit == PhotometricUnit::ABmag) || (unit == PhotometricUnit::Vegamag)
+        || (unit == PhotometricUnit::STmag);
+}
+
+/**
+ * @ingroup CONVERSION
+ * @brief Magnitude unit of a magnitude system
+ */
+inline PhotometricUnit to_photometric_unit(MagSystem system){
+    switch (system) {
+        case MagSystem::AB: return PhotometricUnit::ABmag;
+        case MagSystem::Vega: return PhotometricUnit::Vegamag;
+        case MagSystem::ST: return PhotometricUnit::STmag;
+    }
+    return PhotometricUnit::ABmag;
+}
+
+/**
+ * @ingroup CONVERSION
+ * @brief Magnitude and flux conversions of catalog columns in one band
+ */
+class BandConverter {
+    private:
+        std::string name;       ///< filter name
+        double AB_mag;          ///< AB zero point magnitude
+        double Vega_mag;        ///< Vega zero point magnitude
+        double ST_mag;          ///< ST zero point magnitude
+        double flam_to_Jy;      ///< Jy per flam at the pivot wavelength
+
+    public:
+        BandConverter(const Filter& filter);
+
+        const std::string& get_name() const { return this->name; }
+        double get_zero_mag(PhotometricUnit unit) const;
+        double get_flam_factor(PhotometricUnit unit) const;
+
+        void convert(const double * values, const double * errors, std::size_t n,
+                     PhotometricUnit from, PhotometricUnit to,
+                     double * out, double * out_errors) const;
+        DMatrix convert(const DMatrix& values,
+                        PhotometricUnit from, PhotometricUnit to) const;
+        DMatrix convert(const DMatrix& values, const DMatrix& errors,
+                        PhotometricUnit from, PhotometricUnit to,
+                        DMatrix& out_errors) const;
+};
+
+/**
+ * @brief Construct a new Band Converter object
+ *
+ * @param filter   filter of the band (zero points are computed if needed)
+ */
+BandConverter::BandConverter(const Filter& filter)
+    : name(filter.get_name()) {
+    const ZeroPoints& zp = filter.get_zero_points();
+    this->AB_mag = zp.AB_mag;
+    this->Vega_mag = zp.Vega_mag;
+    this->ST_mag = zp.ST_mag;
+    this->flam_to_Jy = zp.AB_Jy / zp.AB_flam;
+}
+
+/**
+ * @brief Zero point of a magnitude unit
+ *
+ * @param unit   ABmag, Vegamag or STmag
+ * @return zero point magnitude (\f$ m = -2.5 \log_{10} f_\lambda - zp \f$)
+ * @throw std::runtime_error if the unit is not a magnitude
+ */
+double BandConverter::get_zero_mag(PhotometricUnit unit) const {
+    switch (unit) {
+        case PhotometricUnit::ABmag: return this->AB_mag;
+        case PhotometricUnit::Vegamag: return this->Vega_mag;
+        case PhotometricUnit::STmag: return this->ST_mag;
+        default: break;
+    }
+    throw std::runtime_error("BandConverter: not a magnitude unit");
+}
+
+/**
+ * @brief Flux in flam of one unit of a flux unit
+ *
+ * @param unit   flam, fnu or Jy
+ * @return conversion factor to flam
+ * @throw std::runtime_error if the unit is a magnitude
+ */
+double BandConverter::get_flam_factor(PhotometricUnit unit) const {
+    switch (unit) {
+        case PhotometricUnit::flam: return 1.;
+        case PhotometricUnit::Jy: return 1. / this->flam_to_Jy;
+        case PhotometricUnit::fnu: return 1e23 / this->flam_to_Jy;
+        default: break;
+    }
+    throw std::runtime_error("BandConverter: not a flux unit");
+}
+
+/**
+ * @brief Convert a column and its uncertainties
+ *
+ * Every conversion is affine in (log) space:
+ * - magnitude to magnitude: \f$ m' = m + zp - zp' \f$, same uncertainty;
+ * - flux to flux: \f$ f' = k f \f$, \f$ \sigma' = k \sigma \f$;
+ * - magnitude to flux: \f$ f = \exp(\alpha (m + zp)) / k \f$ with
+ *   \f$ \alpha = -0.4 \ln 10 \f$, \f$ \sigma_f = |\alpha| f \sigma_m \f$;
+ * - flux to magnitude: the inverse, NaN for non positive fluxes.
+ *
+ * `out` may alias `values` and `out_errors` may alias `errors`.
+ *
+ * @param values       input values (n)
+ * @param errors       input uncertainties (n) or nullptr
+ * @param n            number of values
+ * @param from         unit of the input
+ * @param to           unit of the output
+ * @param out          converted values (n)
+ * @param out_errors   converted uncertainties (n), ignored if errors is nullptr
+ */
+void BandConverter::convert(const double * values, const double * errors, std::size_t n,
+                            PhotometricUnit from, PhotometricUnit to,
+                            double * out, double * out_errors) const {
+    const double alpha = -0.4 * std::log(10.);
+    const bool with_errors = (errors != nullptr) && (out_errors != nullptr);
+    const bool mag_in = is_magnitude(from);
+    const bool mag_out = is_magnitude(to);
+
+    if (mag_in && mag_out) {
+        const double shift = this->get_zero_mag(from) - this->get_zero_mag(to);
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; ++i) { out[i] = values[i] + shift; }
+        if (with_errors && (out_errors != errors)) {
+            for (std::size_t i = 0; i < n; ++i) { out_errors[i] = errors[i]; }
+        }
+    } else if (! mag_in && ! mag_out) {
+        const double k = this->get_flam_factor(from) / this->get_flam_factor(to);
+        #pragma omp simd
+        for (std::size_t i = 0; i < n; ++i) { out[i] = values[i] * k; }
+        if (with_errors) {
+            #pragma omp simd
+            for (std::size_t i = 0; i < n; ++i) { out_errors[i] = std::abs(errors[i] * k); }
+        }
+    } else if (mag_in) {
+        // f = exp(alpha * m + alpha * zp - log(k_to))
+        const double offset = alpha * this->get_zero_mag(from) - std::log(this->get_flam_factor(to));
+        vexp(values, out, n, alpha, offset);
+        if (with_errors) {
+            const double scale = std::abs(alpha);
+            #pragma omp simd
+            for (std::size_t i = 0; i < n; ++i) { out_errors[i] = scale * out[i] * errors[i]; }
+        }
+    } else {
+        // m = log(f) / alpha + log(k_from) / alpha - zp
+        if (with_errors) {
+            const double scale = 1. / std::abs(alpha);
+            const double nan = std::numeric_limits<double>::quiet_NaN();
+            #pragma omp simd
+            for (std::size_t i = 0; i < n; ++i) {
+                out_errors[i] = (values[i] > 0) ? scale * errors[i] / values[i] : nan;
+            }
+        }
+        const double offset = std::log(this->get_flam_factor(from)) / alpha - this->get_zero_mag(to);
+        vlog(values, out, n, 1. / alpha, offset);
+        // zero gives +inf with the logarithm: NaN as for negative fluxes
+        for (std::size_t i = 0; i < n; ++i) {
+            if (std::isinf(out[i])) { out[i] = std::numeric_limits<double>::quiet_NaN(); }
+        }
+    }
+}
+
+/**
+ * @brief Convert a column
+ *
+ * @param values   input values
+ * @param from     unit of the input
+ * @param to       unit of the output
+ * @return converted values (same shape)
+ */
+DMatrix BandConverter::convert(const DMatrix& values,
+                               PhotometricUnit from, PhotometricUnit to) const {
+    DMatrix out = DMatrix::from_shape(values.shape());
+    this->convert(values.data(), nullptr, values.size(), from, to, out.data(), nullptr);
+    return out;
+}
+
+/**
+ * @brief Convert a column and its uncertainties
+ *
+ * @param values       input values
+ * @param errors       input uncertainties (same shape)
+ * @param from         unit of the input
+ * @param to           unit of the output
+ * @param out_errors   set to the converted uncertainties
+ * @return converted values (same shape)
+ * @throw std::runtime_error if values and errors sizes differ
+ */
+DMatrix BandConverter::convert(const DMatrix& values, const DMatrix& errors,
+                               PhotometricUnit from, PhotometricUnit to,
+                               DMatrix& out_errors) const {
+    if (values.size() != errors.size()) {
+        throw std::runtime_error("BandConverter: values and errors must have the same size");
+    }
+    DMatrix out = DMatrix::from_shape(values.shape());
+    out_errors = DMatrix::from_shape(values.shape());
+    this->convert(values.data(), errors.data(), values.size(), from, to,
+                  out.data(), out_errors.data());
+    return out;
+}
+
+} // namespace cphot
@@ -0,0 +1,542 @@
+/**
+ * @defgroup EXTINCTION Interstellar extinction
+ * @brief Extinction laws and reddened photometry over grids of \f$A_V\f$.
+ *
+ * The laws give \f$A_\lambda / A_V\f$ as a function of wavelength for a given
+ * \f$R_V = A_V / E(B - V)\f$:
+ *
+ * - Cardelli, Clayton & Mathis (1989, ApJ 345, 245), valid for
+ *   \f$0.3 \leq x \leq 10\,\mu m^{-1}\f$ (`ExtinctionLaw::CCM89`),
+ * - Fitzpatrick (1999, PASP 111, 63), cubic spline in the optical/IR and
+ *   Fitzpatrick & Massa (1990) in the UV (`ExtinctionLaw::F99`).
+ *
+ * Outside their domain, the laws are extended with their closest analytic
+ * piece (IR power law and far-UV polynomial for CCM89).
+ *
+ * A reddened spectrum is \f$f(\lambda) 10^{-0.4 A_V k(\lambda)}\f$ with
+ * \f$k = A_\lambda / A_V\f$. An `ExtinctionPlan` evaluates \f$k\f$ once on the
+ * filter definitions. `band_flux` then collects the filter weights and
+ * \f$k\f$ on the spectrum once per filter and evaluates a whole \f$A_V\f$
+ * grid from them (with a multiplicative recurrence for uniform grids).
+ *
+ * `BlackbodyExtinctionTable` tabulates the band fluxes of blackbodies on a
+ * (Teff, \f$A_V\f$) grid for fast lookups in joint reddening fits, with a
+ * relative error bound per filter (`get_max_error`).
+ *
+ * ```cpp
+ * cphot::ExtinctionPlan plan(filters, cphot::ExtinctionLaw::F99, 3.1);
+ * cphot::DMatrix av = xt::linspace<double>(0., 3., 31);
+ * cphot::DMatrix fluxes = plan.band_flux(wave, flux, nm, flam, av);   // (n_av, n_filters)
+ * ```
+ */
+#pragma once
+#include "filter.hpp"
+#include "grids.hpp"
+#include "interpolation.hpp"
+#include "rquantities.hpp"
+#include <blackbody.hpp>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup EXTINCTION
+ * @brief Available extinction laws
+ */
+enum class ExtinctionLaw { CCM89, F99 };
+
+/**
+ * @ingroup EXTINCTION
+ * @brief Cardelli, Clayton & Mathis (1989) extinction law
+ *
+ * @param lam_nm   wavelength in nm
+ * @param Rv       ratio of total to selective extinction
+ * @return \f$A_\lambda / A_V\f$
+ */
+double ccm89(double lam_nm, double Rv){
+    const double x = 1e3 / lam_nm;   // inverse microns
+    double a = 0.;
+    double b = 0.;
+    if (x < 1.1) {
+        // infrared (extended below x = 0.3)
+        const double xp = std::pow(x, 1.61);
+        a = 0.574 * xp;
+        b = -0.527 * xp;
+    } else if (x < 3.3) {
+        // optical / near infrared
+        const double y = x - 1.82;
+        a = 1. + y * (0.17699 + y * (-0.50447 + y * (-0.02427 + y * (0.72085
+               + y * (0.01979 + y * (-0.77530 + y * 0.32999))))));
+        b = y * (1.41338 + y * (2.28305 + y * (1.07233 + y * (-5.38434
+               + y * (-0.62251 + y * (5.30260 + y * -2.09002))))));
+    } else if (x < 8.) {
+        // ultraviolet
+        double fa = 0.;
+        double fb = 0.;
+        if (x > 5.9) {
+            const double y = x - 5.9;
+            fa = -0.04473 * y * y - 0.009779 * y * y * y;
+            fb = 0.2130 * y * y + 0.1207 * y * y * y;
+        }
+        a = 1.752 - 0.316 * x - 0.104 / ((x - 4.67) * (x - 4.67) + 0.341) + fa;
+        b = -3.090 + 1.825 * x + 1.206 / ((x - 4.62) * (x - 4.62) + 0.263) + fb;
+    } else {
+        // far ultraviolet (extended above x = 10)
+        const double y = x - 8.;
+        a = -1.073 - 0.628 * y + 0.137 * y * y - 0.070 * y * y * y;
+        b = 13.670 + 4.257 * y - 0.420 * y * y + 0.374 * y * y * y;
+    }
+    return a + b / Rv;
+}
+
+/**
+ * @ingroup EXTINCTION
+ * @brief Fitzpatrick (1999) extinction law for a given Rv
+ *
+ * The optical/IR part is a natural cubic spline through anchor points that
+ * depend on Rv; it is set up once at construction.
+ */
+class Fitzpatrick99 {
+    private:
+        static constexpr double x0 = 4.596;
+        static constexpr double gamma = 0.99;
+        static constexpr double c3 = 3.23;
+        static constexpr double c4 = 0.41;
+        double Rv;
+        double c1;
+        double c2;
+        std::vector<double> xk;   ///< spline anchors in inverse microns
+        std::vector<double> yk;   ///< E(x - V) / E(B - V) at the anchors
+        std::vector<double> y2;   ///< spline second derivatives
+
+        double uv(double x) const;
+
+    public:
+        Fitzpatrick99(double Rv = 3.1);
+        double operator()(double lam_nm) const;
+};
+
+/**
+ * @brief Fitzpatrick & Massa (1990) parametrization of E(x - V) / E(B - V)
+ */
+double Fitzpatrick99::uv(double x) const {
+    const double x2 = x * x;
+    double k = this->c1 + this->c2 * x
+               + this->c3 * x2 / ((x2 - x0 * x0) * (x2 - x0 * x0) + x2 * gamma * gamma);
+    if (x >= 5.9) {
+        const double y = x - 5.9;
+        k += this->c4 * (0.5392 * y * y + 0.05644 * y * y * y);
+    }
+    return k;
+}
+
+/**
+ * @brief Construct the law for a given Rv
+ *
+ * @param Rv   ratio of total to selective extinction
+ */
+Fitzpatrick99::Fitzpatrick99(double Rv) : Rv(Rv) {
+    this->c2 = -0.824 + 4.717 / Rv;
+    this->c1 = 2.030 - 3.007 * this->c2;
+
+    const double r2 = Rv * Rv;
+    this->xk = {0., 1e4 / 26500., 1e4 / 12200., 1e4 / 6000., 1e4 / 5470.,
+                1e4 / 4670., 1e4 / 4110., 1e4 / 2700., 1e4 / 2600.};
+    this->yk = {-Rv,
+                0.26469 * Rv / 3.1 - Rv,
+                0.82925 * Rv / 3.1 - Rv,
+                -0.422809 + 1.00270 * Rv + 2.13572e-04 * r2 - Rv,
+                -5.13540e-02 + 1.00216 * Rv - 7.35778e-05 * r2 - Rv,
+                0.700127 + 1.00184 * Rv - 3.32598e-05 * r2 - Rv,
+                1.19456 + 1.01707 * Rv - 5.46959e-03 * r2 + 7.97809e-04 * r2 * Rv
+                    - 4.45636e-05 * r2 * r2 - Rv,
+                this->uv(this->xk[7]),
+                this->uv(this->xk[8])};
+
+    // natural cubic spline: tridiagonal system for the second derivatives
+    const std::size_t n = this->xk.size();
+    this->y2.assign(n, 0.);
+    std::vector<double> u(n, 0.);
+    for (std::size_t i = 1; i + 1 < n; ++i) {
+        const double sig = (this->xk[i] - this->xk[i - 1]) / (this->xk[i + 1] - this->xk[i - 1]);
+        const double p = sig * this->y2[i - 1] + 2.;
+        this->y2[i] = (sig - 1.) / p;
+        u[i] = (this->yk[i + 1] - this->yk[i]) / (this->xk[i + 1] - this->xk[i])
+               - (this->yk[i] - this->yk[i - 1]) / (this->xk[i] - this->xk[i - 1]);
+        u[i] = (6. * u[i] / (this->xk[i + 1] - this->xk[i - 1]) - sig * u[i - 1]) / p;
+    }
+    this->y2[n - 1] = 0.;
+    for (std::size_t i = n - 1; i-- > 0;) {
+        this->y2[i] = this->y2[i] * this->y2[i + 1] + u[i];
+    }
+}
+
+/**
+ * @brief Evaluate the law
+ *
+ * @param lam_nm   wavelength in nm
+ * @return \f$A_\lambda / A_V\f$
+ */
+double Fitzpatrick99::operator()(double lam_nm) const {
+    const double x = 1e3 / lam_nm;   // inverse microns
+    double k = 0.;
+    if (x >= this->xk[7]) {
+        k = this->uv(x);
+    } else {
+        const std::size_t i = std::max<std::size_t>(1,
+            std::upper_bound(this->xk.begin(), this->xk.begin() + 8, x) - this->xk.begin()) - 1;
+        const double h = this->xk[i + 1] - this->xk[i];
+        const double a = (this->xk[i + 1] - x) / h;
+        const double b = (x - this->xk[i]) / h;
+        k = a * this->yk[i] + b * this->yk[i + 1]
+            + ((a * a * a - a) * this->y2[i] + (b * b * b - b) * this->y2[i + 1]) * h * h / 6.;
+    }
+    return (k + this->Rv) / this->Rv;
+}
+
+/**
+ * @ingroup EXTINCTION
+ * @brief Evaluate an extinction law on a wavelength array
+ *
+ * @param law      extinction law
+ * @param lam_nm   wavelengths in nm
+ * @param Rv       ratio of total to selective extinction
+ * @return \f$A_\lambda / A_V\f$ with the shape of lam_nm
+ */
+DMatrix get_extinction_ratio(ExtinctionLaw law, const DMatrix& lam_nm, double Rv){
+    DMatrix k = DMatrix::from_shape(lam_nm.shape());
+    if (law == ExtinctionLaw::CCM89) {
+        for (std::size_t i = 0; i < lam_nm.size(); ++i) { k[i] = ccm89(lam_nm[i], Rv); }
+    } else {
+        const Fitzpatrick99 f99(Rv);
+        for (std::size_t i = 0; i < lam_nm.size(); ++i) { k[i] = f99(lam_nm[i]); }
+    }
+    return k;
+}
+
+/**
+ * @ingroup EXTINCTION
+ * @brief Reddened photometry of spectra through a set of filters
+ */
+class ExtinctionPlan {
+    private:
+        std::vector<Filter> filters;      ///< filters in order
+        std::vector<DMatrix> ratios;      ///< A_lambda / A_V on each filter grid
+        ExtinctionLaw law;
+        double Rv;
+
+    public:
+        ExtinctionPlan(const std::vector<Filter>& filters,
+                       ExtinctionLaw law = ExtinctionLaw::F99,
+                       double Rv = 3.1);
+
+        DMatrix band_flux(const DMatrix& wavelength,
+                          const DMatrix& flux,
+                          const QLength& wavelength_unit,
+                          const QSpectralFluxDensity& flux_unit,
+                          const DMatrix& av) const;
+
+        std::size_t size() const { return this->filters.size(); }
+        const std::vector<Filter>& get_filters() const { return this->filters; }
+        const DMatrix& get_extinction_ratio(std::size_t m) const { return this->ratios[m]; }
+        ExtinctionLaw get_law() const { return this->law; }
+        double get_Rv() const { return this->Rv; }
+};
+
+/**
+ * @brief Construct a new Extinction Plan object
+ *
+ * @param filters  filters in the order of the outputs
+ * @param law      extinction law
+ * @param Rv       ratio of total to selective extinction
+ */
+ExtinctionPlan::ExtinctionPlan(const std::vector<Filter>& filters,
+                               ExtinctionLaw law, double Rv)
+    : filters(filters), law(law), Rv(Rv) {
+    for (const auto& filter : this->filters) {
+        this->ratios.push_back(cphot::get_extinction_ratio(law, filter.get_wavelength(), Rv));
+    }
+}
+
+/**
+ * @brief Fluxes of a reddened spectrum over a grid of extinction values
+ *
+ * Identical to `Filter::get_flux` on the spectrum multiplied by
+ * \f$10^{-0.4 A_V k(\lambda)}\f$, where \f$k\f$ is interpolated from the
+ * filter definition.
+ *
+ * @param wavelength        wavelength definition of the spectrum (increasing)
+ * @param flux              flux of the spectrum
+ * @param wavelength_unit   wavelength units
+ * @param flux_unit         flux units
+ * @param av                extinction values A_V in mag (n_av)
+ * @return fluxes in flam of shape (n_av, n_filters)
+ */
+DMatrix ExtinctionPlan::band_flux(const DMatrix& wavelength,
+                                  const DMatrix& flux,
+                                  const QLength& wavelength_unit,
+                                  const QSpectralFluxDensity& flux_unit,
+                                  const DMatrix& av) const {
+    const std::size_t n_filters = this->filters.size();
+    const std::size_t n_av = av.size();
+    const std::size_t n_spec = wavelength.size();
+    if (flux.size() != n_spec) {
+        throw std::runtime_error("ExtinctionPlan::band_flux: flux does not match the wavelength grid");
+    }
+    DMatrix result = xt::zeros<double>({n_av, n_filters});
+
+    const double conv = nm.to(wavelength_unit);
+    const double to_flam = flux_unit.to(flam);
+    const double * spec_wave = wavelength.data();
+    const double * spec_flux = flux.data();
+    const double c = 0.4 * std::log(10.);
+
+    // uniform A_V grids use exp(-c k (av0 + i dav)) = exp(-c k av0) * exp(-c k dav)^i
+    UniformGrid av_grid(0., 1., 1);
+    const bool uniform = detect_uniform_grid(av, av_grid, 1e-10);
+
+    std::vector<double> g, k, x_nm, e, r;
+    for (std::size_t m = 0; m < n_filters; ++m) {
+        // weights of Filter::get_flux times f, and k on the window points
+        std::shared_ptr<const CachedWeights> weights =
+            this->filters[m].get_weights(wavelength, wavelength_unit);
+        const std::size_t n = weights->weights.size();
+        if (n == 0) { continue; }
+        const std::size_t start = weights->start;
+        g.resize(n);
+        k.resize(n);
+        x_nm.resize(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            g[i] = weights->weights[i] * spec_flux[start + i];
+            x_nm[i] = spec_wave[start + i] / conv;
+        }
+        // clamped at the ends against the rounding of the unit conversion
+        const DMatrix& fw = this->filters[m].get_wavelength();
+        const DMatrix& fk = this->ratios[m];
+        interp_sorted(x_nm.data(), n, fw.data(), fk.data(), fw.size(), k.data(),
+                      fk[0], fk[fk.size() - 1]);
+
+        if (uniform && (n_av > 1)) {
+            e.resize(n);
+            r.resize(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                e[i] = std::exp(-c * k[i] * av_grid.start);
+                r[i] = std::exp(-c * k[i] * av_grid.step);
+            }
+            for (std::size_t ia = 0; ia < n_av; ++ia) {
+                double a = 0.;
+                #pragma omp simd reduction(+:a)
+                for (std::size_t i = 0; i < n; ++i) {
+                    a += g[i] * e[i];
+                    e[i] *= r[i];
+                }
+                result(ia, m) = a * to_flam;
+            }
+        } else {
+            for (std::size_t ia = 0; ia < n_av; ++ia) {
+                const double cav = c * av[ia];
+                double a = 0.;
+                for (std::size_t i = 0; i < n; ++i) { a += g[i] * std::exp(-cav * k[i]); }
+                result(ia, m) = a * to_flam;
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @ingroup EXTINCTION
+ * @brief Tabulated band fluxes of reddened blackbodies on a (Teff, A_V) grid
+ *
+ * Band fluxes (amplitude 1) are computed once with `bb_flux` on a dense
+ * sampling: every interval of every filter definition is split in `n_sub`
+ * equal parts, so the transmissions stay exactly piecewise linear while the
+ * blackbody and the extinction curve are resolved within the bands. `n_sub`
+ * starts at 4 and doubles until two successive tables agree to `rel_tol`.
+ *
+ * Lookups interpolate the log of the flux bilinearly in (log Teff, A_V). The
+ * error of the interpolation is measured at the centre of every grid cell;
+ * with the last sampling change, it gives the relative error bound of each
+ * filter (`get_max_error`). The bound is set by the density of the grids.
+ */
+class BlackbodyExtinctionTable {
+    private:
+        std::vector<std::string> names;   ///< filter names
+        DMatrix log_teff;                 ///< log of the temperature grid (n_teff)
+        DMatrix av;                       ///< extinction grid (n_av)
+        DMatrix log_flux;                 ///< log band fluxes (n_teff, n_av, n_filters)
+        std::vector<double> max_error;    ///< relative error bound per filter
+
+        static constexpr std::size_t max_sub = 4096;   ///< finest subdivision of the filter intervals
+
+    public:
+        BlackbodyExtinctionTable(const std::vector<Filter>& filters,
+                                 const DMatrix& teff,
+                                 const DMatrix& av,
+                                 ExtinctionLaw law = ExtinctionLaw::F99,
+                                 double Rv = 3.1,
+                                 double rel_tol = 1e-6);
+
+        DMatrix get_flux(double teff, double av, double amp = 1.) const;
+
+        std::size_t size() const { return this->names.size(); }
+        const std::vector<double>& get_max_error() const { return this->max_error; }
+        const std::vector<std::string>& get_filter_names() const { return this->names; }
+};
+
+/**
+ * @brief Construct the table
+ *
+ * @param filters   filters in the order of the outputs
+ * @param teff      temperature grid in K (increasing, at least 2 points)
+ * @param av        extinction grid in mag (increasing, at least 2 points)
+ * @param law       extinction law
+ * @param Rv        ratio of total to selective extinction
+ * @param rel_tol   relative tolerance of the band fluxes at the grid nodes
+ * @throw std::runtime_error if a grid has less than 2 points, or if rel_tol
+ *        is not reached with 4096 subdivisions of the filter intervals
+ */
+BlackbodyExtinctionTable::BlackbodyExtinctionTable(const std::vector<Filter>& filters,
+                                                   const DMatrix& teff,
+                                                   const DMatrix& av,
+                                                   ExtinctionLaw law,
+                                                   double Rv,
+                                                   double rel_tol)
+    : log_teff(xt::log(teff)), av(av) {
+    if ((teff.size() < 2) || (av.size() < 2)) {
+        throw std::runtime_error("BlackbodyExtinctionTable: grids need at least 2 points");
+    }
+    const std::size_t n_filters = filters.size();
+    const std::size_t n_teff = teff.size();
+    const std::size_t n_av = av.size();
+    for (const auto& filter : filters) { this->names.push_back(filter.get_name()); }
+
+    // wavelength sampling: filter intervals split in n_sub parts
+    auto sampling = [&filters](std::size_t n_sub){
+        std::vector<double> lam;
+        for (const auto& filter : filters) {
+            const DMatrix& fw = filter.get_wavelength();
+            for (std::size_t j = 0; j + 1 < fw.size(); ++j) {
+                const double step = (fw[j + 1] - fw[j]) / n_sub;
+                for (std::size_t s = 0; s < n_sub; ++s) { lam.push_back(fw[j] + s * step); }
+            }
+            lam.push_back(fw[fw.size() - 1]);
+        }
+        std::sort(lam.begin(), lam.end());
+        lam.erase(std::unique(lam.begin(), lam.end()), lam.end());
+        std::vector<std::size_t> shape = { lam.size() };
+        return DMatrix(xt::adapt(lam, shape));
+    };
+
+    ExtinctionPlan plan(filters, law, Rv);
+    // log band fluxes (n_t, n_a, n_filters) of blackbodies sampled on wavelength
+    auto tabulate = [&](const DMatrix& wavelength, const DMatrix& t, const DMatrix& a){
+        DMatrix log_f = DMatrix::from_shape({t.size(), a.size(), n_filters});
+        DMatrix bb = DMatrix::from_shape({wavelength.size()});
+        for (std::size_t it = 0; it < t.size(); ++it) {
+            bb_flux(wavelength.data(), wavelength.size(), nullptr, t.data() + it, 1, bb.data());
+            DMatrix fluxes = plan.band_flux(wavelength, bb, nm, flam, a);
+            for (std::size_t ia = 0; ia < a.size(); ++ia) {
+                for (std::size_t m = 0; m < n_filters; ++m) {
+                    log_f(it, ia, m) = std::log(fluxes(ia, m));
+                }
+            }
+        }
+        return log_f;
+    };
+
+    // refine the sampling until two successive tables agree
+    std::size_t n_sub = 4;
+    DMatrix wavelength = sampling(n_sub);
+    this->log_flux = tabulate(wavelength, teff, av);
+    std::vector<double> sampling_error(n_filters, 0.);
+    while (true) {
+        n_sub *= 2;
+        wavelength = sampling(n_sub);
+        DMatrix refined = tabulate(wavelength, teff, av);
+        std::fill(sampling_error.begin(), sampling_error.end(), 0.);
+        for (std::size_t i = 0; i < refined.size(); ++i) {
+            const double error = std::abs(std::expm1(this->log_flux.data()[i] - refined.data()[i]));
+            double& bound = sampling_error[i % n_filters];
+            bound = std::max(bound, error);
+        }
+        this->log_flux = std::move(refined);
+        const double worst = n_filters ?
+            *std::max_element(sampling_error.begin(), sampling_error.end()) : 0.;
+        if (worst <= rel_tol) { break; }
+        if (n_sub >= max_sub) {
+            std::ostringstream msg;
+            msg << "BlackbodyExtinctionTable: relative tolerance " << rel_tol
+                << " not reached with " << n_sub << " subdivisions of the filter intervals"
+                << " (error bound " << worst << "), increase rel_tol";
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+    // interpolation error at the centres of the grid cells
+    DMatrix teff_mid = DMatrix::from_shape({n_teff - 1});
+    DMatrix av_mid = DMatrix::from_shape({n_av - 1});
+    for (std::size_t it = 0; it + 1 < n_teff; ++it) {
+        teff_mid[it] = std::exp(0.5 * (this->log_teff[it] + this->log_teff[it + 1]));
+    }
+    for (std::size_t ia = 0; ia + 1 < n_av; ++ia) { av_mid[ia] = 0.5 * (av[ia] + av[ia + 1]); }
+    const DMatrix log_mid = tabulate(wavelength, teff_mid, av_mid);
+    this->max_error = sampling_error;
+    std::vector<double> interpolation_error(n_filters, 0.);
+    for (std::size_t it = 0; it + 1 < n_teff; ++it) {
+        for (std::size_t ia = 0; ia + 1 < n_av; ++ia) {
+            const DMatrix f = this->get_flux(teff_mid[it], av_mid[ia]);
+            for (std::size_t m = 0; m < n_filters; ++m) {
+                const double error = std::abs(std::expm1(std::log(f[m]) - log_mid(it, ia, m)));
+                interpolation_error[m] = std::max(interpolation_error[m], error);
+            }
+        }
+    }
+    for (std::size_t m = 0; m < n_filters; ++m) { this->max_error[m] += interpolation_error[m]; }
+}
+
+/**
+ * @brief Band fluxes of a reddened blackbody
+ *
+ * Values outside the grids are clamped to the edges.
+ *
+ * @param teff   temperature in K
+ * @param av     extinction in mag
+ * @param amp    dimensionless normalization factor of the blackbody
+ * @return band fluxes in flam (n_filters)
+ */
+DMatrix BlackbodyExtinctionTable::get_flux(double teff, double av, double amp) const {
+    auto locate = [](const DMatrix& grid, double x, std::size_t& i, double& t){
+        const std::size_t n = grid.size();
+        x = std::min(std::max(x, grid[0]), grid[n - 1]);
+        i = std::min<std::size_t>(
+                std::upper_bound(grid.begin(), grid.end(), x) - grid.begin(), n - 1) - 1;
+        t = (x - grid[i]) / (grid[i + 1] - grid[i]);
+    };
+    std::size_t it, ia;
+    double tt, ta;
+    locate(this->log_teff, std::log(teff), it, tt);
+    locate(this->av, av, ia, ta);
+
+    const std::size_t n_filters = this->names.size();
+    DMatrix result = DMatrix::from_shape({n_filters});
+    for (std::size_t m = 0; m < n_filters; ++m) {
+        const double v = (1. - tt) * ((1. - ta) * this->log_flux(it, ia, m)
+                                      + ta * this->log_flux(it, ia + 1, m))
+                         + tt * ((1. - ta) * this->log_flux(it + 1, ia, m)
+                                 + ta * this->log_flux(it + 1, ia + 1, m));
+        result[m] = amp * std::exp(v);
+    }
+    return result;
+}
+
+} // namespace cphot
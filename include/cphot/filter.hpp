@@ -15,14 +15,24 @@
  */
 #pragma once
 #include "rquantities.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <exception>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <regex>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 #include <xtensor/xadapt.hpp>
 #include <xtensor/xarray.hpp>
+#include "grids.hpp"
+#include "interpolation.hpp"
+#include "spectrum.hpp"
+#include "transmission_cache.hpp"
 #include "vega.hpp"
 
 /** \ingroup FILTER
@@ -31,6 +41,35 @@ namespace cphot {
 
 using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
 
+/**
+ * @ingroup FILTER
+ * @brief Zero points of a filter in the Vega, AB and ST systems.
+ *
+ * Fluxes are in flam (erg/s/cm^2/AA) and Jy.
+ */
+struct ZeroPoints {
+    double Vega_mag = 0;     ///< Vega magnitude zero point
+    double Vega_flam = 0;    ///< Vega flux zero point in flam
+    double Vega_Jy = 0;      ///< Vega flux zero point in Jy
+    double AB_mag = 0;       ///< AB magnitude zero point
+    double AB_flam = 0;      ///< AB flux zero point in flam
+    double AB_Jy = 0;        ///< AB flux zero point in Jy
+    double ST_mag = 0;       ///< ST magnitude zero point
+    double ST_flam = 0;      ///< ST flux zero point in flam
+    double ST_Jy = 0;        ///< ST flux zero point in Jy
+};
+
+/**
+ * @ingroup FILTER
+ * @brief Outcome of a transmission curve simplification (see `Filter::simplify`).
+ */
+struct SimplifyReport {
+    std::string name;              ///< name of the filter
+    std::size_t n_points = 0;      ///< number of points of the original curve
+    std::size_t n_simplified = 0;  ///< number of points kept
+    double max_error = 0;          ///< max relative flux error on the reference SEDs
+};
+
 /**
  * @ingroup FILTER
  * @brief Unit Aware Filter.
@@ -39,6 +78,12 @@ using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
  * Define a filter by its name, wavelength and transmission The type of
  * detector (energy or photon counter) can be specified for adapting
  * calculations. (default: photon)
+ *
+ * A Filter is immutable once constructed: all methods are const and the
+ * curves are returned by reference, so a filter can be shared by reference
+ * across threads without locking. Construction only copies the curves: the
+ * derived quantities (central, pivot and effective wavelengths, widths, zero
+ * points) are computed on first access, under `std::call_once`.
  */
 class Filter {
     private:
@@ -55,28 +100,64 @@ class Filter {
         std::string dtype = "photon";
         //! units of the wavelength (nm by construction)
         QLength wavelength_unit = nm;
-        //! Central wavelength in nm
-        double cl;
-        //! pivot wavelength in nm
-        double lpivot;
-        //! minimum wavelength in nm
-        double lmin;
-        //! maximum wavelength in nm
-        double lmax;
-        //! norm of the passband
-        double norm;
-        //! effective width in nm
-        double width;
-        //! full width at half maximum in nm
-        double fwhm;
-        //! Photon distribution based effective wavelength.
-        double lphot = 0;
-        //! Effective wavelength
-        double leff = 0;
-        //! Internal int λ * transmission * dλ
-        double lT;
-
-        void calculate_sed_independent_properties();
+        //! SED independent properties (wavelengths in nm)
+        struct Properties {
+            double cl = 0;       ///< central wavelength
+            double lpivot = 0;   ///< pivot wavelength
+            double lmin = 0;     ///< minimum wavelength
+            double lmax = 0;     ///< maximum wavelength
+            double norm = 0;     ///< norm of the passband
+            double width = 0;    ///< effective width
+            double fwhm = 0;     ///< full width at half maximum
+            double lT = 0;       ///< int λ * transmission * dλ
+            double leff = 0;     ///< effective wavelength (Vega weighted)
+            double lphot = 0;    ///< photon distribution based effective wavelength
+        };
+
+        //! Lazily computed properties (shared by copies of the filter).
+        //! The Vega weighted wavelengths have their own flag as they need
+        //! an interpolation of the Vega spectrum.
+        struct PropertiesCache {
+            std::once_flag flag;
+            std::once_flag vega_flag;
+            std::atomic<bool> computed {false};        ///< set once flag has run
+            std::atomic<bool> vega_computed {false};   ///< set once vega_flag has run
+            Properties values;
+        };
+        std::shared_ptr<PropertiesCache> properties = std::make_shared<PropertiesCache>();
+
+        //! Lazily computed zero points (shared by copies of the filter)
+        struct ZeroPointsCache {
+            std::once_flag flag;
+            std::atomic<bool> computed {false};   ///< set once flag has run
+            ZeroPoints values;
+        };
+        std::shared_ptr<ZeroPointsCache> zero_points = std::make_shared<ZeroPointsCache>();
+
+        //! Integration weights per spectrum grid (shared by copies, disabled by default)
+        std::shared_ptr<TransmissionCache> transmission_cache = std::make_shared<TransmissionCache>();
+
+        void calculate_sed_independent_properties(Properties& p) const;
+        void calculate_vega_properties(Properties& p) const;
+        const Properties& get_properties() const;
+        const Properties& get_vega_properties() const;
+        void calculate_zero_points(ZeroPoints& zp) const;
+        template <typename Grid>
+        CachedWeights calculate_weights(const Grid& wavelength,
+                                        const QLength& wavelength_unit) const;
+        template <typename Grid, typename Visitor>
+        double visit_weights(const Grid& wavelength,
+                             const QLength& wavelength_unit,
+                             Visitor&& visit) const;
+        template <typename T>
+        double integrate(const DMatrix& wavelength,
+                         const T * flux,
+                         const QLength& wavelength_unit) const;
+        template <typename Grid>
+        QSpectralFluxDensity get_flux_on_grid(const Grid& wavelength,
+                                              const DMatrix& flux,
+                                              const QLength& wavelength_unit,
+                                              const QSpectralFluxDensity& flux_unit) const;
 
     public:
         Filter(const DMatrix& wavelength,
@@ -84,45 +165,77 @@ class Filter {
                const QLength& wavelength_unit,
                const std::string dtype,
                const std::string name);
-        void info();
+        void info() const;
+
+        const std::string& get_name() const { return this->name;}
+        double get_norm() const;
+        QLength get_leff() const;
+        QLength get_lphot() const;
+        QLength get_fwhm() const;
+        QLength get_width() const;
+        QLength get_lmax() const;
+        QLength get_lmin() const;
+        QLength get_lpivot() const;
+        QLength get_cl() const;
+
+        const ZeroPoints& get_zero_points() const;
+
+        bool has_properties() const;
+        bool has_vega_properties() const;
+        bool has_zero_points() const;
 
-        std::string get_name(){ return this->name;}
-        double get_norm();
-        QLength get_leff();
-        QLength get_lphot();
-        QLength get_fwhm();
-        QLength get_width();
-        QLength get_lmax();
-        QLength get_lmin();
-        QLength get_lpivot();
-        QLength get_cl();
+        void set_transmission_cache_size(std::size_t capacity);
+        TransmissionCacheStats get_transmission_cache_stats() const;
+        std::shared_ptr<const CachedWeights> get_weights(const DMatrix& wavelength,
+                                                         const QLength& wavelength_unit) const;
 
-        double get_AB_zero_mag();
-        QSpectralFluxDensity get_AB_zero_flux();
-        QSpectralFluxDensity get_AB_zero_Jy();
+        double get_AB_zero_mag() const;
+        QSpectralFluxDensity get_AB_zero_flux() const;
+        QSpectralFluxDensity get_AB_zero_Jy() const;
 
-        double get_ST_zero_mag();
-        QSpectralFluxDensity get_ST_zero_flux();
-        QSpectralFluxDensity get_ST_zero_Jy();
+        double get_ST_zero_mag() const;
+        QSpectralFluxDensity get_ST_zero_flux() const;
+        QSpectralFluxDensity get_ST_zero_Jy() const;
 
-        double get_Vega_zero_mag();
-        QSpectralFluxDensity get_Vega_zero_flux();
-        QSpectralFluxDensity get_Vega_zero_Jy();
+        double get_Vega_zero_mag() const;
+        QSpectralFluxDensity get_Vega_zero_flux() const;
+        QSpectralFluxDensity get_Vega_zero_Jy() const;
 
-        DMatrix get_wavelength();
-        DMatrix get_wavelength(const QLength& in);
-        DMatrix get_transmission();
+        const DMatrix& get_wavelength() const;
+        DMatrix get_wavelength(const QLength& in) const;
+        const DMatrix& get_transmission() const;
 
-        bool is_photon_type();
+        bool is_photon_type() const;
 
         QSpectralFluxDensity get_flux(const DMatrix& wavelength,
                                       const DMatrix& flux,
                                       const QLength& wavelength_unit,
-                                      const QSpectralFluxDensity& flux_unit);
+                                      const QSpectralFluxDensity& flux_unit) const;
+        QSpectralFluxDensity get_flux(const DMatrix& wavelength,
+                                      const DMatrix& flux,
+                                      const DMatrix& flux_gradient,
+                                      const QLength& wavelength_unit,
+                                      const QSpectralFluxDensity& flux_unit,
+                                      DMatrix& gradient) const;
+        QSpectralFluxDensity get_flux(const UniformGrid& wavelength,
+                                      const DMatrix& flux,
+                                      const QLength& wavelength_unit,
+                                      const QSpectralFluxDensity& flux_unit) const;
+        QSpectralFluxDensity get_flux(const LogUniformGrid& wavelength,
+                                      const DMatrix& flux,
+                                      const QLength& wavelength_unit,
+                                      const QSpectralFluxDensity& flux_unit) const;
+        template <typename T>
+        QSpectralFluxDensity get_flux(const BasicSpectrum<T>& spectrum) const;
+        template <typename T>
+        DMatrix get_flux(const BasicSpectrumBatch<T>& spectra) const;
 
-        Filter reinterp(const DMatrix& new_wavelength_nm);
+        Filter reinterp(const DMatrix& new_wavelength_nm) const;
         Filter reinterp(const DMatrix& new_wavelength,
-                        const QLength& new_wavelength_unit);
+                        const QLength& new_wavelength_unit) const;
+
+        Filter simplify(double rel_tol) const;
+        Filter simplify(double rel_tol, SimplifyReport& report) const;
 };
 
 /**
@@ -152,7 +265,6 @@ Filter::Filter(const DMatrix& wavelength,
     } else {
         throw std::runtime_error("only photon and energy allowed");
     }
-    this->calculate_sed_independent_properties();
 }
 
 /**
@@ -163,7 +275,7 @@ Filter::Filter(const DMatrix& wavelength,
  * @return std::ostream&  same as os
  */
 std::ostream & operator<<(std::ostream &os,
-                          Filter &F){
+                          const Filter &F){
     os << "Filter: " << F.get_name()
        << "\n";
     return os;
@@ -175,7 +287,7 @@ std::ostream & operator<<(std::ostream &os,
  * These properties are e.g., fwhm, pivot wavelength.
  * Those that do not require to consider an SED such as Vega.
  */
-void Filter::calculate_sed_independent_properties(){
+void Filter::calculate_sed_independent_properties(Properties& p) const {
     // Calculate Filter properties
     const auto& wavelength_nm = this->wavelength_nm;
     const auto& transmission = this->transmission;
@@ -187,16 +299,16 @@ void Filter::calculate_sed_independent_properties(){
     auto norm = xt::trapz(transmission, wavelength_nm)[0];
     auto _lT = xt::trapz(wavelength_nm * transmission, wavelength_nm)[0];
     auto _cl = norm > 0 ? _lT / norm : 0.;
-    this->cl = _cl;
-    this->norm = norm;
-    this->lT = _lT;
+    p.cl = _cl;
+    p.norm = norm;
+    p.lT = _lT;
     double lpivot2 = 0.;
     if (this->dtype.compare("photon") == 0){
         lpivot2 = _lT / trapz(transmission / wavelength_nm, wavelength_nm)[0];
     } else {
         lpivot2 = norm / trapz(transmission / xt::square(wavelength_nm), wavelength_nm)[0];
     }
-    this->lpivot = std::sqrt(lpivot2);
+    p.lpivot = std::sqrt(lpivot2);
 
     // the last value with a transmission at least 1% of maximum transmission
     double lmax = wavelength_nm[0];
@@ -208,15 +320,15 @@ void Filter::calculate_sed_independent_properties(){
             lmin = std::min(lmin, wavelength_nm[i]);
         }
     }
-    this->lmin = lmin;
-    this->lmax = lmax;
+    p.lmin = lmin;
+    p.lmax = lmax;
 
     // Effective width
     // Equivalent to the horizontal size of a rectangle with height equal
     // to maximum transmission and with the same area that the one covered by
     // the filter transmission curve.
     // W = int(T dlamb) / max(T)
-    this->width = (norm / xt::amax(transmission)[0]);
+    p.width = (norm / xt::amax(transmission)[0]);
 
     // FWHM
     // the difference between the two wavelengths for which filter transmission is
@@ -240,19 +352,130 @@ void Filter::calculate_sed_independent_properties(){
             break;
         }
     }
-    this->fwhm = last - first;
+    p.fwhm = last - first;
+}
 
+/**
+ * @brief Calculate the Vega weighted effective wavelengths (leff, lphot)
+ *
+ * @param p   structure to fill
+ */
+void Filter::calculate_vega_properties(Properties& p) const {
     // leff = int (lamb * T * Vega dlamb) / int(T * Vega dlamb)
-    auto vega = Vega();
-    const DMatrix& vega_wavelength = vega.get_wavelength(nm);
-    const DMatrix& vega_flux = vega.get_flux(flam);
-    auto vega_T = xt::interp(vega_wavelength, this->get_wavelength(nm), this->get_transmission(), 0., 0.);
-    this->leff =  xt::trapz(vega_wavelength * vega_T * vega_flux, vega_wavelength)[0] /
-                  xt::trapz(vega_T * vega_flux, vega_wavelength)[0];
+    const Vega vega;
+    const DMatrix& vega_wavelength = vega.get_wavelength();   // nm
+    const DMatrix& vega_flux = vega.get_flux();               // flam
+    DMatrix vega_T = interp_sorted(vega_wavelength, this->get_wavelength(), this->get_transmission(), 0., 0.);
+    p.leff = xt::trapz(vega_wavelength * vega_T * vega_flux, vega_wavelength)[0] /
+             xt::trapz(vega_T * vega_flux, vega_wavelength)[0];
 
     // lphot = int(lamb ** 2 * T * Vega dlamb) / int(lamb * T * Vega dlamb)
-    this->lphot = xt::trapz(xt::square(vega_wavelength) * vega_T * vega_flux, vega_wavelength)[0] /
-                  xt::trapz(vega_wavelength * vega_T * vega_flux, vega_wavelength)[0];
+    p.lphot = xt::trapz(xt::square(vega_wavelength) * vega_T * vega_flux, vega_wavelength)[0] /
+              xt::trapz(vega_wavelength * vega_T * vega_flux, vega_wavelength)[0];
+}
+
+/**
+ * @brief SED independent properties, computed on first access
+ *
+ * @return properties (leff and lphot are not set, see get_vega_properties)
+ */
+const Filter::Properties& Filter::get_properties() const {
+    std::call_once(this->properties->flag, [this](){
+        this->calculate_sed_independent_properties(this->properties->values);
+        this->properties->computed = true;
+    });
+    return this->properties->values;
+}
+
+/**
+ * @brief SED independent properties including the Vega weighted wavelengths
+ *
+ * @return properties
+ */
+const Filter::Properties& Filter::get_vega_properties() const {
+    const Properties& p = this->get_properties();
+    std::call_once(this->properties->vega_flag, [this](){
+        this->calculate_vega_properties(this->properties->values);
+        this->properties->vega_computed = true;
+    });
+    return p;
+}
+
+/**
+ * @brief Whether the SED independent properties were computed (and cached)
+ *
+ * Construction and `reinterp` never compute them; the first accessor does.
+ */
+bool Filter::has_properties() const {
+    return this->properties->computed;
+}
+
+/**
+ * @brief Whether the Vega weighted wavelengths (leff, lphot) were computed
+ */
+bool Filter::has_vega_properties() const {
+    return this->properties->vega_computed;
+}
+
+/**
+ * @brief Calculate the zero points of the filter in all systems at once.
+ *
+ * This involves one integration of the Vega spectrum through the filter.
+ * The values are stored in `zero_points` by `Filter::get_zero_points`.
+ *
+ * @param zp   structure to fill
+ */
+void Filter::calculate_zero_points(ZeroPoints& zp) const {
+    // conversion from flam to Jy: 10^5 / (10^-8 c) * lpivot^2 with lpivot in AA
+    double c_ = 1e-8 * speed_of_light.to(meter / second);
+    double flam_to_Jy = 1e5 / c_ * std::pow(this->get_lpivot().to(angstrom), 2);
+
+    // AB: mag = 2.5 log10(lpivot^2 / c) + 48.60 with lpivot in AA
+    double C1 = (this->wavelength_unit).to(angstrom);
+    C1 = C1 * C1 / speed_of_light.to(angstrom / second);
+    const double lpivot = this->get_properties().lpivot;
+    C1 = lpivot * lpivot * C1;
+    zp.AB_mag = 2.5 * std::log10(C1) + 48.60;
+    zp.AB_flam = std::pow(10, -0.4 * zp.AB_mag);
+    zp.AB_Jy = flam_to_Jy * zp.AB_flam;
+
+    // ST: mag = 21.1 by definition
+    zp.ST_mag = 21.1;
+    zp.ST_flam = std::pow(10, -0.4 * zp.ST_mag);
+    zp.ST_Jy = flam_to_Jy * zp.ST_flam;
+
+    // Vega: magnitude of Vega is 0 in all filters
+    const Vega v;
+    zp.Vega_flam = this->get_flux(
+        v.get_wavelength(),
+        v.get_flux(),
+        nm, flam).to(flam);
+    zp.Vega_mag = -2.5 * std::log10(zp.Vega_flam);
+    zp.Vega_Jy = flam_to_Jy * zp.Vega_flam;
+}
+
+/**
+ * @brief Get all the zero points of the filter
+ *
+ * The zero points are calculated on the first call only and cached with the
+ * filter (thread-safe). Copies of a filter share the same cache as the
+ * definition of the passband does not change.
+ *
+ * @return zero points in the Vega, AB and ST systems
+ */
+const ZeroPoints& Filter::get_zero_points() const {
+    std::call_once(this->zero_points->flag, [this](){
+        this->calculate_zero_points(this->zero_points->values);
+        this->zero_points->computed = true;
+    });
+    return this->zero_points->values;
+}
+
+/**
+ * @brief Whether the zero points were computed (and cached)
+ */
+bool Filter::has_zero_points() const {
+    return this->zero_points->computed;
 }
 
 /**
@@ -263,11 +486,8 @@ void Filter::calculate_sed_independent_properties(){
  *
  * @return AB magnitude zero point
  */
-double Filter::get_AB_zero_mag(){
-    double C1 = (this->wavelength_unit).to(angstrom);
-    C1 = C1 * C1 / speed_of_light.to(angstrom / second);
-    C1 = this->lpivot * this->lpivot * C1;
-    return 2.5 * std::log10(C1) + 48.60;
+double Filter::get_AB_zero_mag() const {
+    return this->get_zero_points().AB_mag;
 }
 
 /**
@@ -278,8 +498,8 @@ double Filter::get_AB_zero_mag(){
  *
  * @return AB flux zero point
  */
-QSpectralFluxDensity Filter::get_AB_zero_flux(){
-    return std::pow(10, -0.4 * this->get_AB_zero_mag()) * flam;
+QSpectralFluxDensity Filter::get_AB_zero_flux() const {
+    return this->get_zero_points().AB_flam * flam;
 }
 
 /**
@@ -292,10 +512,8 @@ QSpectralFluxDensity Filter::get_AB_zero_flux(){
  *
  * @return AB flux zero point in Jansky (Jy)
  */
-QSpectralFluxDensity Filter::get_AB_zero_Jy(){
-        double c = 1e-8 * speed_of_light.to(meter / second);
-        double f = 1e5 / c * std::pow(this->get_lpivot().to(angstrom), 2) * this->get_AB_zero_flux().to(flam);
-        return f * Jy;
+QSpectralFluxDensity Filter::get_AB_zero_Jy() const {
+    return this->get_zero_points().AB_Jy * Jy;
 }
 
 /**
@@ -305,8 +523,8 @@ QSpectralFluxDensity Filter::get_AB_zero_Jy(){
  *
  * @return ST magnitude zero point
  */
-double Filter::get_ST_zero_mag(){
-    return 21.1;    // definition
+double Filter::get_ST_zero_mag() const {
+    return this->get_zero_points().ST_mag;
 }
 
 /**
@@ -317,8 +535,8 @@ double Filter::get_ST_zero_mag(){
  *
  * @return ST flux in flam
  */
-QSpectralFluxDensity Filter::get_ST_zero_flux(){
-    return std::pow(10, -0.4 * this->get_ST_zero_mag()) * flam;
+QSpectralFluxDensity Filter::get_ST_zero_flux() const {
+    return this->get_zero_points().ST_flam * flam;
 }
 
 /**
@@ -331,10 +549,8 @@ QSpectralFluxDensity Filter::get_ST_zero_flux(){
  *
  * @return ST flux in Jy
  */
-QSpectralFluxDensity Filter::get_ST_zero_Jy(){
-        double c = 1e-8 * speed_of_light.to(meter / second);
-        double f = 1e5 / c * std::pow(this->get_lpivot().to(angstrom), 2) * this->get_ST_zero_flux().to(flam);
-        return f * Jy;
+QSpectralFluxDensity Filter::get_ST_zero_Jy() const {
+    return this->get_zero_points().ST_Jy * Jy;
 }
 
 /**
@@ -342,8 +558,8 @@ QSpectralFluxDensity Filter::get_ST_zero_Jy(){
  *
  * @return Vega magnitude zero point
  */
-double Filter::get_Vega_zero_mag(){
-    return -2.5 * std::log10(this->get_Vega_zero_flux().to(flam));
+double Filter::get_Vega_zero_mag() const {
+    return this->get_zero_points().Vega_mag;
 }
 
 /**
@@ -351,13 +567,8 @@ double Filter::get_Vega_zero_mag(){
  *
  * @return flux of Vega in flam (erg/s/cm^2/Angstrom)
  */
-QSpectralFluxDensity Filter::get_Vega_zero_flux(){
-    Vega v = Vega();
-    double flux_flam = this->get_flux(
-        v.get_wavelength(nm),
-        v.get_flux(flam),
-        nm, flam).to(flam);
-    return flux_flam * flam;
+QSpectralFluxDensity Filter::get_Vega_zero_flux() const {
+    return this->get_zero_points().Vega_flam * flam;
 }
 
 /**
@@ -370,16 +581,20 @@ QSpectralFluxDensity Filter::get_Vega_zero_flux(){
  *
  * @return flux of Vega in Jy
  */
-QSpectralFluxDensity Filter::get_Vega_zero_Jy(){
-        double c = 1e-8 * speed_of_light.to(meter / second);
-        double f = 1e5 / c * std::pow(this->get_lpivot().to(angstrom), 2) * this->get_Vega_zero_flux().to(flam);
-        return f * Jy;
+QSpectralFluxDensity Filter::get_Vega_zero_Jy() const {
+    return this->get_zero_points().Vega_Jy * Jy;
 }
 
 /**
  * @brief Integrate the flux within the filter and return the integrated energy/flux
  *
- * The filter is first interpolated on the spectrum wavelength definition.
+ * Only the spectrum samples within the filter definition are visited (see
+ * `Filter::visit_weights`): the transmission is linearly interpolated on the
+ * fly and both integrals are accumulated in a single pass without temporary
+ * arrays. This is equivalent to interpolating the filter on the full
+ * spectrum wavelength (with zero outside its definition) and integrating
+ * with the trapezoidal rule.
+ *
  * The flux is then calculated as the integral of the flux within the filter depending on the detector type as:
  *
  * - for photon detectors:
@@ -392,7 +607,7 @@ QSpectralFluxDensity Filter::get_Vega_zero_Jy(){
  * f_\lambda = \frac{\int T(\lambda) f_\lambda d\lambda}{\int T(\lambda) d\lambda}
  * \f]
  *
- * @param wavelength        wavelength array
+ * @param wavelength        wavelength array (increasing)
  * @param flux              flux array
  * @param wavelength_unit   wavelength unit
  * @param flux_unit         flux unit
@@ -403,34 +618,441 @@ QSpectralFluxDensity Filter::get_flux(
     const DMatrix& wavelength,
     const DMatrix& flux,
     const QLength& wavelength_unit,
-    const QSpectralFluxDensity& flux_unit) {
-    //filter on wavelength units
-    const DMatrix& filt_wave = this->get_wavelength(wavelength_unit);
-    const DMatrix& filt_trans = this->get_transmission();
+    const QSpectralFluxDensity& flux_unit) const {
+    if (flux.size() != wavelength.size()) {
+        throw std::runtime_error("Filter::get_flux: flux does not match the wavelength grid");
+    }
+    return this->integrate(wavelength, flux.data(), wavelength_unit) * flux_unit;
+}
 
-    // Check overlaps
-    if ((xt::amin(filt_wave)[0] > xt::amax(wavelength)[0])
-        || (xt::amax(filt_wave)[0] < xt::amin(wavelength)[0])) {
-        return 0. * flux_unit;
+/**
+ * @brief Integration weights of the filter on a wavelength grid
+ *
+ * Single integration kernel of the filter: every flux is
+ * \f$\sum_i w_i f_i / \sum_i w_i\f$ over the weights visited here.
+ *
+ * The transmission is linearly interpolated on the grid points and the
+ * integrals use the trapezoid rule of the grid,
+ * \f$\int W f d\lambda \simeq \sum_i W(\lambda_i) f_i \delta_i\f$ with
+ * \f$\delta_i = (\lambda_{i+1} - \lambda_{i-1}) / 2\f$ (half intervals at the
+ * ends of the grid), and \f$W = \lambda T\f$ (photon) or \f$T\f$ (energy).
+ * The loop runs over the filter segments; the grid points of each segment
+ * are contiguous and the transmission is affine on them, so that the inner
+ * loop has no search. Grid values are fetched by blocks (`values`), and
+ * points outside the filter definition are never visited.
+ *
+ * @tparam Grid             `ArrayGrid`, `UniformGrid` or `LogUniformGrid`
+ * @tparam Visitor          callable `(std::size_t i, double w)`
+ * @param wavelength        wavelength grid (increasing)
+ * @param wavelength_unit   wavelength unit
+ * @param visit             called with increasing contiguous indices i and
+ *                          the unnormalized weights w_i
+ * @return normalization \f$\sum_i w_i\f$, 0 if the filter does not overlap
+ *         the grid or its transmission is null on it
+ */
+template <typename Grid, typename Visitor>
+double Filter::visit_weights(const Grid& wavelength,
+                             const QLength& wavelength_unit,
+                             Visitor&& visit) const {
+    const std::size_t n_spec = wavelength.size();
+    const std::size_t n_filt = this->wavelength_nm.size();
+    if ((n_spec < 2) || (n_filt < 2)) {
+        return 0.;
+    }
+
+    // filter definition, converted on the fly to the spectrum wavelength units
+    const double conv = nm.to(wavelength_unit);
+    const double * filt_wave = this->wavelength_nm.data();
+    const double * filt_trans = this->transmission.data();
+    const double filt_min = filt_wave[0] * conv;
+    const double filt_max = filt_wave[n_filt - 1] * conv;
+    if ((filt_min > wavelength.back()) || (filt_max < wavelength.front())) {
+        return 0.;
     }
 
-    // reinterpolate the transmission to the spectrum wavelength
-    auto new_trans = xt::interp(wavelength, filt_wave, filt_trans, 0., 0.);
+    constexpr std::size_t block = 256;
+    double xb[block + 2];
+    const bool photon = this->is_photon_type();
+    double b = 0.;
+    std::size_t start = wavelength.lower_bound(filt_min);
+    for (std::size_t j = 0; j + 1 < n_filt; ++j) {
+        const double x0 = filt_wave[j] * conv;
+        const double x1 = filt_wave[j + 1] * conv;
+        // grid points in [x0, x1), and [x0, x1] for the last segment
+        const std::size_t end = (j + 2 == n_filt) ? wavelength.upper_bound(x1) :
+                                                    wavelength.lower_bound(x1);
+        if ((end <= start) || !(x1 > x0)) { continue; }
+        const double t0 = filt_trans[j];
+        const double slope = (filt_trans[j + 1] - t0) / (x1 - x0);
+        for (std::size_t first = start; first < end; first += block) {
+            // values of [first - 1, first + m + 1), the grid ends repeated as
+            // their own neighbours (half trapezoids)
+            const std::size_t m = std::min(block, end - first);
+            const bool has_left = (first > 0);
+            const bool has_right = (first + m < n_spec);
+            wavelength.values(first - has_left, first + m + has_right, xb + !has_left);
+            if (!has_left) { xb[0] = xb[1]; }
+            if (!has_right) { xb[m + 1] = xb[m]; }
+            const double * x = xb + 1;
+            for (std::size_t k = 0; k < m; ++k) {
+                const double trans = t0 + (x[k] - x0) * slope;
+                const double w = (photon ? x[k] * trans : trans) * 0.5 * (x[k + 1] - x[k - 1]);
+                b += w;
+                visit(first + k, w);
+            }
+        }
+        start = end;
+    }
+    // null when the transmission is null on the visited points
+    return (b > 0) ? b : 0.;
+}
 
-    // check transmission is not null everywhere
-    if (! xt::any(new_trans > 0)){
+/**
+ * @brief Integrate a flux array within the filter for any flux storage type
+ *
+ * Dot product of the flux with the cached weights when the transmission
+ * cache is enabled, accumulated on the fly otherwise.
+ *
+ * @tparam T                storage type of the flux (accumulation in double)
+ * @param wavelength        wavelength array (increasing)
+ * @param flux              flux values (wavelength.size())
+ * @param wavelength_unit   wavelength unit
+ * @return integrated flux in the units of the flux
+ */
+template <typename T>
+double Filter::integrate(const DMatrix& wavelength,
+                         const T * flux,
+                         const QLength& wavelength_unit) const {
+    if (this->transmission_cache->get_capacity() > 0) {
+        std::shared_ptr<const CachedWeights> weights = this->get_weights(wavelength, wavelength_unit);
+        const double * w = weights->weights.data();
+        const T * f = flux + weights->start;
+        double a = 0.;
+        for (std::size_t i = 0; i < weights->weights.size(); ++i) { a += w[i] * f[i]; }
+        return a;
+    }
+    double a = 0.;
+    const double b = this->visit_weights(ArrayGrid(wavelength), wavelength_unit,
+                                         [&](std::size_t i, double w){ a += w * flux[i]; });
+    return (b > 0) ? a / b : 0.;
+}
+
+/**
+ * @brief Normalized integration weights of the filter on a wavelength grid
+ *
+ * Weights of `Filter::visit_weights` stored for the transmission cache.
+ *
+ * @param wavelength        wavelength grid (increasing)
+ * @param wavelength_unit   wavelength unit
+ * @return weights (empty if the filter does not overlap the grid)
+ */
+template <typename Grid>
+CachedWeights Filter::calculate_weights(const Grid& wavelength,
+                                        const QLength& wavelength_unit) const {
+    CachedWeights result;
+    std::vector<double> weights;
+    std::size_t start = 0;
+    const double b = this->visit_weights(wavelength, wavelength_unit,
+                                         [&](std::size_t i, double w){
+                                             if (weights.empty()) { start = i; }
+                                             weights.push_back(w);
+                                         });
+    if (!(b > 0)) {
+        return result;
+    }
+    for (auto& w : weights) { w /= b; }
+    result.start = start;
+    result.weights = std::move(weights);
+    return result;
+}
+
+/**
+ * @brief Normalized integration weights of the filter on a wavelength array
+ *
+ * The integrated flux of any spectrum on this grid is
+ * \f$\sum_i w_i f_{start + i}\f$ (see `CachedWeights`). Weights come from
+ * the transmission cache when it is enabled
+ * (`Filter::set_transmission_cache_size`).
+ *
+ * @param wavelength        wavelength array (increasing)
+ * @param wavelength_unit   wavelength unit
+ * @return shared weights
+ */
+std::shared_ptr<const CachedWeights> Filter::get_weights(const DMatrix& wavelength,
+                                                         const QLength& wavelength_unit) const {
+    const ArrayGrid grid(wavelength);
+    if ((this->transmission_cache->get_capacity() == 0) || (this->wavelength_nm.size() < 2)) {
+        return std::make_shared<const CachedWeights>(this->calculate_weights(grid, wavelength_unit));
+    }
+    // the weights depend on the grid points within the filter and their neighbours
+    const double conv = nm.to(wavelength_unit);
+    const std::size_t n = grid.size();
+    const std::size_t lo = grid.lower_bound(this->wavelength_nm[0] * conv);
+    const std::size_t hi = grid.upper_bound(this->wavelength_nm[this->wavelength_nm.size() - 1] * conv);
+    const std::size_t window_start = (lo > 0) ? lo - 1 : 0;
+    const std::size_t window_end = std::min(hi + 1, n);
+    GridFingerprint key = make_grid_fingerprint(wavelength.data(), n, wavelength_unit.to(nm));
+    auto cached = this->transmission_cache->get(key, wavelength.data(), window_start, window_end, [&](){
+        return this->calculate_weights(grid, wavelength_unit);
+    });
+    if (cached->start + cached->weights.size() > wavelength.size()) {
+        throw std::runtime_error("Filter::get_flux: cached weights do not match the wavelength grid");
+    }
+    return cached;
+}
+
+/**
+ * @brief Integrate a spectrum within the filter
+ *
+ * Same as `Filter::get_flux` on the arrays of the spectrum (no copy).
+ *
+ * @tparam T         storage type of the flux (accumulation in double)
+ * @param spectrum   spectrum
+ * @return integrated flux through the filter, in the flux unit of the spectrum
+ */
+template <typename T>
+QSpectralFluxDensity Filter::get_flux(const BasicSpectrum<T>& spectrum) const {
+    return this->integrate(spectrum.get_wavelength(), spectrum.get_flux().data(),
+                           spectrum.get_wavelength_unit()) * spectrum.get_flux_unit();
+}
+
+/**
+ * @brief Integrate a batch of spectra within the filter
+ *
+ * The normalized weights of the filter on the shared wavelength grid are
+ * computed once (or taken from the transmission cache), each spectrum then
+ * reduces to a dot product over its flux row.
+ *
+ * @tparam T        storage type of the flux (accumulation in double)
+ * @param spectra   spectra sharing one wavelength grid
+ * @return integrated fluxes (n_spectra) in the flux unit of the batch
+ */
+template <typename T>
+DMatrix Filter::get_flux(const BasicSpectrumBatch<T>& spectra) const {
+    const std::size_t n = spectra.n_spectra();
+    DMatrix result = xt::zeros<double>({n});
+    if ((spectra.n_wavelength() < 2) || (this->wavelength_nm.size() < 2)) {
+        return result;
+    }
+    std::shared_ptr<const CachedWeights> cached = this->get_weights(spectra.get_wavelength(),
+                                                                    spectra.get_wavelength_unit());
+    const double * w = cached->weights.data();
+    const std::size_t n_weights = cached->weights.size();
+    for (std::size_t k = 0; k < n; ++k) {
+        const T * f = spectra.row(k) + cached->start;
+        double a = 0.;
+        #pragma omp simd reduction(+:a)
+        for (std::size_t i = 0; i < n_weights; ++i) { a += w[i] * f[i]; }
+        result[k] = a;
+    }
+    return result;
+}
+
+/**
+ * @brief Set the number of spectrum grids whose integration weights are cached
+ *
+ * When enabled, `get_flux` on a wavelength grid already seen (see
+ * `GridFingerprint`) skips the interpolation and reduces to a dot product.
+ * The cache is shared by the copies of the filter, which see the new
+ * capacity as well.
+ *
+ * @param capacity  maximum number of grids (0 disables the cache)
+ */
+void Filter::set_transmission_cache_size(std::size_t capacity) {
+    this->transmission_cache->set_capacity(capacity);
+}
+
+/**
+ * @brief Hit, miss and eviction counters of the transmission cache
+ *
+ * @return TransmissionCacheStats
+ */
+TransmissionCacheStats Filter::get_transmission_cache_stats() const {
+    return this->transmission_cache->get_stats();
+}
+
+/**
+ * @brief Compute the integrated flux and its gradient with the same weights
+ *
+ * The integration is linear in the flux, so the derivative of the
+ * integrated flux with respect to a parameter \f$\theta\f$ of the spectrum
+ * is the integral of \f$\partial f_\lambda / \partial \theta\f$. The
+ * weights of the filter are computed once (see `Filter::get_weights`) and
+ * applied to the flux and to all the derivatives (see `bb_flux_gradient` for
+ * the blackbody derivatives).
+ *
+ * @param wavelength        wavelength array (increasing, n)
+ * @param flux              flux array (n)
+ * @param flux_gradient     derivatives of the flux (n_params, n)
+ * @param wavelength_unit   wavelength unit
+ * @param flux_unit         flux unit
+ * @param gradient          set to the derivatives of the integrated flux
+ *                          (n_params) in flux units per parameter unit
+ * @return integrated flux through the filter
+ * @throw std::runtime_error if the flux or the gradient do not match the wavelength
+ */
+QSpectralFluxDensity Filter::get_flux(
+    const DMatrix& wavelength,
+    const DMatrix& flux,
+    const DMatrix& flux_gradient,
+    const QLength& wavelength_unit,
+    const QSpectralFluxDensity& flux_unit,
+    DMatrix& gradient) const {
+
+    const std::size_t n_spec = wavelength.size();
+    const std::size_t n_params = (n_spec > 0) ? flux_gradient.size() / n_spec : 0;
+    if (n_params * n_spec != flux_gradient.size()) {
+        throw std::runtime_error("flux_gradient must be of shape (n_params, n_wavelength)");
+    }
+    if (flux.size() != n_spec) {
+        throw std::runtime_error("Filter::get_flux: flux does not match the wavelength grid");
+    }
+    gradient = xt::zeros<double>({n_params});
+
+    // same weights applied to the flux and all the derivatives
+    std::shared_ptr<const CachedWeights> weights = this->get_weights(wavelength, wavelength_unit);
+    const double * w = weights->weights.data();
+    const std::size_t n = weights->weights.size();
+    const double * f = flux.data() + weights->start;
+    double a = 0.;
+    for (std::size_t i = 0; i < n; ++i) { a += w[i] * f[i]; }
+    for (std::size_t k = 0; k < n_params; ++k) {
+        const double * g = flux_gradient.data() + k * n_spec + weights->start;
+        double da = 0.;
+        for (std::size_t i = 0; i < n; ++i) { da += w[i] * g[i]; }
+        gradient[k] = da;
+    }
+    return a * flux_unit;
+}
+
+/**
+ * @brief Integrate the flux within the filter on a regular wavelength grid
+ *
+ * Shared by the `UniformGrid` and `LogUniformGrid` overloads of
+ * `Filter::get_flux`, with the weights of `Filter::visit_weights` in a
+ * specialized kernel: the grid values are generated by blocks (`values`),
+ * interior trapezoid weights are closed-form (`interior_weight_at`: the step,
+ * or \f$\lambda \sinh\delta\f$) and the inner loop of each filter segment is
+ * a branch-free vectorized reduction. The half trapezoids at the ends of the
+ * grid are corrected afterwards.
+ *
+ * @param wavelength        wavelength grid descriptor
+ * @param flux              flux array on the grid
+ * @param wavelength_unit   wavelength unit
+ * @param flux_unit         flux unit
+ * @return integrated flux through the filter
+ * @throw std::runtime_error if the flux does not match the grid size
+ */
+template <typename Grid>
+QSpectralFluxDensity Filter::get_flux_on_grid(
+    const Grid& wavelength,
+    const DMatrix& flux,
+    const QLength& wavelength_unit,
+    const QSpectralFluxDensity& flux_unit) const {
+
+    const std::size_t n_spec = wavelength.size();
+    const std::size_t n_filt = this->wavelength_nm.size();
+    if (flux.size() != n_spec) {
+        throw std::runtime_error("Filter::get_flux: flux does not match the wavelength grid");
+    }
+    if ((n_spec < 2) || (n_filt < 2)) {
         return 0. * flux_unit;
     }
-    // Calculate the flux depending on detector type
-    if (this->is_photon_type()){
-        double a = xt::trapz(wavelength * new_trans * flux, wavelength)[0];
-        double b = xt::trapz(wavelength * new_trans, wavelength)[0];
-        return a / b * flux_unit;
-    } else {
-        double a = xt::trapz(new_trans * flux, wavelength)[0];
-        double b = xt::trapz(new_trans, wavelength)[0];
-        return a / b * flux_unit;
+
+    const double conv = nm.to(wavelength_unit);
+    const double * filt_wave = this->wavelength_nm.data();
+    const double * filt_trans = this->transmission.data();
+    const double * spec_flux = flux.data();
+    const double filt_min = filt_wave[0] * conv;
+    const double filt_max = filt_wave[n_filt - 1] * conv;
+    if ((filt_min > wavelength.back()) || (filt_max < wavelength.front())) {
+        return 0. * flux_unit;
+    }
+
+    constexpr std::size_t block = 256;
+    double xb[block];
+    const double px = this->is_photon_type() ? 1. : 0.;   // weight x * T or T
+    double a = 0.;       // int weight * flux dλ
+    double b = 0.;       // int weight dλ
+    std::size_t start = wavelength.lower_bound(filt_min);
+    for (std::size_t j = 0; j + 1 < n_filt; ++j) {
+        const double x0 = filt_wave[j] * conv;
+        const double x1 = filt_wave[j + 1] * conv;
+        // grid points in [x0, x1), and [x0, x1] for the last segment
+        const std::size_t end = (j + 2 == n_filt) ? wavelength.upper_bound(x1) :
+                                                    wavelength.lower_bound(x1);
+        if ((end <= start) || !(x1 > x0)) { continue; }
+        const double t0 = filt_trans[j];
+        const double slope = (filt_trans[j + 1] - t0) / (x1 - x0);
+        for (std::size_t first = start; first < end; first += block) {
+            const std::size_t m = std::min(block, end - first);
+            wavelength.values(first, first + m, xb);
+            const double * f = spec_flux + first;
+            #pragma omp simd reduction(+:a, b)
+            for (std::size_t k = 0; k < m; ++k) {
+                const double x = xb[k];
+                const double trans = t0 + (x - x0) * slope;
+                const double w = trans * (px * x + (1. - px)) * wavelength.interior_weight_at(x);
+                a += w * f[k];
+                b += w;
+            }
+        }
+        start = end;
+    }
+
+    // the end points of the grid have half trapezoids
+    for (std::size_t k : {std::size_t(0), n_spec - 1}) {
+        const double x = wavelength[k];
+        if ((x < filt_min) || (x > filt_max)) { continue; }
+        double trans = 0.;
+        const double x_nm = x / conv;
+        interp_sorted(&x_nm, 1, filt_wave, filt_trans, n_filt, &trans, 0., 0.);
+        const double w = trans * (px * x + (1. - px)) *
+                         (wavelength.trapz_weight(k) - wavelength.interior_weight(k));
+        a += w * spec_flux[k];
+        b += w;
     }
+    return ((b > 0) ? a / b : 0.) * flux_unit;
+}
+
+/**
+ * @brief Integrate the flux within the filter on a uniform wavelength grid
+ *
+ * Same as `Filter::get_flux` with an implicit wavelength array
+ * \f$\lambda_i = \lambda_0 + i \delta\lambda\f$ that is never materialized.
+ *
+ * @param wavelength        uniform wavelength grid descriptor
+ * @param flux              flux array on the grid
+ * @param wavelength_unit   wavelength unit
+ * @param flux_unit         flux unit
+ * @return integrated flux through the filter
+ */
+QSpectralFluxDensity Filter::get_flux(
+    const UniformGrid& wavelength,
+    const DMatrix& flux,
+    const QLength& wavelength_unit,
+    const QSpectralFluxDensity& flux_unit) const {
+    return this->get_flux_on_grid(wavelength, flux, wavelength_unit, flux_unit);
+}
+
+/**
+ * @brief Integrate the flux within the filter on a log-uniform wavelength grid
+ *
+ * Same as `Filter::get_flux` with an implicit wavelength array
+ * \f$\lambda_i = \lambda_0 e^{i \delta}\f$ that is never materialized.
+ *
+ * @param wavelength        log-uniform wavelength grid descriptor
+ * @param flux              flux array on the grid
+ * @param wavelength_unit   wavelength unit
+ * @param flux_unit         flux unit
+ * @return integrated flux through the filter
+ */
+QSpectralFluxDensity Filter::get_flux(
+    const LogUniformGrid& wavelength,
+    const DMatrix& flux,
+    const QLength& wavelength_unit,
+    const QSpectralFluxDensity& flux_unit) const {
+    return this->get_flux_on_grid(wavelength, flux, wavelength_unit, flux_unit);
 }
 
 /**
@@ -439,10 +1061,10 @@ QSpectralFluxDensity Filter::get_flux(
  * @param new_wavelength_nm    wavelength definition in nm
  * @return new filter interpolated to match the new wavelength definition
  */
-Filter Filter::reinterp(const DMatrix& new_wavelength_nm){
+Filter Filter::reinterp(const DMatrix& new_wavelength_nm) const {
     const DMatrix& filt_wave = this->get_wavelength();
     const DMatrix& filt_trans = this->get_transmission();
-    auto new_trans = xt::interp(new_wavelength_nm, filt_wave, filt_trans, 0., 0.);
+    DMatrix new_trans = interp_sorted(new_wavelength_nm, filt_wave, filt_trans, 0., 0.);
     return Filter(new_wavelength_nm, new_trans, nm, this->dtype, this->name);
 }
 
@@ -453,32 +1075,173 @@ Filter Filter::reinterp(const DMatrix& new_wavelength_nm){
  * @param new_wavelength_unit  wavelength unit
  * @return new filter interpolated to match the new wavelength definition
  */
-Filter Filter::reinterp(const DMatrix& new_wavelength, const QLength& new_wavelength_unit){
+Filter Filter::reinterp(const DMatrix& new_wavelength, const QLength& new_wavelength_unit) const {
     const DMatrix& filt_wave = this->get_wavelength(new_wavelength_unit);
     const DMatrix& filt_trans = this->get_transmission();
-    auto new_trans = xt::interp(new_wavelength, filt_wave, filt_trans, 0., 0.);
+    DMatrix new_trans = interp_sorted(new_wavelength, filt_wave, filt_trans, 0., 0.);
     return Filter(new_wavelength, new_trans, new_wavelength_unit,
                   this->dtype, this->name);
 }
 
+/**
+ * @brief Keep the points of a curve deviating by more than epsilon from its
+ *        simplification (Douglas-Peucker).
+ *
+ * @param x        abscissa (increasing)
+ * @param y        values
+ * @param epsilon  absolute tolerance on y
+ * @return flags of the points to keep (end points are always kept)
+ */
+std::vector<bool> douglas_peucker(const DMatrix& x, const DMatrix& y, double epsilon){
+    const std::size_t n = x.size();
+    std::vector<bool> keep(n, false);
+    if (n == 0) { return keep; }
+    keep[0] = true;
+    keep[n - 1] = true;
+    std::vector<std::pair<std::size_t, std::size_t>> stack;
+    if (n > 2) { stack.emplace_back(0, n - 1); }
+    while (!stack.empty()) {
+        std::size_t first = stack.back().first;
+        std::size_t last = stack.back().second;
+        stack.pop_back();
+        const double slope = (y[last] - y[first]) / (x[last] - x[first]);
+        double dmax = -1.;
+        std::size_t imax = first;
+        for (std::size_t i = first + 1; i < last; ++i) {
+            double d = std::abs(y[i] - (y[first] + (x[i] - x[first]) * slope));
+            if (d > dmax) { dmax = d; imax = i; }
+        }
+        if (dmax > epsilon) {
+            keep[imax] = true;
+            if (imax - first > 1) { stack.emplace_back(first, imax); }
+            if (last - imax > 1) { stack.emplace_back(imax, last); }
+        }
+    }
+    return keep;
+}
+
+/**
+ * @brief Simplified filter preserving synthetic fluxes
+ *
+ * @param rel_tol   maximum relative error on the fluxes of the reference SEDs
+ * @return filter with fewer points
+ */
+Filter Filter::simplify(double rel_tol) const {
+    SimplifyReport report;
+    return this->simplify(rel_tol, report);
+}
+
+/**
+ * @brief Simplified filter preserving synthetic fluxes
+ *
+ * Points are dropped with a Douglas-Peucker simplification of the
+ * transmission curve. The tolerance on the transmission is adjusted by
+ * bisection to the largest value that keeps the fluxes of Vega and of
+ * blackbodies from 3000 K to 50000 K within `rel_tol` of the original filter.
+ *
+ * @param rel_tol   maximum relative error on the fluxes of the reference SEDs
+ * @param report    set to the achieved error and point reduction
+ * @return filter with fewer points
+ */
+Filter Filter::simplify(double rel_tol, SimplifyReport& report) const {
+    const DMatrix& wave = this->wavelength_nm;
+    const DMatrix& trans = this->transmission;
+    const std::size_t n = wave.size();
+
+    report.name = this->name;
+    report.n_points = n;
+    report.n_simplified = n;
+    report.max_error = 0;
+    if (n <= 2) { return *this; }
+
+    // reference SEDs: Vega on its own definition, blackbodies on the filter one
+    const Vega vega;
+    const DMatrix& vega_wave = vega.get_wavelength();
+    const DMatrix& vega_flux = vega.get_flux();
+    const double hc_k = 1.438776877e7;  // hc/k in nm K
+    const std::vector<double> temperatures {3000., 5000., 10000., 20000., 50000.};
+    std::vector<DMatrix> bb_flux;
+    for (double teff : temperatures) {
+        DMatrix bb = DMatrix::from_shape({n});
+        for (std::size_t i = 0; i < n; ++i) {
+            bb[i] = std::pow(wave[i], -5.) / std::expm1(hc_k / (wave[i] * teff));
+        }
+        bb_flux.push_back(bb);
+    }
+
+    auto fluxes = [&](const Filter& filter){
+        std::vector<double> values;
+        values.push_back(filter.get_flux(vega_wave, vega_flux, nm, flam).to(flam));
+        for (const auto& bb : bb_flux) {
+            values.push_back(filter.get_flux(wave, bb, nm, flam).to(flam));
+        }
+        return values;
+    };
+    const std::vector<double> reference = fluxes(*this);
+
+    auto candidate = [&](double epsilon, double& error){
+        std::vector<bool> keep = douglas_peucker(wave, trans, epsilon);
+        std::vector<double> w, t;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (keep[i]) { w.push_back(wave[i]); t.push_back(trans[i]); }
+        }
+        std::vector<std::size_t> shape = { w.size() };
+        Filter simplified(xt::adapt(w, shape), xt::adapt(t, shape), nm,
+                          this->dtype, this->name);
+        std::vector<double> values = fluxes(simplified);
+        error = 0;
+        for (std::size_t k = 0; k < values.size(); ++k) {
+            if (reference[k] != 0) {
+                error = std::max(error, std::abs(values[k] / reference[k] - 1.));
+            }
+        }
+        return simplified;
+    };
+
+    // bisection on log(epsilon) between negligible and the full curve amplitude
+    const double tmax = xt::amax(trans)[0];
+    if (!(tmax > 0)) { return *this; }
+    double lo = std::log(1e-12 * tmax);
+    double hi = std::log(tmax);
+    Filter best = *this;
+    for (int iter = 0; iter < 40; ++iter) {
+        double mid = 0.5 * (lo + hi);
+        double error = 0;
+        Filter simplified = candidate(std::exp(mid), error);
+        if (error <= rel_tol) {
+            lo = mid;
+            if (simplified.get_transmission().size() < best.get_transmission().size()) {
+                best = simplified;
+                report.n_simplified = simplified.get_transmission().size();
+                report.max_error = error;
+            }
+        } else {
+            hi = mid;
+        }
+        if (hi - lo < 1e-3) { break; }
+    }
+    return best;
+}
+
 /**
  * @brief Display some information on cout
  */
-void Filter::info(){
+void Filter::info() const {
     size_t n_points = this->transmission.size();
+    const Properties& p = this->get_vega_properties();
     std::cout << "Filter Object information:\n"
             << "    name:                 " << this->name << "\n"
             << "    detector type:        " << this->dtype << "\n"
             << "    wavelength units:     " << "nm  (internally set)" << "\n"
-            << "    central wavelength:   " << this->cl  << " nm" << "\n"
-            << "    pivot wavelength:     " << this->lpivot << " nm" << "\n"
-            << "    effective wavelength: " << this->leff << " nm" << "\n"
-            << "    photon wavelength:    " << this->lphot << " nm" << "\n"
-            << "    minimum wavelength:   " << this->lmin << " nm" << "\n"
-            << "    maximum wavelength:   " << this->lmax << " nm" << "\n"
-            << "    norm:                 " << this->norm << "\n"
-            << "    effective width:      " << this->width << " nm" << "\n"
-            << "    fullwidth half-max:   " << this->fwhm  << " nm" << "\n"
+            << "    central wavelength:   " << p.cl  << " nm" << "\n"
+            << "    pivot wavelength:     " << p.lpivot << " nm" << "\n"
+            << "    effective wavelength: " << p.leff << " nm" << "\n"
+            << "    photon wavelength:    " << p.lphot << " nm" << "\n"
+            << "    minimum wavelength:   " << p.lmin << " nm" << "\n"
+            << "    maximum wavelength:   " << p.lmax << " nm" << "\n"
+            << "    norm:                 " << p.norm << "\n"
+            << "    effective width:      " << p.width << " nm" << "\n"
+            << "    fullwidth half-max:   " << p.fwhm  << " nm" << "\n"
             << "    definition contains " << n_points << " points" << "\n"
             << " \n"
             << "  Zeropoints \n"
@@ -501,7 +1264,7 @@ void Filter::info(){
  *
  * @return central wavelength in nm
  */
-QLength Filter::get_cl(){ return this->cl * this->wavelength_unit;}
+QLength Filter::get_cl() const { return this->get_properties().cl * this->wavelength_unit;}
 
 /**
  * @brief  Pivot wavelength in nm
@@ -514,21 +1277,21 @@ QLength Filter::get_cl(){ return this->cl * this->wavelength_unit;}
  *
  * @return pivot wavelength in nm
  */
-QLength Filter::get_lpivot(){ return this->lpivot * this->wavelength_unit;}
+QLength Filter::get_lpivot() const { return this->get_properties().lpivot * this->wavelength_unit;}
 
 /**
  * @brief the first λ value with a transmission at least 1% of maximum transmission
  *
  * @return min wavelength in nm
  */
-QLength Filter::get_lmin(){ return this->lmin * this->wavelength_unit;}
+QLength Filter::get_lmin() const { return this->get_properties().lmin * this->wavelength_unit;}
 
 /**
  * @brief the last λ value with a transmission at least 1% of maximum transmission
  *
  * @return max wavelength in nm
  */
-QLength Filter::get_lmax(){ return this->lmax * this->wavelength_unit;}
+QLength Filter::get_lmax() const { return this->get_properties().lmax * this->wavelength_unit;}
 
 /**
  * @brief the norm of the passband
@@ -537,7 +1300,7 @@ QLength Filter::get_lmax(){ return this->lmax * this->wavelength_unit;}
  *
  * @return norm
  */
-double Filter::get_norm(){ return this->norm; }
+double Filter::get_norm() const { return this->get_properties().norm; }
 
 /**
  * @brief  Effective width
@@ -546,7 +1309,7 @@ double Filter::get_norm(){ return this->norm; }
  *
  * @return width in nm
  */
-QLength Filter::get_width(){ return this->width * this->wavelength_unit;}
+QLength Filter::get_width() const { return this->get_properties().width * this->wavelength_unit;}
 
 /**
  * @brief the difference between the two wavelengths for which filter
@@ -558,7 +1321,7 @@ QLength Filter::get_width(){ return this->width * this->wavelength_unit;}
  *
  * @return fwhm in nm
  */
-QLength Filter::get_fwhm(){ return this->fwhm * this->wavelength_unit;}
+QLength Filter::get_fwhm() const { return this->get_properties().fwhm * this->wavelength_unit;}
 
 /**
  * @brief Photon distribution based effective wavelength.
@@ -568,7 +1331,7 @@ QLength Filter::get_fwhm(){ return this->fwhm * this->wavelength_unit;}
  *
  * @return QLength
  */
-QLength Filter::get_lphot(){ return this->lphot * this->wavelength_unit;}
+QLength Filter::get_lphot() const { return this->get_vega_properties().lphot * this->wavelength_unit;}
 
 /**
  * @brief Effective wavelength
@@ -577,14 +1340,14 @@ QLength Filter::get_lphot(){ return this->lphot * this->wavelength_unit;}
  *
  * @return Effective wavelenth
  */
-QLength Filter::get_leff(){ return this->leff * this->wavelength_unit;}
+QLength Filter::get_leff() const { return this->get_vega_properties().leff * this->wavelength_unit;}
 
 /**
  * @brief Get the wavelength in nm
  *
  * @return wavelegnth in nm
  */
-DMatrix Filter::get_wavelength() {
+const DMatrix& Filter::get_wavelength() const {
     return this->wavelength_nm;
 }
 
@@ -594,7 +1357,7 @@ DMatrix Filter::get_wavelength() {
  * @param in  units to convert to
  * @return  wavelegnth in requested units
  */
-DMatrix Filter::get_wavelength(const QLength& in) {
+DMatrix Filter::get_wavelength(const QLength& in) const {
     return this->wavelength_nm * nm.to(in);
 }
 
@@ -603,7 +1366,7 @@ DMatrix Filter::get_wavelength(const QLength& in) {
  *
  * @return Transmission (unitless)
  */
-DMatrix Filter::get_transmission() {
+const DMatrix& Filter::get_transmission() const {
     return this->transmission;
 }
 
@@ -613,7 +1376,7 @@ DMatrix Filter::get_transmission() {
  * @return true   photon
  * @return false  energy
  */
-bool Filter::is_photon_type() {
+bool Filter::is_photon_type() const {
     return (this->dtype.compare("photon") == 0);
 }
 
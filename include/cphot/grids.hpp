@@ -0,0 +1,348 @@
+/**
+ * @defgroup GRIDS Regular wavelength grids
+ * @brief Descriptors of uniformly and log-uniformly sampled wavelength grids.
+ *
+ * Model spectra are often sampled on uniform (\f$\lambda_i = \lambda_0 + i
+ * \delta\lambda\f$) or log-uniform (\f$\lambda_i = \lambda_0 e^{i \delta}\f$)
+ * grids. For those, locating a wavelength and the trapezoid weights reduce to
+ * index arithmetic, and the wavelength array never needs to be stored.
+ *
+ * Both descriptors, and `ArrayGrid` for an arbitrary array, provide the same
+ * interface (`size`, `operator[]`, `lower_bound`, `upper_bound`,
+ * `trapz_weight`, `values`) so that integration kernels can be written once
+ * for all of them (see `cphot::Filter::visit_weights`). The regular grids
+ * also give their interior trapezoid weights in closed form
+ * (`interior_weight_at`), which `cphot::Filter::get_flux` uses in a
+ * specialized vectorized kernel.
+ *
+ * ```cpp
+ * // 1 million points between 100 and 2500 nm
+ * cphot::UniformGrid grid = cphot::UniformGrid::linspace(100., 2500., 1000000);
+ * QSpectralFluxDensity f = filter.get_flux(grid, flux, nm, flam);
+ * ```
+ */
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup GRIDS
+ * @brief Uniformly sampled grid: start + i * step, for i in [0, n)
+ */
+struct UniformGrid {
+    double start;      ///< first value
+    double step;       ///< constant step (> 0)
+    std::size_t n;     ///< number of points
+
+    /**
+     * @brief Construct a new Uniform Grid object
+     *
+     * @param start  first value
+     * @param step   constant step (> 0)
+     * @param n      number of points
+     * @throw std::runtime_error if step is not positive
+     */
+    UniformGrid(double start, double step, std::size_t n)
+        : start(start), step(step), n(n) {
+        if (!(step > 0)) { throw std::runtime_error("UniformGrid: step must be positive"); }
+    }
+
+    /**
+     * @brief grid of n points from start to stop (included)
+     *
+     * @throw std::runtime_error if n < 2 or stop <= start
+     */
+    static UniformGrid linspace(double start, double stop, std::size_t n){
+        if (n < 2) { throw std::runtime_error("UniformGrid::linspace: at least 2 points are required"); }
+        return UniformGrid(start, (stop - start) / (n - 1), n);
+    }
+
+    std::size_t size() const { return this->n; }
+    double operator[](std::size_t i) const { return this->start + i * this->step; }
+    double front() const { return this->start; }
+    double back() const { return (*this)[this->n - 1]; }
+
+    /**
+     * @brief index of the first point with a value >= x
+     */
+    std::size_t lower_bound(double x) const {
+        double k = std::ceil((x - this->start) / this->step);
+        std::size_t i = (k <= 0) ? 0 : std::min(static_cast<std::size_t>(k), this->n);
+        // fix rounding of the division
+        while ((i > 0) && ((*this)[i - 1] >= x)) { --i; }
+        while ((i < this->n) && ((*this)[i] < x)) { ++i; }
+        return i;
+    }
+
+    /**
+     * @brief index of the first point with a value > x
+     */
+    std::size_t upper_bound(double x) const {
+        std::size_t i = this->lower_bound(x);
+        while ((i < this->n) && ((*this)[i] <= x)) { ++i; }
+        return i;
+    }
+
+    /**
+     * @brief weight of an interior point in the trapezoidal rule (step)
+     */
+    double interior_weight(std::size_t) const { return this->step; }
+
+    /**
+     * @brief weight of an interior point of value x in the trapezoidal rule (step)
+     */
+    double interior_weight_at(double) const { return this->step; }
+
+    /**
+     * @brief weight of point i in the trapezoidal rule over the grid
+     */
+    double trapz_weight(std::size_t i) const {
+        if ((i == 0) || (i == this->n - 1)) { return 0.5 * this->step; }
+        return this->step;
+    }
+
+    /**
+     * @brief materialize the grid values
+     */
+    DMatrix values() const {
+        DMatrix v = DMatrix::from_shape({this->n});
+        for (std::size_t i = 0; i < this->n; ++i) { v[i] = (*this)[i]; }
+        return v;
+    }
+
+    /**
+     * @brief values of the points [first, last) in out
+     */
+    void values(std::size_t first, std::size_t last, double * out) const {
+        for (std::size_t i = first; i < last; ++i) { out[i - first] = (*this)[i]; }
+    }
+};
+
+/**
+ * @ingroup GRIDS
+ * @brief Log-uniformly sampled grid: start * exp(i * log_step), for i in [0, n)
+ */
+struct LogUniformGrid {
+    double start;      ///< first value (> 0)
+    double log_step;   ///< constant step in natural log (> 0)
+    std::size_t n;     ///< number of points
+    double ratio;      ///< exp(log_step), ratio of consecutive values
+    double sinh_step;  ///< sinh(log_step), relative interior trapezoid weight
+
+    /**
+     * @brief Construct a new Log Uniform Grid object
+     *
+     * @param start     first value (> 0)
+     * @param log_step  constant step in natural logarithm (> 0)
+     * @param n         number of points
+     * @throw std::runtime_error if start or log_step are not positive
+     */
+    LogUniformGrid(double start, double log_step, std::size_t n)
+        : start(start), log_step(log_step), n(n),
+          ratio(std::exp(log_step)), sinh_step(std::sinh(log_step)) {
+        if (!(start > 0)) { throw std::runtime_error("LogUniformGrid: start must be positive"); }
+        if (!(log_step > 0)) { throw std::runtime_error("LogUniformGrid: log_step must be positive"); }
+    }
+
+    /**
+     * @brief grid of n points from start to stop (included)
+     *
+     * @throw std::runtime_error if n < 2, start <= 0 or stop <= start
+     */
+    static LogUniformGrid logspace(double start, double stop, std::size_t n){
+        if (n < 2) { throw std::runtime_error("LogUniformGrid::logspace: at least 2 points are required"); }
+        return LogUniformGrid(start, std::log(stop / start) / (n - 1), n);
+    }
+
+    std::size_t size() const { return this->n; }
+    double operator[](std::size_t i) const { return this->start * std::exp(i * this->log_step); }
+    double front() const { return this->start; }
+    double back() const { return (*this)[this->n - 1]; }
+
+    /**
+     * @brief index of the first point with a value >= x
+     */
+    std::size_t lower_bound(double x) const {
+        if (x <= this->start) { return 0; }
+        double k = std::ceil(std::log(x / this->start) / this->log_step);
+        std::size_t i = std::min(static_cast<std::size_t>(k), this->n);
+        // fix rounding of the logarithm
+        while ((i > 0) && ((*this)[i - 1] >= x)) { --i; }
+        while ((i < this->n) && ((*this)[i] < x)) { ++i; }
+        return i;
+    }
+
+    /**
+     * @brief index of the first point with a value > x
+     */
+    std::size_t upper_bound(double x) const {
+        std::size_t i = this->lower_bound(x);
+        while ((i < this->n) && ((*this)[i] <= x)) { ++i; }
+        return i;
+    }
+
+    /**
+     * @brief weight of an interior point in the trapezoidal rule
+     *
+     * \f$(\lambda_{i+1} - \lambda_{i-1}) / 2 = \lambda_i \sinh(\delta)\f$
+     */
+    double interior_weight(std::size_t i) const {
+        return this->interior_weight_at((*this)[i]);
+    }
+
+    /**
+     * @brief weight of an interior point of value x in the trapezoidal rule
+     *
+     * \f$x \sinh(\delta)\f$, without evaluating an exponential
+     */
+    double interior_weight_at(double x) const { return x * this->sinh_step; }
+
+    /**
+     * @brief weight of point i in the trapezoidal rule over the grid
+     */
+    double trapz_weight(std::size_t i) const {
+        if (i == 0) { return 0.5 * ((*this)[1] - (*this)[0]); }
+        if (i == this->n - 1) { return 0.5 * ((*this)[i] - (*this)[i - 1]); }
+        return this->interior_weight(i);
+    }
+
+    /**
+     * @brief materialize the grid values
+     */
+    DMatrix values() const {
+        DMatrix v = DMatrix::from_shape({this->n});
+        this->values(0, this->n, v.data());
+        return v;
+    }
+
+    /**
+     * @brief values of the points [first, last) in out
+     *
+     * Consecutive values are a running product with `ratio`, restarted from
+     * an exact exponential every `exact_every` points to bound the rounding
+     * drift to a few ulp.
+     */
+    void values(std::size_t first, std::size_t last, double * out) const {
+        for (std::size_t i = first; i < last; i += exact_every) {
+            const std::size_t end = std::min(last, i + exact_every);
+            double v = (*this)[i];
+            for (std::size_t j = i; j < end; ++j) {
+                out[j - first] = v;
+                v *= this->ratio;
+            }
+        }
+    }
+
+    static constexpr std::size_t exact_every = 64;   ///< running product length
+};
+
+/**
+ * @ingroup GRIDS
+ * @brief Grid interface over an existing array of increasing values (no copy)
+ */
+struct ArrayGrid {
+    const double * x;  ///< values (not owned)
+    std::size_t n;     ///< number of points
+
+    /**
+     * @brief Construct a new Array Grid object
+     *
+     * @param x   values (increasing), must outlive the grid
+     * @param n   number of points
+     */
+    ArrayGrid(const double * x, std::size_t n) : x(x), n(n) {}
+    explicit ArrayGrid(const DMatrix& x) : x(x.data()), n(x.size()) {}
+
+    std::size_t size() const { return this->n; }
+    double operator[](std::size_t i) const { return this->x[i]; }
+    double front() const { return this->x[0]; }
+    double back() const { return this->x[this->n - 1]; }
+
+    /**
+     * @brief index of the first point with a value >= x
+     */
+    std::size_t lower_bound(double value) const {
+        return std::lower_bound(this->x, this->x + this->n, value) - this->x;
+    }
+
+    /**
+     * @brief index of the first point with a value > x
+     */
+    std::size_t upper_bound(double value) const {
+        return std::upper_bound(this->x, this->x + this->n, value) - this->x;
+    }
+
+    /**
+     * @brief weight of point i in the trapezoidal rule over the grid
+     */
+    double trapz_weight(std::size_t i) const {
+        return 0.5 * (this->x[std::min(i + 1, this->n - 1)] - this->x[std::max<std::size_t>(i, 1) - 1]);
+    }
+
+    /**
+     * @brief materialize the grid values
+     */
+    DMatrix values() const {
+        DMatrix v = DMatrix::from_shape({this->n});
+        std::copy(this->x, this->x + this->n, v.data());
+        return v;
+    }
+
+    /**
+     * @brief values of the points [first, last) in out
+     */
+    void values(std::size_t first, std::size_t last, double * out) const {
+        std::copy(this->x + first, this->x + last, out);
+    }
+};
+
+/**
+ * @ingroup GRIDS
+ * @brief Check whether an array is uniformly sampled
+ *
+ * @param x      values to check (increasing)
+ * @param grid   set to the corresponding descriptor if uniform
+ * @param rtol   tolerance relative to the step
+ * @return true if all the points are on the grid within rtol
+ */
+bool detect_uniform_grid(const DMatrix& x, UniformGrid& grid, double rtol = 1e-6){
+    const std::size_t n = x.size();
+    if (n < 2) { return false; }
+    const double step = (x[n - 1] - x[0]) / (n - 1);
+    if (!(step > 0)) { return false; }
+    for (std::size_t i = 1; i < n; ++i) {
+        if (std::abs(x[i] - (x[0] + i * step)) > rtol * step) { return false; }
+    }
+    grid = UniformGrid(x[0], step, n);
+    return true;
+}
+
+/**
+ * @ingroup GRIDS
+ * @brief Check whether an array is log-uniformly sampled
+ *
+ * @param x      values to check (increasing, positive)
+ * @param grid   set to the corresponding descriptor if log-uniform
+ * @param rtol   tolerance relative to the log step
+ * @return true if all the points are on the grid within rtol
+ */
+bool detect_log_uniform_grid(const DMatrix& x, LogUniformGrid& grid, double rtol = 1e-6){
+    const std::size_t n = x.size();
+    if ((n < 2) || !(x[0] > 0)) { return false; }
+    const double log_step = std::log(x[n - 1] / x[0]) / (n - 1);
+    if (!(log_step > 0)) { return false; }
+    for (std::size_t i = 1; i < n; ++i) {
+        if (std::abs(std::log(x[i] / x[0]) - i * log_step) > rtol * log_step) { return false; }
+    }
+    grid = LogUniformGrid(x[0], log_step, n);
+    return true;
+}
+
+} // namespace cphot
@@ -0,0 +1,98 @@
+/**
+ * @defgroup INTERP Interpolation
+ * @brief Linear interpolation kernels for sorted grids.
+ *
+ * Spectra and passbands are always defined on increasing wavelength arrays.
+ * `xt::interp` searches the segment of every output point independently. When
+ * both the output points and the definition points are sorted, walking the
+ * two arrays together finds all the segments in \f$O(N + M)\f$.
+ *
+ * Output points falling in the same definition segment are contiguous. They
+ * are evaluated in a simple affine loop that the compiler vectorizes (see
+ * `src/bench_interp.cpp` for a comparison with `xt::interp`).
+ *
+ * The semantics follow `xt::interp` (and `numpy.interp`):
+ * - `x < xp[0]` gives `left`,
+ * - `x > xp[-1]` gives `right`,
+ * - otherwise linear interpolation between the surrounding points.
+ */
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup INTERP
+ * @brief Linear interpolation of sorted points on a sorted definition.
+ *
+ * @param x       points to interpolate at (n, increasing)
+ * @param n       number of points
+ * @param xp      definition abscissa (np, increasing)
+ * @param fp      definition values (np)
+ * @param np      number of definition points
+ * @param out     output values (n)
+ * @param left    value for x < xp[0]
+ * @param right   value for x > xp[np - 1]
+ */
+void interp_sorted(const double * x, std::size_t n,
+                   const double * xp, const double * fp, std::size_t np,
+                   double * out, double left = 0., double right = 0.){
+    std::size_t i = 0;
+    if (np == 0) {
+        for (; i < n; ++i) { out[i] = left; }
+        return;
+    }
+    // before the definition
+    while ((i < n) && (x[i] < xp[0])) { out[i++] = left; }
+
+    // walk the segments [xp[j], xp[j + 1]) with the sorted points
+    for (std::size_t j = 0; (j + 1 < np) && (i < n); ++j) {
+        std::size_t end = i;
+        while ((end < n) && (x[end] < xp[j + 1])) { ++end; }
+        if (end == i) { continue; }
+        const double x0 = xp[j];
+        const double f0 = fp[j];
+        const double slope = (fp[j + 1] - f0) / (xp[j + 1] - x0);
+        #pragma omp simd
+        for (std::size_t k = i; k < end; ++k) {
+            out[k] = f0 + (x[k] - x0) * slope;
+        }
+        i = end;
+    }
+
+    // on the last definition point then beyond the definition
+    while ((i < n) && (x[i] == xp[np - 1])) { out[i++] = fp[np - 1]; }
+    for (; i < n; ++i) { out[i] = right; }
+}
+
+/**
+ * @ingroup INTERP
+ * @brief Linear interpolation of sorted points on a sorted definition.
+ *
+ * Drop-in replacement of `xt::interp(x, xp, fp, left, right)` when `x` is
+ * sorted.
+ *
+ * @param x       points to interpolate at (increasing)
+ * @param xp      definition abscissa (increasing)
+ * @param fp      definition values
+ * @param left    value for x < xp[0]
+ * @param right   value for x > xp[-1]
+ * @return DMatrix  interpolated values with the shape of x
+ * @throw std::runtime_error if xp and fp sizes differ
+ */
+DMatrix interp_sorted(const DMatrix& x, const DMatrix& xp, const DMatrix& fp,
+                      double left = 0., double right = 0.){
+    if (xp.size() != fp.size()) {
+        throw std::runtime_error("interp_sorted: xp and fp must have the same size");
+    }
+    DMatrix out = DMatrix::from_shape(x.shape());
+    interp_sorted(x.data(), x.size(), xp.data(), fp.data(), xp.size(),
+                  out.data(), left, right);
+    return out;
+}
+
+} // namespace cphot
@@ -142,6 +142,9 @@ namespace cphot {
             HDF5Library(const std::string & filename);
             std::vector<std::string> get_content();
             Filter load_filter(const std::string & filter_name);
+            std::vector<Filter> load_simplified_filters(
+                    double rel_tol,
+                    std::vector<SimplifyReport> & reports);
             std::vector<std::string> find (const std::string & name,
                                            bool case_sensitive=true);
             std::string get_source();
@@ -181,6 +184,30 @@ namespace cphot {
         return get_filter_from_hdf5_library(this->source, filter_name);
     }
 
+    /**
+     * @brief Load and simplify all the filters of the library
+     *
+     * Every filter is passed through `Filter::simplify`, which drops the
+     * transmission points that do not change the synthetic fluxes of the
+     * reference SEDs by more than the tolerance.
+     *
+     * @param rel_tol   maximum relative flux error per filter
+     * @param reports   set to the achieved error and point reduction of each
+     *                  filter (same order as the returned filters)
+     * @return simplified filters in the order of get_content()
+     */
+    std::vector<Filter> HDF5Library::load_simplified_filters(
+            double rel_tol, std::vector<SimplifyReport> & reports){
+        std::vector<Filter> filters;
+        reports.clear();
+        for (const auto & filter_name: this->get_content()) {
+            SimplifyReport report;
+            filters.push_back(this->load_filter(filter_name).simplify(rel_tol, report));
+            reports.push_back(report);
+        }
+        return filters;
+    }
+
     /**
      * @brief Look for filter names
      *
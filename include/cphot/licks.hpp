@@ -39,6 +39,7 @@
  */
 #include <cmath>
 #include <vector>
+#include <cphot/interpolation.hpp>
 #include <cphot/rquantities.hpp>
 #include <cphot/hardcoded_data/licks_data.hpp>
 
@@ -71,7 +72,7 @@ DMatrix reduce_resolution(const DMatrix& w, const DMatrix& flux, double fwhm0, d
 
     // Linear interpolation of lick_res over w
     // TODO: need to add extrapolation
-    DMatrix res = xt::interp(w, w_lick_res, lick_res);
+    DMatrix res = interp_sorted(w, w_lick_res, lick_res, lick_res[0], lick_res[lick_res.size() - 1]);
 
     // Compute width from fwhm
     double constant = 2. * std::sqrt(2. * std::log(2));     // constant that converts fwhm --> sigma
@@ -86,8 +87,8 @@ DMatrix reduce_resolution(const DMatrix& w, const DMatrix& flux, double fwhm0, d
         // sampling floor: min (0.2, sigma * 0.1)
         double delta = std::min(sigma_floor, sigma * 0.1);
         DMatrix delta_wj = xt::arange(-maxsigma, + maxsigma, delta);
-        auto wj = delta_wj + w[i];
-        auto fluxj = xt::interp(wj, w, flux, 0., 0.);
+        DMatrix wj = delta_wj + w[i];
+        DMatrix fluxj = interp_sorted(wj, w, flux, 0., 0.);
         flux_red[i] = xt::sum(fluxj * delta * xt::exp(-0.5 * xt::pow(delta_wj / sigma, 2)))();
     }
     flux_red /= lick_sigma * constant;
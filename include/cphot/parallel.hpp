@@ -0,0 +1,69 @@
+/**
+ * @file parallel.hpp
+ * @brief Minimal thread pool free parallel loop over independent items.
+ *
+ * Batched routines (many spectra, many models) are embarrassingly parallel.
+ * `parallel_for` splits an index range in contiguous chunks, one per worker
+ * `std::thread`, so that no OpenMP runtime is required.
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace cphot {
+
+/**
+ * @brief Number of worker threads to use
+ *
+ * @param n_threads  requested number of threads (0 for the hardware concurrency)
+ * @param n_items    number of items to process
+ * @return number of threads, at least 1 and at most n_items
+ */
+inline std::size_t get_n_threads(std::size_t n_threads, std::size_t n_items){
+    if (n_threads == 0) {
+        n_threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+    return std::max<std::size_t>(1, std::min(n_threads, n_items));
+}
+
+/**
+ * @brief Call func(i) for i in [0, n) over several threads
+ *
+ * The calls for different i must be independent. The first exception thrown
+ * by a worker is rethrown in the calling thread.
+ *
+ * @param n          number of items
+ * @param func       callable taking the item index
+ * @param n_threads  number of threads (0 for the hardware concurrency)
+ */
+template <typename Func>
+void parallel_for(std::size_t n, Func&& func, std::size_t n_threads = 0){
+    n_threads = get_n_threads(n_threads, n);
+    if (n_threads <= 1) {
+        for (std::size_t i = 0; i < n; ++i) { func(i); }
+        return;
+    }
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(n_threads);
+    const std::size_t chunk = (n + n_threads - 1) / n_threads;
+    for (std::size_t t = 0; t < n_threads; ++t) {
+        const std::size_t begin = t * chunk;
+        const std::size_t end = std::min(n, begin + chunk);
+        workers.emplace_back([&, t, begin, end](){
+            try {
+                for (std::size_t i = begin; i < end; ++i) { func(i); }
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+    for (auto& worker : workers) { worker.join(); }
+    for (auto& error : errors) {
+        if (error) { std::rethrow_exception(error); }
+    }
+}
+
+} // namespace cphot
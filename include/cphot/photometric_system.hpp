@@ -0,0 +1,331 @@
+/**
+ * @defgroup SYSTEM Photometric system
+ * @brief Magnitudes of a spectrum in a set of bands in a single pass.
+ *
+ * A catalog usually provides magnitudes in several bands, each in its own
+ * magnitude system (e.g. GALEX and SDSS in AB, Gaia in Vega). Calling
+ * `cphot::Filter::get_flux` per band searches and scans the spectrum once
+ * per band.
+ *
+ * A `PhotometricSystem` owns an ordered set of filters with their magnitude
+ * systems and zero points. It sorts the band supports once, so that
+ * `magnitudes` locates all of them in one walk over the spectrum and then
+ * integrates all the bands in a single sweep over the union of the supports:
+ * every spectrum point (and its trapezoid weight) is read once and
+ * accumulated in all the bands covering it, with the weights of
+ * `cphot::Filter::get_flux`.
+ *
+ * ```cpp
+ * cphot::PhotometricSystem system(filters, {cphot::MagSystem::AB, ...});
+ * cphot::DMatrix mags = system.magnitudes(wavelength, flux, nm, flam);
+ * ```
+ */
+#pragma once
+#include "filter.hpp"
+#include "rquantities.hpp"
+#include <helpers.hpp>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup SYSTEM
+ * @brief Magnitude systems
+ */
+enum class MagSystem { AB, Vega, ST };
+
+/**
+ * @ingroup SYSTEM
+ * @brief Parse a magnitude system name ("AB", "Vega" or "ST", case insensitive)
+ *
+ * @param name   name of the system
+ * @return MagSystem
+ * @throw std::runtime_error if the name is not recognized
+ */
+MagSystem parse_mag_system(const std::string& name){
+    std::string lower = tolower(name);
+    if (lower == "ab") { return MagSystem::AB; }
+    if (lower == "vega") { return MagSystem::Vega; }
+    if (lower == "st") { return MagSystem::ST; }
+    throw std::runtime_error("Unknown magnitude system: " + name);
+}
+
+/**
+ * @ingroup SYSTEM
+ * @brief Ordered set of filters with their magnitude systems.
+ */
+class PhotometricSystem {
+    private:
+        std::vector<Filter> filters;       ///< filters in order
+        std::vector<MagSystem> systems;    ///< magnitude system of each filter
+        std::vector<double> zero_mags;     ///< zero point magnitude of each filter
+        std::vector<std::size_t> order;    ///< filters sorted by support minimum
+
+        void initialize();
+
+    public:
+        PhotometricSystem(const std::vector<Filter>& filters,
+                          const std::vector<MagSystem>& systems);
+        PhotometricSystem(const std::vector<Filter>& filters,
+                          MagSystem system);
+
+        DMatrix get_flux(const DMatrix& wavelength,
+                         const DMatrix& flux,
+                         const QLength& wavelength_unit,
+                         const QSpectralFluxDensity& flux_unit) const;
+        DMatrix magnitudes(const DMatrix& wavelength,
+                           const DMatrix& flux,
+                           const QLength& wavelength_unit,
+                           const QSpectralFluxDensity& flux_unit) const;
+        DMatrix get_flux(const Spectrum& spectrum) const;
+        DMatrix magnitudes(const Spectrum& spectrum) const;
+
+        std::size_t size() const { return this->filters.size(); }
+        const std::vector<Filter>& get_filters() const { return this->filters; }
+        const std::vector<MagSystem>& get_systems() const { return this->systems; }
+        const std::vector<double>& get_zero_mags() const { return this->zero_mags; }
+        std::vector<std::string> get_names() const;
+};
+
+/**
+ * @brief Construct a new Photometric System object
+ *
+ * @param filters   filters in the order of the outputs
+ * @param systems   magnitude system of each filter
+ * @throw std::runtime_error if the sizes differ
+ */
+PhotometricSystem::PhotometricSystem(const std::vector<Filter>& filters,
+                                     const std::vector<MagSystem>& systems)
+    : filters(filters), systems(systems) {
+    if (filters.size() != systems.size()) {
+        throw std::runtime_error("PhotometricSystem: one magnitude system per filter is required");
+    }
+    this->initialize();
+}
+
+/**
+ * @brief Construct a new Photometric System object with a single system
+ *
+ * @param filters   filters in the order of the outputs
+ * @param system    magnitude system of all the filters
+ */
+PhotometricSystem::PhotometricSystem(const std::vector<Filter>& filters,
+                                     MagSystem system)
+    : filters(filters), systems(filters.size(), system) {
+    this->initialize();
+}
+
+/**
+ * @brief Collect the zero points and sort the band supports
+ */
+void PhotometricSystem::initialize(){
+    for (std::size_t m = 0; m < this->filters.size(); ++m) {
+        const ZeroPoints& zp = this->filters[m].get_zero_points();
+        switch (this->systems[m]) {
+            case MagSystem::AB: this->zero_mags.push_back(zp.AB_mag); break;
+            case MagSystem::Vega: this->zero_mags.push_back(zp.Vega_mag); break;
+            case MagSystem::ST: this->zero_mags.push_back(zp.ST_mag); break;
+        }
+    }
+    this->order.resize(this->filters.size());
+    std::iota(this->order.begin(), this->order.end(), 0);
+    std::sort(this->order.begin(), this->order.end(),
+              [&](std::size_t a, std::size_t b){
+                  return this->filters[a].get_wavelength()[0] < this->filters[b].get_wavelength()[0];
+              });
+}
+
+/**
+ * @brief Names of the filters in order
+ */
+std::vector<std::string> PhotometricSystem::get_names() const {
+    std::vector<std::string> names;
+    for (const auto& filter : this->filters) { names.push_back(filter.get_name()); }
+    return names;
+}
+
+/**
+ * @brief Fluxes of a spectrum through all the filters in a single sweep
+ *
+ * Identical to calling `Filter::get_flux` on every filter (without its
+ * transmission cache): the spectrum is searched once for all the band
+ * windows, then every point of the union of the windows is read once with
+ * its trapezoid weight and accumulated in all the bands covering it.
+ *
+ * @param wavelength        wavelength definition of the spectrum (increasing)
+ * @param flux              flux of the spectrum
+ * @param wavelength_unit   wavelength units
+ * @param flux_unit         flux units
+ * @return fluxes (n_filters) in flam
+ * @throw std::runtime_error if the flux does not match the wavelength
+ */
+DMatrix PhotometricSystem::get_flux(const DMatrix& wavelength,
+                                    const DMatrix& flux,
+                                    const QLength& wavelength_unit,
+                                    const QSpectralFluxDensity& flux_unit) const {
+    if (flux.size() != wavelength.size()) {
+        throw std::runtime_error("PhotometricSystem::get_flux: flux does not match the wavelength grid");
+    }
+    const std::size_t n_bands = this->filters.size();
+    const std::size_t n_spec = wavelength.size();
+    DMatrix result = xt::zeros<double>({n_bands});
+    if (n_spec < 2) { return result; }
+
+    const double conv = nm.to(wavelength_unit);
+    const double to_flam = flux_unit.to(flam);
+    const double * spec_wave = wavelength.data();
+    const double * spec_flux = flux.data();
+
+    // integration state of a band (see Filter::visit_weights)
+    struct Band {
+        std::size_t m;            // filter index
+        const double * wave;      // filter wavelength in nm
+        const double * trans;     // filter transmission
+        std::size_t n_filt;       // number of filter points
+        double photon;            // 1 for photon counters, 0 for energy
+        std::size_t start, end;   // spectrum window [start, end)
+        std::size_t j = 0;        // current filter segment
+        double a = 0., b = 0.;
+    };
+
+    // locate all the supports in one monotonic walk (bands sorted by minimum)
+    std::vector<Band> bands;
+    std::size_t cursor = 0;
+    for (std::size_t m : this->order) {
+        const Filter& filter = this->filters[m];
+        const DMatrix& fw = filter.get_wavelength();
+        Band band;
+        band.m = m;
+        band.wave = fw.data();
+        band.trans = filter.get_transmission().data();
+        band.n_filt = fw.size();
+        if (band.n_filt < 2) { continue; }
+        const double wmin = band.wave[0] * conv;
+        const double wmax = band.wave[band.n_filt - 1] * conv;
+        band.photon = filter.is_photon_type() ? 1. : 0.;
+        cursor = std::lower_bound(spec_wave + cursor, spec_wave + n_spec, wmin) - spec_wave;
+        band.start = cursor;
+        band.end = std::upper_bound(spec_wave + cursor, spec_wave + n_spec, wmax) - spec_wave;
+        if (band.end <= band.start) { continue; }
+        bands.push_back(band);
+    }
+    if (bands.empty()) { return result; }
+
+    // single sweep over the union of the supports, by blocks of points: the
+    // values, fluxes and trapezoid weights of a block are read once and
+    // accumulated in all the bands covering it
+    constexpr std::size_t block = 256;
+    double xb[block], fb[block], db[block];
+    std::size_t last = 0;
+    for (const auto& band : bands) { last = std::max(last, band.end); }
+    std::size_t next = 0;                 // next band to activate
+    std::vector<Band*> active;
+    for (std::size_t i0 = bands[0].start; i0 < last; i0 += block) {
+        if (active.empty()) { i0 = std::max(i0, bands[next].start); }
+        const std::size_t i1 = std::min(last, i0 + block);
+        while ((next < bands.size()) && (bands[next].start < i1)) {
+            active.push_back(&bands[next++]);
+        }
+        // the grid ends are their own neighbours (half trapezoids)
+        for (std::size_t i = i0; i < i1; ++i) {
+            xb[i - i0] = spec_wave[i];
+            fb[i - i0] = spec_flux[i];
+            db[i - i0] = 0.5 * (spec_wave[std::min(i + 1, n_spec - 1)] - spec_wave[(i > 0) ? i - 1 : 0]);
+        }
+        for (Band * band : active) {
+            std::size_t lo = std::max(i0, band->start);
+            const std::size_t hi = std::min(i1, band->end);
+            while (lo < hi) {
+                // points of the filter segment j: [x0, x1), [x0, x1] for the last one
+                while ((band->j + 2 < band->n_filt) && (band->wave[band->j + 1] * conv <= xb[lo - i0])) {
+                    ++band->j;
+                }
+                const std::size_t j = band->j;
+                const double x0 = band->wave[j] * conv;
+                const double x1 = band->wave[j + 1] * conv;
+                const std::size_t seg_end = (j + 2 == band->n_filt) ? hi :
+                    std::lower_bound(xb + (lo - i0), xb + (hi - i0), x1) - xb + i0;
+                const double t0 = band->trans[j];
+                const double slope = (x1 > x0) ? (band->trans[j + 1] - t0) / (x1 - x0) : 0.;
+                const double px = band->photon;
+                double a = 0., b = 0.;
+                #pragma omp simd reduction(+:a, b)
+                for (std::size_t k = lo - i0; k < seg_end - i0; ++k) {
+                    const double trans = t0 + (xb[k] - x0) * slope;
+                    const double w = trans * (px * xb[k] + (1. - px)) * db[k];
+                    a += w * fb[k];
+                    b += w;
+                }
+                band->a += a;
+                band->b += b;
+                lo = seg_end;
+            }
+        }
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [i1](const Band * band){ return band->end <= i1; }),
+                     active.end());
+    }
+
+    for (const auto& band : bands) {
+        if (band.b > 0) { result[band.m] = band.a / band.b * to_flam; }
+    }
+    return result;
+}
+
+/**
+ * @brief Magnitudes of a spectrum in all the filters
+ *
+ * \f$ mag = -2.5 \log_{10}(f) - zp \f$ with the flux in flam and the zero
+ * point of the magnitude system of each filter.
+ *
+ * @param wavelength        wavelength definition of the spectrum (increasing)
+ * @param flux              flux of the spectrum
+ * @param wavelength_unit   wavelength units
+ * @param flux_unit         flux units
+ * @return magnitudes (n_filters), NaN where the flux is not positive
+ */
+DMatrix PhotometricSystem::magnitudes(const DMatrix& wavelength,
+                                      const DMatrix& flux,
+                                      const QLength& wavelength_unit,
+                                      const QSpectralFluxDensity& flux_unit) const {
+    DMatrix fluxes = this->get_flux(wavelength, flux, wavelength_unit, flux_unit);
+    DMatrix mags = DMatrix::from_shape({this->filters.size()});
+    for (std::size_t m = 0; m < this->filters.size(); ++m) {
+        const double f = fluxes[m];
+        mags[m] = (f > 0) ? -2.5 * std::log10(f) - this->zero_mags[m]
+                          : std::nan("");
+    }
+    return mags;
+}
+
+/**
+ * @brief Integrated fluxes of a spectrum in all the bands
+ *
+ * @param spectrum   spectrum
+ * @return integrated fluxes in flam (size())
+ */
+DMatrix PhotometricSystem::get_flux(const Spectrum& spectrum) const {
+    return this->get_flux(spectrum.get_wavelength(), spectrum.get_flux(),
+                          spectrum.get_wavelength_unit(), spectrum.get_flux_unit());
+}
+
+/**
+ * @brief Magnitudes of a spectrum in all the bands
+ *
+ * @param spectrum   spectrum
+ * @return magnitudes (size()), NaN for non positive fluxes
+ */
+DMatrix PhotometricSystem::magnitudes(const Spectrum& spectrum) const {
+    return this->magnitudes(spectrum.get_wavelength(), spectrum.get_flux(),
+                            spectrum.get_wavelength_unit(), spectrum.get_flux_unit());
+}
+
+} // namespace cphot
@@ -0,0 +1,177 @@
+/**
+ * @defgroup PLAN Photometry plan
+ * @brief Batch photometry of many spectra through many filters.
+ *
+ * `cphot::Filter::get_flux` interpolates the transmission on the spectrum
+ * wavelength definition and integrates for every call. When a large set of
+ * spectra share the same wavelength definition (e.g. a grid of models), these
+ * steps only depend on the wavelength grid and the filters.
+ *
+ * A `PhotometryPlan` precomputes once the integration weights of each filter
+ * on a given wavelength grid, i.e. the interpolated transmission multiplied by
+ * \f$\lambda\f$ (photon counters) and the trapezoid weights, normalized by the
+ * filter integral. The flux of N spectra through M filters then reduces to a
+ * single matrix product
+ * \f[
+ *     F_{n, m} = \sum_{i} f_{n, i}\, W_{m, i},
+ * \f]
+ * evaluated with BLAS.
+ *
+ * ```cpp
+ * cphot::PhotometryPlan plan(wavelength, nm, filters);
+ * // flux: (n_spectra, n_wavelength) in flam
+ * cphot::DMatrix photometry = plan.get_flux(flux);  // (n_spectra, n_filters) in flam
+ * ```
+ */
+#pragma once
+#include "blas.hpp"
+#include "filter.hpp"
+#include "rquantities.hpp"
+#include "spectrum.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xarray.hpp>
+#include <xtensor/xmath.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup PLAN
+ * @brief Precomputed integration of a set of filters on a wavelength grid.
+ *
+ * The plan stores one row of integration weights per filter, such that the
+ * integrated flux of a spectrum is the dot product of its flux with the row.
+ * This is identical to `Filter::get_flux` on the same wavelength definition.
+ */
+class PhotometryPlan {
+    private:
+        DMatrix wavelength;                 ///< wavelength grid (n_wavelength)
+        QLength wavelength_unit;            ///< wavelength unit of the grid
+        DMatrix weights;                    ///< weights (n_filters, n_wavelength)
+        std::vector<std::string> names;     ///< filter names in order
+
+    public:
+        PhotometryPlan(const DMatrix& wavelength,
+                       const QLength& wavelength_unit,
+                       const std::vector<Filter>& filters);
+
+        DMatrix get_flux(const DMatrix& flux) const;
+        DMatrix get_flux(const SpectrumBatch& spectra) const;
+
+        const DMatrix& get_weights() const { return this->weights; }
+        const DMatrix& get_wavelength() const { return this->wavelength; }
+        QLength get_wavelength_unit() const { return this->wavelength_unit; }
+        const std::vector<std::string>& get_filter_names() const { return this->names; }
+        std::size_t n_filters() const { return this->names.size(); }
+        std::size_t n_wavelength() const { return this->wavelength.size(); }
+};
+
+/**
+ * @brief Construct a new Photometry Plan object
+ *
+ * The normalized weights of every filter on the wavelength grid
+ * (`Filter::get_weights`) are stored once as the rows of a dense matrix.
+ *
+ * @param wavelength       wavelength grid shared by all spectra (increasing)
+ * @param wavelength_unit  wavelength unit of the grid
+ * @param filters          filters to integrate
+ * @throw std::runtime_error if the wavelength grid has less than 2 points
+ */
+PhotometryPlan::PhotometryPlan(const DMatrix& wavelength,
+                               const QLength& wavelength_unit,
+                               const std::vector<Filter>& filters)
+    : wavelength(wavelength), wavelength_unit(wavelength_unit) {
+
+    const std::size_t n_wave = wavelength.size();
+    const std::size_t n_filters = filters.size();
+    if (n_wave < 2) {
+        throw std::runtime_error("PhotometryPlan requires at least 2 wavelength points");
+    }
+
+    this->weights = xt::zeros<double>({n_filters, n_wave});
+    double * w = this->weights.data();
+
+    // weights of Filter::get_flux on the grid, zero outside the filter window
+    for (std::size_t m = 0; m < n_filters; ++m) {
+        const Filter& filter = filters[m];
+        this->names.push_back(filter.get_name());
+        std::shared_ptr<const CachedWeights> band = filter.get_weights(wavelength, wavelength_unit);
+        std::copy(band->weights.begin(), band->weights.end(), w + m * n_wave + band->start);
+    }
+}
+
+/**
+ * @brief Integrate a block of spectra through all the filters
+ *
+ * The spectra must be defined on the wavelength grid of the plan. The
+ * integration is a single matrix product `flux * weights^T`.
+ *
+ * @param flux  spectra of shape (n_spectra, n_wavelength) or a single
+ *              spectrum of shape (n_wavelength)
+ * @return integrated fluxes of shape (n_spectra, n_filters) or (n_filters) in
+ *         the units of the input flux
+ * @throw std::runtime_error if the flux does not match the wavelength grid
+ */
+DMatrix PhotometryPlan::get_flux(const DMatrix& flux) const {
+    const std::size_t n_wave = this->n_wavelength();
+    const std::size_t n_filters = this->n_filters();
+
+    if ((flux.dimension() == 0) || (flux.dimension() > 2) ||
+        (flux.shape()[flux.dimension() - 1] != n_wave)) {
+        throw std::runtime_error("PhotometryPlan: flux must be of shape (n_spectra, "
+                                 + std::to_string(n_wave) + ")");
+    }
+    const std::size_t n_spectra = (flux.dimension() == 2) ? flux.shape()[0] : 1;
+
+    DMatrix result = xt::zeros<double>({n_spectra, n_filters});
+    if ((n_spectra > 0) && (n_filters > 0)) {
+        blas::gemm_abt(static_cast<int>(n_spectra),
+                       static_cast<int>(n_filters),
+                       static_cast<int>(n_wave),
+                       flux.data(), this->weights.data(), result.data());
+    }
+    if (flux.dimension() == 1) {
+        result.reshape({n_filters});
+    }
+    return result;
+}
+
+/**
+ * @brief Integrate a batch of spectra through all the filters
+ *
+ * The flux block of the batch is used in place. The batch must be defined on
+ * the wavelength grid of the plan (possibly in another wavelength unit).
+ *
+ * @param spectra  spectra on the wavelength grid of the plan
+ * @return integrated fluxes of shape (n_spectra, n_filters) in the flux unit
+ *         of the batch
+ * @throw std::runtime_error if the batch grid differs from the plan grid
+ */
+DMatrix PhotometryPlan::get_flux(const SpectrumBatch& spectra) const {
+    const std::size_t n_wave = this->n_wavelength();
+    const DMatrix& wavelength = spectra.get_wavelength();
+    bool same_grid = (wavelength.size() == n_wave);
+    if (same_grid) {
+        const double conv = spectra.get_wavelength_factor(this->wavelength_unit);
+        const double tol = 1e-12 * std::abs(this->wavelength[n_wave - 1]);
+        for (std::size_t i = 0; (i < n_wave) && same_grid; ++i) {
+            same_grid = (std::abs(wavelength[i] * conv - this->wavelength[i]) <= tol);
+        }
+    }
+    if (! same_grid) {
+        throw std::runtime_error("PhotometryPlan: spectra are not defined on the plan wavelength grid");
+    }
+    DMatrix result = this->get_flux(spectra.get_flux());
+    if (result.dimension() == 1) {
+        result.reshape({1, this->n_filters()});
+    }
+    return result;
+}
+
+}; // namespace cphot
@@ -0,0 +1,339 @@
+/**
+ * @defgroup QUADRATURE Filter quadrature rules
+ * @brief Gauss quadrature rules compiled from filter passbands.
+ *
+ * For a smooth SED \f$f(\lambda)\f$ known analytically (e.g. a blackbody), the
+ * flux through a filter
+ * \f[
+ *     \langle f \rangle = \frac{\int W(\lambda) f(\lambda) d\lambda}{\int W(\lambda) d\lambda},
+ *     \quad W(\lambda) = \lambda T(\lambda) \textrm{ (photon) or } T(\lambda) \textrm{ (energy)}
+ * \f]
+ * does not need to evaluate the SED on all the filter definition points. A
+ * Gauss rule for the weight function \f$W\f$ gives K nodes \f$\lambda_k\f$ and
+ * weights \f$w_k\f$ such that
+ * \f[
+ *     \langle f \rangle \simeq \sum_{k=1}^{K} w_k f(\lambda_k),
+ * \f]
+ * exact for polynomials of degree up to \f$2K - 1\f$. Smooth SEDs usually
+ * need K = 8-16 nodes.
+ *
+ * The rule is computed with the discretized Stieltjes procedure on the
+ * piecewise linear transmission (integrated exactly with Gauss-Legendre
+ * points on every segment), followed by the Golub-Welsch eigen decomposition
+ * of the Jacobi matrix (LAPACK `dstev`).
+ *
+ * ```cpp
+ * cphot::QuadratureRule rule = cphot::QuadratureRule::with_tolerance(filter, 1e-6);
+ * cphot::QuadratureRule fixed = cphot::QuadratureRule::with_nodes(filter, 8);
+ * double f = rule.integrate([&](double lam_nm){ return bb_flux_function(lam_nm, amp, teff); });
+ * ```
+ */
+#pragma once
+#include "blas.hpp"
+#include "filter.hpp"
+#include "rquantities.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cphot {
+
+/**
+ * @ingroup QUADRATURE
+ * @brief Gauss-Legendre nodes and weights on [-1, 1]
+ *
+ * @param n        number of points
+ * @param nodes    output nodes (size n)
+ * @param weights  output weights (size n)
+ */
+void gauss_legendre(std::size_t n,
+                    std::vector<double>& nodes,
+                    std::vector<double>& weights){
+    nodes.assign(n, 0.);
+    weights.assign(n, 0.);
+    const double pi = std::acos(-1.);
+    for (std::size_t i = 0; i < (n + 1) / 2; ++i) {
+        // Newton iterations on P_n starting from the Chebyshev estimate
+        double x = std::cos(pi * (i + 0.75) / (n + 0.5));
+        double dp = 0.;
+        for (int iter = 0; iter < 100; ++iter) {
+            double p0 = 1.;
+            double p1 = x;
+            for (std::size_t k = 2; k <= n; ++k) {
+                double p2 = ((2. * k - 1.) * x * p1 - (k - 1.) * p0) / k;
+                p0 = p1;
+                p1 = p2;
+            }
+            dp = n * (x * p1 - p0) / (x * x - 1.);
+            double dx = p1 / dp;
+            x -= dx;
+            if (std::abs(dx) < 1e-15) { break; }
+        }
+        // recompute the derivative at the converged node
+        double p0 = 1.;
+        double p1 = x;
+        for (std::size_t k = 2; k <= n; ++k) {
+            double p2 = ((2. * k - 1.) * x * p1 - (k - 1.) * p0) / k;
+            p0 = p1;
+            p1 = p2;
+        }
+        dp = n * (x * p1 - p0) / (x * x - 1.);
+        double w = 2. / ((1. - x * x) * dp * dp);
+        nodes[i] = -x;
+        nodes[n - 1 - i] = x;
+        weights[i] = w;
+        weights[n - 1 - i] = w;
+    }
+}
+
+/**
+ * @ingroup QUADRATURE
+ * @brief Gauss quadrature rule of a filter passband
+ *
+ * Nodes are wavelengths in nm and weights are normalized to sum to 1, so that
+ * `integrate` returns directly the flux through the filter in the units of the
+ * SED.
+ */
+class QuadratureRule {
+    private:
+        std::vector<double> nodes_nm;   ///< nodes in nm
+        std::vector<double> weights;    ///< normalized weights
+        double max_error = 0;           ///< max relative error on the test SEDs
+        std::string name;               ///< name of the filter
+
+        explicit QuadratureRule(const Filter& filter) : name(filter.get_name()) {}
+        void build(const Filter& filter, std::size_t n_nodes);
+        double test_error(const Filter& filter) const;
+
+    public:
+        static QuadratureRule with_nodes(const Filter& filter, std::size_t n_nodes);
+        static QuadratureRule with_tolerance(const Filter& filter, double rel_tol,
+                                             std::size_t max_nodes = 32);
+
+        /**
+         * @brief Integrate an SED through the filter
+         *
+         * @param sed   callable returning the flux at a wavelength in nm
+         * @return flux through the filter in the units of the SED
+         */
+        template <typename Func>
+        double integrate(Func&& sed) const {
+            double result = 0.;
+            for (std::size_t k = 0; k < this->nodes_nm.size(); ++k) {
+                result += this->weights[k] * sed(this->nodes_nm[k]);
+            }
+            return result;
+        }
+
+        std::size_t size() const { return this->nodes_nm.size(); }
+        const std::vector<double>& get_nodes() const { return this->nodes_nm; }
+        DMatrix get_nodes(const QLength& in) const;
+        const std::vector<double>& get_weights() const { return this->weights; }
+        double get_max_error() const { return this->max_error; }
+        const std::string& get_name() const { return this->name; }
+};
+
+/**
+ * @brief K-node Gauss rule for the filter
+ *
+ * @param filter    filter to compile
+ * @param n_nodes   number of nodes K
+ * @return QuadratureRule
+ * @throw std::runtime_error if the passband cannot support K nodes
+ */
+QuadratureRule QuadratureRule::with_nodes(const Filter& filter, std::size_t n_nodes){
+    QuadratureRule rule(filter);
+    rule.build(filter, n_nodes);
+    rule.max_error = rule.test_error(filter);
+    return rule;
+}
+
+/**
+ * @brief Smallest Gauss rule reaching a given accuracy
+ *
+ * The number of nodes is increased (2, 4, 6, ...) until the relative error on
+ * the test SEDs (blackbodies from 2000 K to 50000 K and power laws) is below
+ * the tolerance, or `max_nodes` is reached. The achieved error is available
+ * with `get_max_error`.
+ *
+ * @param filter      filter to compile
+ * @param rel_tol     requested relative accuracy
+ * @param max_nodes   maximum number of nodes
+ * @return QuadratureRule
+ */
+QuadratureRule QuadratureRule::with_tolerance(const Filter& filter, double rel_tol,
+                                              std::size_t max_nodes){
+    QuadratureRule rule(filter);
+    for (std::size_t k = 2; k <= max_nodes; k += 2) {
+        rule.build(filter, k);
+        rule.max_error = rule.test_error(filter);
+        if (rule.max_error <= rel_tol) { break; }
+    }
+    return rule;
+}
+
+/**
+ * @brief Compute nodes and weights with Stieltjes and Golub-Welsch
+ *
+ * @param filter    filter to compile
+ * @param n_nodes   number of nodes
+ */
+void QuadratureRule::build(const Filter& filter, std::size_t n_nodes){
+    const DMatrix& wave = filter.get_wavelength();
+    const DMatrix& trans = filter.get_transmission();
+    const std::size_t n_filt = wave.size();
+    if ((n_nodes == 0) || (n_filt < 2)) {
+        throw std::runtime_error("QuadratureRule: invalid number of nodes or filter definition");
+    }
+    const bool photon = filter.is_photon_type();
+
+    // discrete measure exact for polynomials of degree 2K - 1 times W
+    std::vector<double> gl_x, gl_w;
+    gauss_legendre(n_nodes + 2, gl_x, gl_w);
+    const double center = 0.5 * (wave[n_filt - 1] + wave[0]);
+    const double half = 0.5 * (wave[n_filt - 1] - wave[0]);
+    std::vector<double> t, m;
+    for (std::size_t j = 0; j + 1 < n_filt; ++j) {
+        const double x0 = wave[j];
+        const double x1 = wave[j + 1];
+        if (x1 <= x0) { continue; }
+        const double h = 0.5 * (x1 - x0);
+        for (std::size_t q = 0; q < gl_x.size(); ++q) {
+            const double x = x0 + h * (gl_x[q] + 1.);
+            const double tr = trans[j] + (x - x0) * (trans[j + 1] - trans[j]) / (x1 - x0);
+            const double w = (photon ? x * tr : tr) * h * gl_w[q];
+            if (w != 0) {
+                t.push_back((x - center) / half);
+                m.push_back(w);
+            }
+        }
+    }
+
+    // discretized Stieltjes procedure with normalized polynomials
+    std::vector<double> alpha(n_nodes, 0.), beta(n_nodes, 0.);
+    std::vector<double> p_prev(t.size(), 0.), p(t.size(), 1.), p_next(t.size());
+    double mu0 = 0.;
+    for (double w : m) { mu0 += w; }
+    if (!(mu0 > 0)) {
+        throw std::runtime_error("QuadratureRule: transmission must be positive");
+    }
+    double norm_prev = 1.;
+    double norm = mu0;
+    for (std::size_t k = 0; k < n_nodes; ++k) {
+        double xpp = 0.;
+        for (std::size_t i = 0; i < t.size(); ++i) { xpp += m[i] * t[i] * p[i] * p[i]; }
+        alpha[k] = xpp / norm;
+        beta[k] = (k == 0) ? mu0 : norm / norm_prev;
+        if (!(beta[k] > 0)) {
+            throw std::runtime_error("QuadratureRule: too many nodes for this passband");
+        }
+        // p_{k+1} = (t - alpha_k) p_k - beta_k p_{k-1}, rescaled by sqrt(norm)
+        const double scale = 1. / std::sqrt(norm);
+        double norm_next = 0.;
+        for (std::size_t i = 0; i < t.size(); ++i) {
+            p_next[i] = ((t[i] - alpha[k]) * p[i] - ((k == 0) ? 0. : beta[k] * p_prev[i])) * scale;
+            norm_next += m[i] * p_next[i] * p_next[i];
+        }
+        for (std::size_t i = 0; i < t.size(); ++i) {
+            p_prev[i] = p[i] * scale;
+            p[i] = p_next[i];
+        }
+        norm_prev = 1.;
+        norm = norm_next;
+    }
+
+    // Golub-Welsch: nodes are the eigenvalues of the Jacobi matrix,
+    // weights the squared first components of the eigenvectors
+    const int n = static_cast<int>(n_nodes);
+    std::vector<double> d(alpha);
+    std::vector<double> e(n_nodes, 0.);
+    for (std::size_t k = 1; k < n_nodes; ++k) { e[k - 1] = std::sqrt(beta[k]); }
+    std::vector<double> z(n_nodes * n_nodes, 0.);
+    std::vector<double> work(std::max(1, 2 * n - 2));
+    const char jobz = 'V';
+    int info = 0;
+    dstev_(&jobz, &n, d.data(), e.data(), z.data(), &n, work.data(), &info);
+    if (info != 0) {
+        throw std::runtime_error("QuadratureRule: eigen decomposition failed");
+    }
+    this->nodes_nm.resize(n_nodes);
+    this->weights.resize(n_nodes);
+    for (std::size_t k = 0; k < n_nodes; ++k) {
+        this->nodes_nm[k] = center + half * d[k];
+        this->weights[k] = z[k * n_nodes] * z[k * n_nodes];
+    }
+}
+
+/**
+ * @brief Maximum relative error of the rule on test SEDs
+ *
+ * The reference values are integrated with 16 Gauss-Legendre points on every
+ * segment of the filter definition, which is exact for the piecewise linear
+ * transmission up to the smoothness of the SED.
+ *
+ * @param filter  filter the rule was built from
+ * @return maximum relative error
+ */
+double QuadratureRule::test_error(const Filter& filter) const {
+    const DMatrix& wave = filter.get_wavelength();
+    const DMatrix& trans = filter.get_transmission();
+    const std::size_t n_filt = wave.size();
+    const bool photon = filter.is_photon_type();
+
+    // reference discretization of W(λ) dλ
+    std::vector<double> gl_x, gl_w;
+    gauss_legendre(16, gl_x, gl_w);
+    std::vector<double> x_ref, m_ref;
+    for (std::size_t j = 0; j + 1 < n_filt; ++j) {
+        const double x0 = wave[j];
+        const double x1 = wave[j + 1];
+        if (x1 <= x0) { continue; }
+        const double h = 0.5 * (x1 - x0);
+        for (std::size_t q = 0; q < gl_x.size(); ++q) {
+            const double x = x0 + h * (gl_x[q] + 1.);
+            const double tr = trans[j] + (x - x0) * (trans[j + 1] - trans[j]) / (x1 - x0);
+            x_ref.push_back(x);
+            m_ref.push_back((photon ? x * tr : tr) * h * gl_w[q]);
+        }
+    }
+
+    // hc/k in nm K
+    const double hc_k = 1.438776877e7;
+    const std::vector<double> temperatures {2000., 3000., 5000., 10000., 20000., 50000.};
+    const std::vector<double> powers {-4., -2., 0., 2.};
+
+    double error = 0.;
+    auto check = [&](auto&& sed){
+        double a = 0.;
+        double b = 0.;
+        for (std::size_t i = 0; i < x_ref.size(); ++i) {
+            a += m_ref[i] * sed(x_ref[i]);
+            b += m_ref[i];
+        }
+        const double ref = a / b;
+        if (ref != 0) { error = std::max(error, std::abs(this->integrate(sed) / ref - 1.)); }
+    };
+    for (double teff : temperatures) {
+        check([&](double lam){ return std::pow(lam, -5) / std::expm1(hc_k / (lam * teff)); });
+    }
+    for (double power : powers) {
+        check([&](double lam){ return std::pow(lam, power); });
+    }
+    return error;
+}
+
+/**
+ * @brief Get the nodes in requested units
+ *
+ * @param in  units to convert to
+ * @return nodes in requested units
+ */
+DMatrix QuadratureRule::get_nodes(const QLength& in) const {
+    std::vector<std::size_t> shape = { this->nodes_nm.size() };
+    DMatrix nodes = xt::adapt(this->nodes_nm, shape);
+    return nodes * nm.to(in);
+}
+
+} // namespace cphot
@@ -0,0 +1,292 @@
+/**
+ * @defgroup REBIN Rebinning
+ * @brief Flux conserving rebinning of spectra onto a new wavelength grid.
+ *
+ * Point interpolation (`interp_sorted`, `xt::interp`) samples the spectrum
+ * at the new wavelengths and does not conserve the integrated flux when the
+ * output grid is coarser than the input one. Rebinning instead treats every
+ * input sample as constant over its bin and averages it over the output bins
+ * by overlap:
+ *
+ * \f[
+ * f^{out}_j = \frac{1}{\Delta_j} \sum_i f^{in}_i \,
+ *             |[e_i, e_{i+1}] \cap [e'_j, e'_{j+1}]|
+ * \f]
+ *
+ * where \f$e\f$ and \f$e'\f$ are the bin edges of the input and output grids
+ * (midpoints between the wavelengths, see `bin_edges`) and \f$\Delta_j\f$ the
+ * width of the output bin. \f$\sum_j f^{out}_j \Delta_j\f$ equals the input
+ * integral over the covered range.
+ *
+ * The overlaps only depend on the two grids. A `RebinPlan` stores them once as
+ * one contiguous run of weights per output bin, so rebinning a spectrum is a
+ * short dot product per output bin. Batches of spectra are split over worker
+ * threads (`cphot::parallel_for`).
+ *
+ * ```cpp
+ * cphot::RebinPlan plan(library_wavelength, common_wavelength, angstrom);
+ * cphot::DMatrix rebinned = plan.rebin(library_flux);   // (n_spectra, n_out)
+ * ```
+ */
+#pragma once
+#include "parallel.hpp"
+#include "rquantities.hpp"
+#include "spectrum.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup REBIN
+ * @brief Bin edges of a wavelength grid
+ *
+ * The edges are the midpoints between consecutive wavelengths; the first and
+ * last bins are symmetric around their wavelength.
+ *
+ * @param x   wavelength (n >= 2, increasing)
+ * @param n   number of points
+ * @param edges  output edges (n + 1)
+ */
+void bin_edges(const double * x, std::size_t n, double * edges){
+    edges[0] = x[0] - 0.5 * (x[1] - x[0]);
+    for (std::size_t i = 1; i < n; ++i) {
+        edges[i] = 0.5 * (x[i - 1] + x[i]);
+    }
+    edges[n] = x[n - 1] + 0.5 * (x[n - 1] - x[n - 2]);
+}
+
+/**
+ * @ingroup REBIN
+ * @brief Bin edges of a wavelength grid
+ *
+ * @param x   wavelength (at least 2 points, increasing)
+ * @return edges (x.size() + 1)
+ * @throw std::runtime_error if x has less than 2 points
+ */
+DMatrix bin_edges(const DMatrix& x){
+    if (x.size() < 2) {
+        throw std::runtime_error("bin_edges requires at least 2 wavelength points");
+    }
+    DMatrix edges = DMatrix::from_shape({x.size() + 1});
+    bin_edges(x.data(), x.size(), edges.data());
+    return edges;
+}
+
+/**
+ * @ingroup REBIN
+ * @brief Precomputed flux conserving rebinning between two wavelength grids
+ */
+class RebinPlan {
+    private:
+        std::shared_ptr<const DMatrix> in_wavelength;    ///< input grid (n_in)
+        std::shared_ptr<const DMatrix> out_wavelength;   ///< output grid (n_out)
+        QLength wavelength_unit;                         ///< unit of both grids
+        double fill;                                     ///< value of bins not fully covered
+        std::vector<std::size_t> start;                  ///< first input index per output bin
+        std::vector<std::size_t> offset;                 ///< weights of bin j in [offset[j], offset[j + 1])
+        std::vector<double> weights;                     ///< overlap / output bin width
+        std::vector<bool> covered;                       ///< output bin inside the input range
+
+    public:
+        RebinPlan(const DMatrix& in_wavelength,
+                  const DMatrix& out_wavelength,
+                  const QLength& wavelength_unit,
+                  double fill = 0.);
+
+        template <typename T>
+        void rebin(const T * flux, T * out) const;
+        DMatrix rebin(const DMatrix& flux, std::size_t n_threads = 0) const;
+        template <typename T>
+        BasicSpectrumBatch<T> rebin(const BasicSpectrumBatch<T>& spectra,
+                                    std::size_t n_threads = 0) const;
+
+        const DMatrix& get_in_wavelength() const { return *(this->in_wavelength); }
+        const DMatrix& get_out_wavelength() const { return *(this->out_wavelength); }
+        QLength get_wavelength_unit() const { return this->wavelength_unit; }
+        std::size_t n_in() const { return this->in_wavelength->size(); }
+        std::size_t n_out() const { return this->out_wavelength->size(); }
+};
+
+/**
+ * @brief Construct a new Rebin Plan object
+ *
+ * Both grids are walked once together to collect the overlaps of every
+ * output bin with the input bins.
+ *
+ * @param in_wavelength    input wavelength grid (increasing)
+ * @param out_wavelength   output wavelength grid (increasing)
+ * @param wavelength_unit  unit of both grids
+ * @param fill             value of output bins not fully covered by the input grid
+ * @throw std::runtime_error if a grid has less than 2 points
+ */
+RebinPlan::RebinPlan(const DMatrix& in_wavelength,
+                     const DMatrix& out_wavelength,
+                     const QLength& wavelength_unit,
+                     double fill)
+    : in_wavelength(std::make_shared<const DMatrix>(in_wavelength)),
+      out_wavelength(std::make_shared<const DMatrix>(out_wavelength)),
+      wavelength_unit(wavelength_unit), fill(fill) {
+
+    const std::size_t n_in = in_wavelength.size();
+    const std::size_t n_out = out_wavelength.size();
+    if ((n_in < 2) || (n_out < 2)) {
+        throw std::runtime_error("RebinPlan requires at least 2 points in both grids");
+    }
+    const DMatrix in_edges = bin_edges(in_wavelength);
+    const DMatrix out_edges = bin_edges(out_wavelength);
+    // relative tolerance on the coverage test (grids converted between units)
+    const double tol = 1e-10 * (in_edges[n_in] - in_edges[0]);
+
+    this->start.resize(n_out, 0);
+    this->offset.resize(n_out + 1, 0);
+    this->covered.resize(n_out, false);
+
+    std::size_t i = 0;   // first input bin overlapping the current output bin
+    for (std::size_t j = 0; j < n_out; ++j) {
+        const double lo = out_edges[j];
+        const double hi = out_edges[j + 1];
+        const double width = hi - lo;
+        this->covered[j] = (lo >= in_edges[0] - tol) && (hi <= in_edges[n_in] + tol);
+        while ((i < n_in) && (in_edges[i + 1] <= lo)) { ++i; }
+        this->start[j] = i;
+        for (std::size_t k = i; (k < n_in) && (in_edges[k] < hi); ++k) {
+            const double overlap = std::min(hi, in_edges[k + 1]) - std::max(lo, in_edges[k]);
+            this->weights.push_back(std::max(overlap, 0.) / width);
+        }
+        this->offset[j + 1] = this->weights.size();
+    }
+}
+
+/**
+ * @brief Rebin one spectrum
+ *
+ * @tparam T     storage type of the flux (accumulation in double)
+ * @param flux   input flux on the input grid (n_in)
+ * @param out    rebinned flux on the output grid (n_out)
+ */
+template <typename T>
+void RebinPlan::rebin(const T * flux, T * out) const {
+    const double * w = this->weights.data();
+    for (std::size_t j = 0; j < this->n_out(); ++j) {
+        if (! this->covered[j]) {
+            out[j] = static_cast<T>(this->fill);
+            continue;
+        }
+        const T * f = flux + this->start[j];
+        const std::size_t begin = this->offset[j];
+        const std::size_t n = this->offset[j + 1] - begin;
+        double value = 0.;
+        #pragma omp simd reduction(+:value)
+        for (std::size_t k = 0; k < n; ++k) {
+            value += w[begin + k] * f[k];
+        }
+        out[j] = static_cast<T>(value);
+    }
+}
+
+/**
+ * @brief Rebin a block of spectra
+ *
+ * The spectra are distributed over worker threads.
+ *
+ * @param flux        spectra of shape (n_spectra, n_in) or a single
+ *                    spectrum of shape (n_in)
+ * @param n_threads   number of threads (0 for the hardware concurrency)
+ * @return rebinned spectra of shape (n_spectra, n_out) or (n_out)
+ * @throw std::runtime_error if the flux does not match the input grid
+ */
+DMatrix RebinPlan::rebin(const DMatrix& flux, std::size_t n_threads) const {
+    const std::size_t n_in = this->n_in();
+    const std::size_t n_out = this->n_out();
+    if ((flux.dimension() == 0) || (flux.dimension() > 2) ||
+        (flux.shape()[flux.dimension() - 1] != n_in)) {
+        throw std::runtime_error("RebinPlan: flux must be of shape (n_spectra, "
+                                 + std::to_string(n_in) + ")");
+    }
+    if (flux.dimension() == 1) {
+        DMatrix result = DMatrix::from_shape({n_out});
+        this->rebin(flux.data(), result.data());
+        return result;
+    }
+    const std::size_t n_spectra = flux.shape()[0];
+    DMatrix result = DMatrix::from_shape({n_spectra, n_out});
+    const double * in = flux.data();
+    double * out = result.data();
+    parallel_for(n_spectra, [&](std::size_t k){
+        this->rebin(in + k * n_in, out + k * n_out);
+    }, n_threads);
+    return result;
+}
+
+/**
+ * @brief Rebin a batch of spectra
+ *
+ * The batch must be defined on the input grid of the plan (possibly in
+ * another wavelength unit). The result shares the output grid of the plan
+ * and keeps the flux unit of the batch.
+ *
+ * @tparam T          storage type of the flux
+ * @param spectra     spectra on the input grid of the plan
+ * @param n_threads   number of threads (0 for the hardware concurrency)
+ * @return rebinned spectra
+ * @throw std::runtime_error if the batch grid differs from the input grid
+ */
+template <typename T>
+BasicSpectrumBatch<T> RebinPlan::rebin(const BasicSpectrumBatch<T>& spectra,
+                                       std::size_t n_threads) const {
+    const DMatrix& wavelength = spectra.get_wavelength();
+    const DMatrix& in_wave = *(this->in_wavelength);
+    const std::size_t n_in = this->n_in();
+    bool same_grid = (wavelength.size() == n_in);
+    if (same_grid) {
+        const double conv = spectra.get_wavelength_factor(this->wavelength_unit);
+        const double tol = 1e-12 * std::abs(in_wave[n_in - 1]);
+        for (std::size_t i = 0; (i < n_in) && same_grid; ++i) {
+            same_grid = (std::abs(wavelength[i] * conv - in_wave[i]) <= tol);
+        }
+    }
+    if (! same_grid) {
+        throw std::runtime_error("RebinPlan: spectra are not defined on the plan input grid");
+    }
+    using FluxMatrix = typename BasicSpectrumBatch<T>::FluxMatrix;
+    const std::size_t n_spectra = spectra.n_spectra();
+    const std::size_t n_out = this->n_out();
+    auto flux = std::make_shared<FluxMatrix>(FluxMatrix::from_shape({n_spectra, n_out}));
+    T * out = flux->data();
+    parallel_for(n_spectra, [&](std::size_t k){
+        this->rebin(spectra.row(k), out + k * n_out);
+    }, n_threads);
+    return BasicSpectrumBatch<T>(this->out_wavelength, flux, this->wavelength_unit,
+                                 spectra.get_flux_unit());
+}
+
+/**
+ * @ingroup REBIN
+ * @brief Flux conserving rebinning of spectra onto a new grid
+ *
+ * Convenience wrapper around `RebinPlan` for a single use of the grids.
+ *
+ * @param in_wavelength    input wavelength grid (increasing)
+ * @param flux             spectra of shape (n_spectra, n_in) or (n_in)
+ * @param out_wavelength   output wavelength grid, same unit (increasing)
+ * @param fill             value of output bins not fully covered by the input grid
+ * @param n_threads        number of threads (0 for the hardware concurrency)
+ * @return rebinned spectra of shape (n_spectra, n_out) or (n_out)
+ */
+DMatrix rebin(const DMatrix& in_wavelength, const DMatrix& flux,
+              const DMatrix& out_wavelength, double fill = 0.,
+              std::size_t n_threads = 0){
+    RebinPlan plan(in_wavelength, out_wavelength, 1. * nm, fill);
+    return plan.rebin(flux, n_threads);
+}
+
+} // namespace cphot
@@ -0,0 +1,359 @@
+/**
+ * @defgroup REDSHIFT Redshifted photometry
+ * @brief Synthetic photometry of spectra over a grid of redshifts and
+ *        k-corrections.
+ *
+ * Redshifting a rest-frame spectrum \f$f(\lambda)\f$ only rescales its
+ * wavelength axis: \f$f_z(\lambda) = f(\lambda / (1 + z)) / (1 + z)\f$. With
+ * \f$u = \lambda / (1 + z)\f$, the flux through a filter of weight \f$W\f$
+ * (\f$\lambda T\f$ for photon counters, \f$T\f$ for energy counters) reads
+ * \f[
+ *     \langle f_z \rangle = \frac{\int W((1+z) u) f(u) du}
+ *                                {(1 + z) \int W((1+z) u) du}.
+ * \f]
+ * On every filter segment, \f$W((1+z)u)\f$ is a polynomial of degree 1 or 2
+ * in \f$u\f$. The integrals therefore only need the moments
+ * \f$\int u^k f(u) du\f$ (k = 0, 1, 2) of the spectrum, which are precomputed
+ * once as cumulative integrals. Each (redshift, filter) pair then costs
+ * O(number of filter points) whatever the spectrum resolution.
+ *
+ * The spectrum is treated as piecewise linear and the integrals over the
+ * overlap of the spectrum and the filter are exact. The fluxes are in the
+ * units of the rest-frame flux density, without the distance dilution
+ * \f$1 / (4 \pi d_L^2)\f$.
+ *
+ * ```cpp
+ * cphot::DMatrix z = xt::linspace<double>(0., 2., 201);
+ * cphot::DMatrix flux_z = cphot::get_redshifted_flux(wave, flux, nm, flam, filters, z);  // (n_z, n_filters)
+ * cphot::DMatrix kcorr = cphot::get_kcorrections(wave, flux, nm, flam, system, z);       // (n_z, n_filters)
+ * ```
+ */
+#pragma once
+#include "filter.hpp"
+#include "parallel.hpp"
+#include "photometric_system.hpp"
+#include "rquantities.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup REDSHIFT
+ * @brief Cumulative moments \f$\int u^k f(u) du\f$ (k = 0, 1, 2) of a piecewise
+ *        linear spectrum.
+ *
+ * The moments are taken in the centered variable \f$v = u - u_{ref}\f$ to
+ * limit cancellations.
+ */
+class SpectrumMoments {
+    private:
+        std::vector<double> v;          ///< centered wavelength
+        std::vector<double> alpha;      ///< f = alpha + slope * v on [v_i, v_i+1]
+        std::vector<double> slope;
+        std::vector<double> cumul[3];   ///< cumulative moments at the nodes
+        double ref;                     ///< centering wavelength
+
+        void at(double x, std::size_t& cursor, double * out) const;
+
+    public:
+        SpectrumMoments(const double * wavelength, const double * flux, std::size_t n);
+
+        double get_ref() const { return this->ref; }
+        double get_min() const { return this->v.front() + this->ref; }
+        double get_max() const { return this->v.back() + this->ref; }
+        void moments(double a, double b, std::size_t& cursor, double * out) const;
+};
+
+/**
+ * @brief Construct the cumulative moments
+ *
+ * @param wavelength   wavelength definition (increasing, n)
+ * @param flux         flux values (n)
+ * @param n            number of points (>= 2)
+ * @throw std::runtime_error if less than 2 points
+ */
+SpectrumMoments::SpectrumMoments(const double * wavelength, const double * flux,
+                                 std::size_t n){
+    if (n < 2) {
+        throw std::runtime_error("SpectrumMoments requires at least 2 points");
+    }
+    this->ref = 0.5 * (wavelength[0] + wavelength[n - 1]);
+    this->v.resize(n);
+    for (std::size_t i = 0; i < n; ++i) { this->v[i] = wavelength[i] - this->ref; }
+    this->alpha.assign(n, 0.);
+    this->slope.assign(n, 0.);
+    for (auto& c : this->cumul) { c.assign(n, 0.); }
+    for (std::size_t i = 0; i + 1 < n; ++i) {
+        const double v0 = this->v[i];
+        const double v1 = this->v[i + 1];
+        const double s = (v1 > v0) ? (flux[i + 1] - flux[i]) / (v1 - v0) : 0.;
+        this->slope[i] = s;
+        this->alpha[i] = flux[i] - s * v0;
+        double p0 = v0, p1 = v1;   // powers v^(k + 1)
+        for (int k = 0; k < 3; ++k) {
+            const double q0 = p0 * v0;
+            const double q1 = p1 * v1;
+            this->cumul[k][i + 1] = this->cumul[k][i]
+                + this->alpha[i] * (p1 - p0) / (k + 1) + s * (q1 - q0) / (k + 2);
+            p0 = q0;
+            p1 = q1;
+        }
+    }
+}
+
+/**
+ * @brief Cumulative moments from the first point to x (clipped to the range)
+ *
+ * @param x        wavelength
+ * @param cursor   segment hint, updated (monotonic queries are O(1))
+ * @param out      cumulative moments (3)
+ */
+void SpectrumMoments::at(double x, std::size_t& cursor, double * out) const {
+    const std::size_t n = this->v.size();
+    const double vx = std::min(std::max(x - this->ref, this->v[0]), this->v[n - 1]);
+    // locate the segment [v_i, v_i+1] containing vx from the hint
+    std::size_t i = std::min(cursor, n - 2);
+    if (this->v[i] > vx) {
+        i = std::upper_bound(this->v.begin(), this->v.begin() + i, vx) - this->v.begin();
+        i = (i > 0) ? i - 1 : 0;
+    } else {
+        while ((i + 2 < n) && (this->v[i + 1] <= vx)) { ++i; }
+    }
+    cursor = i;
+    const double vi = this->v[i];
+    double p0 = vi, p1 = vx;
+    for (int k = 0; k < 3; ++k) {
+        const double q0 = p0 * vi;
+        const double q1 = p1 * vx;
+        out[k] = this->cumul[k][i]
+            + this->alpha[i] * (p1 - p0) / (k + 1) + this->slope[i] * (q1 - q0) / (k + 2);
+        p0 = q0;
+        p1 = q1;
+    }
+}
+
+/**
+ * @brief Moments \f$\int_a^b v^k f dv\f$ over the overlap of [a, b] with the
+ *        spectrum range (v = u - get_ref()).
+ *
+ * @param a        lower wavelength
+ * @param b        upper wavelength
+ * @param cursor   segment hint for a (queries with increasing a are O(1))
+ * @param out      moments (3)
+ */
+void SpectrumMoments::moments(double a, double b, std::size_t& cursor, double * out) const {
+    double lo[3], hi[3];
+    this->at(a, cursor, lo);
+    std::size_t cursor_b = cursor;
+    this->at(b, cursor_b, hi);
+    for (int k = 0; k < 3; ++k) { out[k] = hi[k] - lo[k]; }
+}
+
+/**
+ * @ingroup REDSHIFT
+ * @brief Fluxes of a spectrum through filters over a grid of redshifts
+ *
+ * @param moments      cumulative moments of the rest-frame spectrum (in nm)
+ * @param filters      filters
+ * @param redshifts    redshifts (n_z)
+ * @param out          output fluxes (n_z * n_filters, row-major)
+ */
+void get_redshifted_flux(const SpectrumMoments& moments,
+                         const std::vector<Filter>& filters,
+                         const DMatrix& redshifts,
+                         double * out){
+    const std::size_t n_filters = filters.size();
+    const double umin = moments.get_min();
+    const double umax = moments.get_max();
+    const double r = moments.get_ref();
+
+    for (std::size_t m = 0; m < n_filters; ++m) {
+        const DMatrix& wave = filters[m].get_wavelength();
+        const DMatrix& trans = filters[m].get_transmission();
+        const std::size_t n_filt = wave.size();
+        const bool photon = filters[m].is_photon_type();
+
+        for (std::size_t iz = 0; iz < redshifts.size(); ++iz) {
+            const double zp1 = 1. + redshifts[iz];
+            double num = 0.;
+            double den = 0.;
+            std::size_t cursor = 0;
+            for (std::size_t j = 0; j + 1 < n_filt; ++j) {
+                // segment in rest-frame wavelength, clipped to the spectrum
+                const double a = std::max(wave[j] / zp1, umin);
+                const double b = std::min(wave[j + 1] / zp1, umax);
+                if (b <= a) { continue; }
+                // T((1+z) u) = c0 + c1 u on the segment
+                const double c1 = (trans[j + 1] - trans[j]) / (wave[j + 1] - wave[j]) * zp1;
+                const double c0 = trans[j] - c1 * wave[j] / zp1;
+                // W as a polynomial of v = u - r
+                double w0, w1, w2;
+                if (photon) {
+                    w0 = zp1 * (c0 * r + c1 * r * r);
+                    w1 = zp1 * (c0 + 2. * c1 * r);
+                    w2 = zp1 * c1;
+                } else {
+                    w0 = c0 + c1 * r;
+                    w1 = c1;
+                    w2 = 0.;
+                }
+                double mom[3];
+                moments.moments(a, b, cursor, mom);
+                num += w0 * mom[0] + w1 * mom[1] + w2 * mom[2];
+                const double va = a - r;
+                const double vb = b - r;
+                den += w0 * (vb - va)
+                       + w1 * (vb * vb - va * va) / 2.
+                       + w2 * (vb * vb * vb - va * va * va) / 3.;
+            }
+            out[iz * n_filters + m] = (den > 0) ? num / (zp1 * den) : 0.;
+        }
+    }
+}
+
+/**
+ * @ingroup REDSHIFT
+ * @brief Fluxes of a rest-frame spectrum through filters over a grid of
+ *        redshifts
+ *
+ * @param wavelength        rest-frame wavelength (increasing)
+ * @param flux              rest-frame flux (n_wavelength) or a batch of
+ *                          spectra (n_spectra, n_wavelength)
+ * @param wavelength_unit   wavelength units
+ * @param flux_unit         flux units
+ * @param filters           filters
+ * @param redshifts         redshifts (n_z)
+ * @param n_threads         threads used across spectra (0 for all cores)
+ * @return fluxes in flam of shape (n_z, n_filters), or
+ *         (n_spectra, n_z, n_filters) for a batch of spectra
+ * @throw std::runtime_error if the flux does not match the wavelength
+ */
+DMatrix get_redshifted_flux(const DMatrix& wavelength,
+                            const DMatrix& flux,
+                            const QLength& wavelength_unit,
+                            const QSpectralFluxDensity& flux_unit,
+                            const std::vector<Filter>& filters,
+                            const DMatrix& redshifts,
+                            std::size_t n_threads = 0){
+    const std::size_t n_wave = wavelength.size();
+    if ((flux.dimension() == 0) || (flux.dimension() > 2) ||
+        (flux.shape()[flux.dimension() - 1] != n_wave)) {
+        throw std::runtime_error("get_redshifted_flux: flux must be of shape (n_spectra, "
+                                 + std::to_string(n_wave) + ")");
+    }
+    const std::size_t n_spectra = (flux.dimension() == 2) ? flux.shape()[0] : 1;
+    const std::size_t n_z = redshifts.size();
+    const std::size_t n_filters = filters.size();
+
+    const DMatrix wave_nm = wavelength * wavelength_unit.to(nm);
+    const double to_flam = flux_unit.to(flam);
+
+    DMatrix result = xt::zeros<double>({n_spectra, n_z, n_filters});
+    parallel_for(n_spectra, [&](std::size_t s){
+        std::vector<double> f(flux.data() + s * n_wave, flux.data() + (s + 1) * n_wave);
+        for (auto& value : f) { value *= to_flam; }
+        SpectrumMoments moments(wave_nm.data(), f.data(), n_wave);
+        get_redshifted_flux(moments, filters, redshifts,
+                            result.data() + s * n_z * n_filters);
+    }, n_threads);
+
+    if (flux.dimension() == 1) {
+        result.reshape({n_z, n_filters});
+    }
+    return result;
+}
+
+/**
+ * @ingroup REDSHIFT
+ * @brief K-correction tables of a rest-frame spectrum
+ *
+ * Following Hogg et al. (2002), an object at redshift z with absolute
+ * magnitude \f$M_Q\f$ in the rest-frame band Q is observed in band R with
+ * \f$m_R = M_Q + DM(z) + K_{QR}(z)\f$ and
+ * \f[
+ *     K_{QR}(z) = -2.5 \log_{10} \frac{\langle f_z \rangle_R}{\langle f \rangle_Q}
+ *                 - zp_R + zp_Q,
+ * \f]
+ * where the zero points zp follow the magnitude system of each band.
+ *
+ * @param wavelength        rest-frame wavelength (increasing)
+ * @param flux              rest-frame flux (n_wavelength) or a batch of
+ *                          spectra (n_spectra, n_wavelength)
+ * @param wavelength_unit   wavelength units
+ * @param flux_unit         flux units
+ * @param observed          observed bands R
+ * @param rest              rest-frame bands Q (same size as observed)
+ * @param redshifts         redshifts (n_z)
+ * @param n_threads         threads used across spectra (0 for all cores)
+ * @return k-corrections of shape (n_z, n_bands), or (n_spectra, n_z, n_bands)
+ * @throw std::runtime_error if the systems have different sizes
+ */
+DMatrix get_kcorrections(const DMatrix& wavelength,
+                         const DMatrix& flux,
+                         const QLength& wavelength_unit,
+                         const QSpectralFluxDensity& flux_unit,
+                         const PhotometricSystem& observed,
+                         const PhotometricSystem& rest,
+                         const DMatrix& redshifts,
+                         std::size_t n_threads = 0){
+    const std::size_t n_bands = observed.size();
+    if (rest.size() != n_bands) {
+        throw std::runtime_error("get_kcorrections: observed and rest systems must have the same size");
+    }
+    DMatrix flux_z = get_redshifted_flux(wavelength, flux, wavelength_unit, flux_unit,
+                                         observed.get_filters(), redshifts, n_threads);
+    DMatrix zero = {0.};
+    DMatrix flux_0 = get_redshifted_flux(wavelength, flux, wavelength_unit, flux_unit,
+                                         rest.get_filters(), zero, n_threads);
+
+    const std::vector<double>& zp_obs = observed.get_zero_mags();
+    const std::vector<double>& zp_rest = rest.get_zero_mags();
+    const std::size_t n_rows = flux_z.size() / n_bands;
+    const std::size_t n_z = redshifts.size();
+    DMatrix kcorr = DMatrix::from_shape(flux_z.shape());
+    for (std::size_t row = 0; row < n_rows; ++row) {
+        const double * ref = flux_0.data() + (row / n_z) * n_bands;
+        for (std::size_t m = 0; m < n_bands; ++m) {
+            const double f = flux_z.data()[row * n_bands + m];
+            kcorr.data()[row * n_bands + m] = ((f > 0) && (ref[m] > 0))
+                ? -2.5 * std::log10(f / ref[m]) - zp_obs[m] + zp_rest[m]
+                : std::nan("");
+        }
+    }
+    return kcorr;
+}
+
+/**
+ * @ingroup REDSHIFT
+ * @brief K-correction tables in the same bands (Q = R)
+ *
+ * The zero points cancel: \f$K(z) = -2.5 \log_{10}
+ * (\langle f_z \rangle / \langle f \rangle)\f$.
+ *
+ * @param wavelength        rest-frame wavelength (increasing)
+ * @param flux              rest-frame flux (n_wavelength) or (n_spectra, n_wavelength)
+ * @param wavelength_unit   wavelength units
+ * @param flux_unit         flux units
+ * @param system            bands
+ * @param redshifts         redshifts (n_z)
+ * @param n_threads         threads used across spectra (0 for all cores)
+ * @return k-corrections of shape (n_z, n_bands), or (n_spectra, n_z, n_bands)
+ */
+DMatrix get_kcorrections(const DMatrix& wavelength,
+                         const DMatrix& flux,
+                         const QLength& wavelength_unit,
+                         const QSpectralFluxDensity& flux_unit,
+                         const PhotometricSystem& system,
+                         const DMatrix& redshifts,
+                         std::size_t n_threads = 0){
+    return get_kcorrections(wavelength, flux, wavelength_unit, flux_unit,
+                            system, system, redshifts, n_threads);
+}
+
+} // namespace cphot
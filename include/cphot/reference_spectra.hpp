@@ -0,0 +1,96 @@
+/**
+ * @defgroup REFERENCES Reference spectra
+ * @brief Process-wide registry of the hardcoded reference spectra.
+ *
+ * The reference spectra (Vega, Sun) are hardcoded as `std::vector` in
+ * `cphot/hardcoded_data`. The registry converts them once to `DMatrix` in
+ * internal units (nm, flam) on first use and shares the resulting immutable
+ * arrays through `std::shared_ptr<const DMatrix>`. `cphot::Vega` and
+ * `cphot::Sun` objects are views on these arrays, so that creating them (e.g.
+ * once per `Filter`) does not copy the spectra anymore.
+ *
+ * Available names:
+ * - `vega`: Vega synthetic spectrum (Bohlin 2007)
+ * - `sun_theoretical`: Kurucz'93 model of the Sun at 1 au
+ * - `sun_observed`: CALSPEC observed solar spectrum at 1 au
+ */
+#pragma once
+#include "rquantities.hpp"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xadapt.hpp>
+#include <xtensor/xarray.hpp>
+#include <cphot/hardcoded_data/vega_data.hpp>
+#include <cphot/hardcoded_data/sun_data.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup REFERENCES
+ * @brief Immutable spectrum shared across the process.
+ */
+struct ReferenceSpectrum {
+    std::shared_ptr<const DMatrix> wavelength_nm;   ///< wavelength in nm
+    std::shared_ptr<const DMatrix> flux_flam;       ///< flux in flam
+};
+
+/**
+ * @ingroup REFERENCES
+ * @brief Make a reference spectrum from raw data
+ *
+ * @param wavelength       wavelength values
+ * @param flux             flux values
+ * @param wavelength_unit  wavelength unit
+ * @param flux_unit        flux unit
+ * @return ReferenceSpectrum in nm and flam
+ */
+ReferenceSpectrum make_reference_spectrum(const std::vector<double>& wavelength,
+                                          const std::vector<double>& flux,
+                                          const QLength& wavelength_unit,
+                                          const QSpectralFluxDensity& flux_unit){
+    std::vector<std::size_t> shape = { wavelength.size() };
+    auto wave = std::make_shared<DMatrix>(xt::adapt(wavelength, shape));
+    auto flux_ = std::make_shared<DMatrix>(xt::adapt(flux, shape));
+    double wconv = wavelength_unit.to(nm);
+    double fconv = flux_unit.to(flam);
+    if (wconv != 1.) { *wave *= wconv; }
+    if (fconv != 1.) { *flux_ *= fconv; }
+    return {wave, flux_};
+}
+
+/**
+ * @ingroup REFERENCES
+ * @brief Get a reference spectrum from the registry
+ *
+ * The spectrum is built on the first call (thread-safe) and shared afterwards.
+ *
+ * @param name  name of the reference (vega, sun_theoretical, sun_observed)
+ * @return const ReferenceSpectrum&  shared immutable spectrum
+ * @throw std::runtime_error if the name is unknown
+ */
+const ReferenceSpectrum& get_reference_spectrum(const std::string& name){
+    if (name.compare("vega") == 0) {
+        static const ReferenceSpectrum vega = make_reference_spectrum(
+            cphot_vega::wavelength_nm, cphot_vega::flux_flam, nm, flam);
+        return vega;
+    }
+    if (name.compare("sun_theoretical") == 0) {
+        static const ReferenceSpectrum sun = make_reference_spectrum(
+            cphot_sun_theoretical::wavelength, cphot_sun_theoretical::flux,
+            cphot_sun_theoretical::wavelength_unit, cphot_sun_theoretical::flux_unit);
+        return sun;
+    }
+    if (name.compare("sun_observed") == 0) {
+        static const ReferenceSpectrum sun = make_reference_spectrum(
+            cphot_sun_observed::wavelength, cphot_sun_observed::flux,
+            cphot_sun_observed::wavelength_unit, cphot_sun_observed::flux_unit);
+        return sun;
+    }
+    throw std::runtime_error("Unknown reference spectrum: " + name);
+}
+
+} // namespace cphot
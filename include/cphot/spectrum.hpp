@@ -0,0 +1,353 @@
+/**
+ * @defgroup SPECTRUM Spectrum
+ * @brief Spectra with units as metadata and shared wavelength grids.
+ *
+ * A `Spectrum` bundles a wavelength definition, a flux and their units. The
+ * arrays are held by `std::shared_ptr<const DMatrix>`, so copies, reference
+ * spectra (`Vega::get_spectrum`, `Sun::get_spectrum`) and batches share the
+ * same memory. Units are never applied to the data: consumers ask for a
+ * scalar conversion factor (`get_wavelength_factor`, `get_flux_factor`) and
+ * fold it in their own loops.
+ *
+ * A `SpectrumBatch` stores N spectra sharing one wavelength grid as a single
+ * (N, L) row-major flux block (structure of arrays: one wavelength array, one
+ * flux array). Batch APIs (`Filter::get_flux`, `PhotometryPlan::get_flux`)
+ * read the rows in place.
+ *
+ * Both containers are templated on the storage type of the flux
+ * (`BasicSpectrum<T>`, `BasicSpectrumBatch<T>`). `Spectrum` and
+ * `SpectrumBatch` store doubles; `FSpectrum` and `FSpectrumBatch` store
+ * floats, which halves the memory of large model grids. The wavelength is
+ * always stored in double so that grids, integration weights and cache keys
+ * are shared with the double path; kernels accumulate in double (see
+ * `docs/cphot_precision.md` for the accuracy).
+ *
+ * ```cpp
+ * cphot::Spectrum spectrum(wavelength, flux, angstrom, flam);
+ * QSpectralFluxDensity f = filter.get_flux(spectrum);
+ * cphot::SpectrumBatch batch(wavelength, fluxes, angstrom, flam);   // fluxes (N, L)
+ * cphot::DMatrix photometry = plan.get_flux(batch);
+ * ```
+ */
+#pragma once
+#include "rquantities.hpp"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup SPECTRUM
+ * @brief Single spectrum with units as metadata
+ *
+ * @tparam T  storage type of the flux (double or float)
+ */
+template <typename T>
+class BasicSpectrum {
+    public:
+        using value_type = T;
+        using FluxMatrix = xt::xarray<T, xt::layout_type::row_major>;
+
+    private:
+        std::shared_ptr<const DMatrix> wavelength;      ///< wavelength definition (L)
+        std::shared_ptr<const FluxMatrix> flux;         ///< flux (L)
+        QLength wavelength_unit;                     ///< unit of the wavelength
+        QSpectralFluxDensity flux_unit;              ///< unit of the flux
+
+    public:
+        BasicSpectrum(const DMatrix& wavelength,
+                      const FluxMatrix& flux,
+                      const QLength& wavelength_unit,
+                      const QSpectralFluxDensity& flux_unit);
+        BasicSpectrum(std::shared_ptr<const DMatrix> wavelength,
+                      std::shared_ptr<const FluxMatrix> flux,
+                      const QLength& wavelength_unit,
+                      const QSpectralFluxDensity& flux_unit);
+
+        std::size_t size() const { return this->wavelength->size(); }
+        const DMatrix& get_wavelength() const { return *(this->wavelength); }
+        const FluxMatrix& get_flux() const { return *(this->flux); }
+        DMatrix get_wavelength(const QLength& in) const;
+        DMatrix get_flux(const QSpectralFluxDensity& in) const;
+        QLength get_wavelength_unit() const { return this->wavelength_unit; }
+        QSpectralFluxDensity get_flux_unit() const { return this->flux_unit; }
+        double get_wavelength_factor(const QLength& in) const { return this->wavelength_unit.to(in); }
+        double get_flux_factor(const QSpectralFluxDensity& in) const { return this->flux_unit.to(in); }
+        const std::shared_ptr<const DMatrix>& get_shared_wavelength() const { return this->wavelength; }
+        const std::shared_ptr<const FluxMatrix>& get_shared_flux() const { return this->flux; }
+
+        BasicSpectrum<T> scaled(double factor) const;
+        template <typename U>
+        BasicSpectrum<U> astype() const;
+};
+
+using Spectrum = BasicSpectrum<double>;     ///< spectrum stored in double precision
+using FSpectrum = BasicSpectrum<float>;     ///< spectrum stored in single precision
+
+/**
+ * @brief Construct a new Spectrum object (one copy of the data)
+ *
+ * @param wavelength        wavelength definition (increasing)
+ * @param flux              flux values
+ * @param wavelength_unit   wavelength unit
+ * @param flux_unit         flux unit
+ * @throw std::runtime_error if the sizes differ
+ */
+template <typename T>
+BasicSpectrum<T>::BasicSpectrum(const DMatrix& wavelength,
+                                const FluxMatrix& flux,
+                                const QLength& wavelength_unit,
+                                const QSpectralFluxDensity& flux_unit)
+    : BasicSpectrum(std::make_shared<const DMatrix>(wavelength),
+                    std::make_shared<const FluxMatrix>(flux),
+                    wavelength_unit, flux_unit) {}
+
+/**
+ * @brief Construct a new Spectrum object sharing existing data
+ *
+ * @param wavelength        wavelength definition (increasing)
+ * @param flux              flux values
+ * @param wavelength_unit   wavelength unit
+ * @param flux_unit         flux unit
+ * @throw std::runtime_error if the sizes differ
+ */
+template <typename T>
+BasicSpectrum<T>::BasicSpectrum(std::shared_ptr<const DMatrix> wavelength,
+                                std::shared_ptr<const FluxMatrix> flux,
+                                const QLength& wavelength_unit,
+                                const QSpectralFluxDensity& flux_unit)
+    : wavelength(std::move(wavelength)), flux(std::move(flux)),
+      wavelength_unit(wavelength_unit), flux_unit(flux_unit) {
+    if (this->wavelength->size() != this->flux->size()) {
+        throw std::runtime_error("Spectrum: wavelength and flux must have the same size");
+    }
+}
+
+/**
+ * @brief Get the wavelength in requested units (new array)
+ *
+ * @param in  requested units
+ * @return wavelength in units of in
+ */
+template <typename T>
+DMatrix BasicSpectrum<T>::get_wavelength(const QLength& in) const {
+    return *(this->wavelength) * this->wavelength_unit.to(in);
+}
+
+/**
+ * @brief Get the flux in requested units (new double precision array)
+ *
+ * @param in  requested units
+ * @return flux in units of in
+ */
+template <typename T>
+DMatrix BasicSpectrum<T>::get_flux(const QSpectralFluxDensity& in) const {
+    const double factor = this->flux_unit.to(in);
+    DMatrix result = DMatrix::from_shape({this->size()});
+    const T * f = this->flux->data();
+    for (std::size_t i = 0; i < this->size(); ++i) { result[i] = f[i] * factor; }
+    return result;
+}
+
+/**
+ * @brief Same data with the flux scaled by a factor (no copy)
+ *
+ * @param factor   multiplicative factor applied to the flux unit
+ * @return Spectrum
+ */
+template <typename T>
+BasicSpectrum<T> BasicSpectrum<T>::scaled(double factor) const {
+    return BasicSpectrum<T>(this->wavelength, this->flux, this->wavelength_unit,
+                            factor * this->flux_unit);
+}
+
+/**
+ * @brief Same spectrum with another flux storage type (shared wavelength)
+ *
+ * @tparam U  new storage type of the flux
+ * @return BasicSpectrum<U>
+ */
+template <typename T>
+template <typename U>
+BasicSpectrum<U> BasicSpectrum<T>::astype() const {
+    using Target = typename BasicSpectrum<U>::FluxMatrix;
+    auto f = std::make_shared<Target>(Target::from_shape({this->size()}));
+    const T * in = this->flux->data();
+    for (std::size_t i = 0; i < this->size(); ++i) { (*f)[i] = static_cast<U>(in[i]); }
+    return BasicSpectrum<U>(this->wavelength, f, this->wavelength_unit, this->flux_unit);
+}
+
+/**
+ * @ingroup SPECTRUM
+ * @brief Set of spectra sharing one wavelength grid
+ *
+ * @tparam T  storage type of the flux (double or float)
+ */
+template <typename T>
+class BasicSpectrumBatch {
+    public:
+        using value_type = T;
+        using FluxMatrix = xt::xarray<T, xt::layout_type::row_major>;
+
+    private:
+        std::shared_ptr<const DMatrix> wavelength;      ///< shared wavelength grid (L)
+        std::shared_ptr<const FluxMatrix> flux;         ///< flux rows (N, L)
+        QLength wavelength_unit;                     ///< unit of the wavelength
+        QSpectralFluxDensity flux_unit;              ///< unit of the flux
+
+    public:
+        BasicSpectrumBatch(const DMatrix& wavelength,
+                           const FluxMatrix& flux,
+                           const QLength& wavelength_unit,
+                           const QSpectralFluxDensity& flux_unit);
+        BasicSpectrumBatch(std::shared_ptr<const DMatrix> wavelength,
+                           std::shared_ptr<const FluxMatrix> flux,
+                           const QLength& wavelength_unit,
+                           const QSpectralFluxDensity& flux_unit);
+        BasicSpectrumBatch(const std::vector<BasicSpectrum<T>>& spectra);
+
+        std::size_t n_spectra() const { return this->flux->size() / this->n_wavelength(); }
+        std::size_t n_wavelength() const { return this->wavelength->size(); }
+        const DMatrix& get_wavelength() const { return *(this->wavelength); }
+        const FluxMatrix& get_flux() const { return *(this->flux); }
+        const T * row(std::size_t i) const { return this->flux->data() + i * this->n_wavelength(); }
+        QLength get_wavelength_unit() const { return this->wavelength_unit; }
+        QSpectralFluxDensity get_flux_unit() const { return this->flux_unit; }
+        double get_wavelength_factor(const QLength& in) const { return this->wavelength_unit.to(in); }
+        double get_flux_factor(const QSpectralFluxDensity& in) const { return this->flux_unit.to(in); }
+        const std::shared_ptr<const DMatrix>& get_shared_wavelength() const { return this->wavelength; }
+
+        BasicSpectrum<T> get_spectrum(std::size_t i) const;
+        template <typename U>
+        BasicSpectrumBatch<U> astype() const;
+};
+
+using SpectrumBatch = BasicSpectrumBatch<double>;    ///< batch stored in double precision
+using FSpectrumBatch = BasicSpectrumBatch<float>;    ///< batch stored in single precision
+
+/**
+ * @brief Construct a new Spectrum Batch object (one copy of the data)
+ *
+ * @param wavelength        wavelength grid (L, increasing)
+ * @param flux              flux rows (N, L) or a single spectrum (L)
+ * @param wavelength_unit   wavelength unit
+ * @param flux_unit         flux unit
+ * @throw std::runtime_error if the flux does not match the grid
+ */
+template <typename T>
+BasicSpectrumBatch<T>::BasicSpectrumBatch(const DMatrix& wavelength,
+                                          const FluxMatrix& flux,
+                                          const QLength& wavelength_unit,
+                                          const QSpectralFluxDensity& flux_unit)
+    : BasicSpectrumBatch(std::make_shared<const DMatrix>(wavelength),
+                         std::make_shared<const FluxMatrix>(flux),
+                         wavelength_unit, flux_unit) {}
+
+/**
+ * @brief Construct a new Spectrum Batch object sharing existing data
+ *
+ * @param wavelength        wavelength grid (L, increasing)
+ * @param flux              flux rows (N, L) or a single spectrum (L)
+ * @param wavelength_unit   wavelength unit
+ * @param flux_unit         flux unit
+ * @throw std::runtime_error if the flux does not match the grid
+ */
+template <typename T>
+BasicSpectrumBatch<T>::BasicSpectrumBatch(std::shared_ptr<const DMatrix> wavelength,
+                                          std::shared_ptr<const FluxMatrix> flux,
+                                          const QLength& wavelength_unit,
+                                          const QSpectralFluxDensity& flux_unit)
+    : wavelength(std::move(wavelength)), flux(std::move(flux)),
+      wavelength_unit(wavelength_unit), flux_unit(flux_unit) {
+    const std::size_t n_wave = this->wavelength->size();
+    if ((n_wave == 0) || (this->flux->dimension() == 0) || (this->flux->dimension() > 2) ||
+        (this->flux->shape()[this->flux->dimension() - 1] != n_wave)) {
+        throw std::runtime_error("SpectrumBatch: flux must be of shape (n_spectra, "
+                                 + std::to_string(n_wave) + ")");
+    }
+}
+
+/**
+ * @brief Construct a new Spectrum Batch object from spectra on the same grid
+ *
+ * The flux rows are copied into a single block and converted to the flux
+ * unit of the first spectrum.
+ *
+ * @param spectra   spectra sharing the same wavelength grid
+ * @throw std::runtime_error if the spectra do not share the same grid
+ */
+template <typename T>
+BasicSpectrumBatch<T>::BasicSpectrumBatch(const std::vector<BasicSpectrum<T>>& spectra)
+    : wavelength_unit(1. * nm), flux_unit(1. * flam) {
+    if (spectra.empty()) {
+        throw std::runtime_error("SpectrumBatch: at least one spectrum is required");
+    }
+    const BasicSpectrum<T>& first = spectra[0];
+    const std::size_t n_wave = first.size();
+    this->wavelength = first.get_shared_wavelength();
+    this->wavelength_unit = first.get_wavelength_unit();
+    this->flux_unit = first.get_flux_unit();
+
+    auto block = std::make_shared<FluxMatrix>(FluxMatrix::from_shape({spectra.size(), n_wave}));
+    for (std::size_t i = 0; i < spectra.size(); ++i) {
+        const BasicSpectrum<T>& s = spectra[i];
+        bool same_grid = (s.get_shared_wavelength() == this->wavelength) &&
+                         (s.get_wavelength_factor(this->wavelength_unit) == 1.);
+        if (!same_grid && (s.size() == n_wave)) {
+            const double conv = s.get_wavelength_factor(this->wavelength_unit);
+            same_grid = true;
+            for (std::size_t j = 0; (j < n_wave) && same_grid; ++j) {
+                same_grid = (s.get_wavelength()[j] * conv == (*this->wavelength)[j]);
+            }
+        }
+        if (!same_grid) {
+            throw std::runtime_error("SpectrumBatch: spectra must share the same wavelength grid");
+        }
+        const double factor = s.get_flux_factor(this->flux_unit);
+        const FluxMatrix& f = s.get_flux();
+        T * row = block->data() + i * n_wave;
+        for (std::size_t j = 0; j < n_wave; ++j) { row[j] = static_cast<T>(f[j] * factor); }
+    }
+    this->flux = block;
+}
+
+/**
+ * @brief Get one spectrum of the batch (copy of the flux row, shared grid)
+ *
+ * @param i   index of the spectrum
+ * @return Spectrum
+ */
+template <typename T>
+BasicSpectrum<T> BasicSpectrumBatch<T>::get_spectrum(std::size_t i) const {
+    const std::size_t n_wave = this->n_wavelength();
+    if (i >= this->n_spectra()) {
+        throw std::runtime_error("SpectrumBatch: index out of range");
+    }
+    auto f = std::make_shared<FluxMatrix>(FluxMatrix::from_shape({n_wave}));
+    std::copy(this->row(i), this->row(i) + n_wave, f->data());
+    return BasicSpectrum<T>(this->wavelength, f, this->wavelength_unit, this->flux_unit);
+}
+
+/**
+ * @brief Same batch with another flux storage type (shared wavelength)
+ *
+ * @tparam U  new storage type of the flux
+ * @return BasicSpectrumBatch<U>
+ */
+template <typename T>
+template <typename U>
+BasicSpectrumBatch<U> BasicSpectrumBatch<T>::astype() const {
+    using Target = typename BasicSpectrumBatch<U>::FluxMatrix;
+    auto f = std::make_shared<Target>(Target::from_shape(this->flux->shape()));
+    const T * in = this->flux->data();
+    U * out = f->data();
+    for (std::size_t i = 0; i < this->flux->size(); ++i) { out[i] = static_cast<U>(in[i]); }
+    return BasicSpectrumBatch<U>(this->wavelength, f, this->wavelength_unit, this->flux_unit);
+}
+
+} // namespace cphot
@@ -27,7 +27,9 @@
 #include <string>
 #include <xtensor/xadapt.hpp>
 #include <xtensor/xarray.hpp>
-#include <cphot/hardcoded_data/sun_data.hpp>
+#include <memory>
+#include "reference_spectra.hpp"
+#include "spectrum.hpp"
 
 
 
@@ -39,11 +41,13 @@ using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
  * @ingroup SUN
  * @brief Class that handles the Sun's spectrum and references.
  *
+ * The spectra at 1 au are shared and immutable (see
+ * `cphot::get_reference_spectrum`), only the distance scaling is stored.
  */
 class Sun{
     private:
-        DMatrix wavelength_nm;       ///< Wavelength in nm
-        DMatrix flux_flam;           ///< flux in flam
+        std::shared_ptr<const DMatrix> wavelength_nm;   ///< Wavelength in nm
+        std::shared_ptr<const DMatrix> flux_flam;       ///< flux in flam at 1 au
         QLength distance;            ///< distance to the sun
         double distance_conversion;  ///< conversion factor for distance
 
@@ -51,10 +55,11 @@ class Sun{
         Sun(const QLength & distance=1 * au,
             const std::string & flavor="theoretical");
 
-        DMatrix get_wavelength();
-        DMatrix get_wavelength(const QLength& in);
-        DMatrix get_flux();
-        DMatrix get_flux(const QSpectralFluxDensity& in);
+        const DMatrix& get_wavelength() const;
+        DMatrix get_wavelength(const QLength& in) const;
+        DMatrix get_flux() const;
+        DMatrix get_flux(const QSpectralFluxDensity& in) const;
+        Spectrum get_spectrum() const;
 
 };
 
@@ -68,18 +73,13 @@ Sun::Sun(const QLength & distance,
          const std::string & flavor){
 
     this->distance = distance;
-    if (flavor.compare("theoretical") == 0){
-        // read the theoretical spectrum
-        this->wavelength_nm = xt::adapt(cphot_sun_theoretical::wavelength) * cphot_sun_theoretical::wavelength_unit.to(nm);
-        this->flux_flam = xt::adapt(cphot_sun_theoretical::flux) * cphot_sun_theoretical::flux_unit.to(flam);
-        // distance_conversion = (default distance / distance) ** 2
-        this->distance_conversion = std::pow((cphot_sun_theoretical::distance/distance).value, 2);
-    } else {
-        // read the theoretical spectrum
-        this->wavelength_nm = xt::adapt(cphot_sun_observed::wavelength) * cphot_sun_observed::wavelength_unit.to(nm);
-        this->flux_flam = xt::adapt(cphot_sun_observed::flux) * cphot_sun_observed::flux_unit.to(flam);
-        this->distance_conversion = std::pow((cphot_sun_theoretical::distance/distance).value, 2);
-    }
+    const ReferenceSpectrum& ref = (flavor.compare("theoretical") == 0) ?
+                                   get_reference_spectrum("sun_theoretical") :
+                                   get_reference_spectrum("sun_observed");
+    this->wavelength_nm = ref.wavelength_nm;
+    this->flux_flam = ref.flux_flam;
+    // distance_conversion = (default distance / distance) ** 2
+    this->distance_conversion = std::pow((cphot_sun_theoretical::distance/distance).value, 2);
 }
 
 /**
@@ -87,8 +87,8 @@ Sun::Sun(const QLength & distance,
  *
  * @return Sun wavelength in nm
  */
-DMatrix Sun::get_wavelength() {
-    return this->wavelength_nm;
+const DMatrix& Sun::get_wavelength() const {
+    return *(this->wavelength_nm);
 }
 
 /**
@@ -97,8 +97,8 @@ DMatrix Sun::get_wavelength() {
  * @param in  requested units for the wavelength
  * @return Sun wavelength units of in
  */
-DMatrix Sun::get_wavelength(const QLength& in) {
-    return this->wavelength_nm * nm.to(in);
+DMatrix Sun::get_wavelength(const QLength& in) const {
+    return *(this->wavelength_nm) * nm.to(in);
 }
 
 /**
@@ -106,8 +106,8 @@ DMatrix Sun::get_wavelength(const QLength& in) {
  *
  * @return Sun flux in flam
  */
-DMatrix Sun::get_flux() {
-    return this->flux_flam * this->distance_conversion;
+DMatrix Sun::get_flux() const {
+    return *(this->flux_flam) * this->distance_conversion;
 }
 
 /**
@@ -116,8 +116,20 @@ DMatrix Sun::get_flux() {
  * @param in  requested units for the flux
  * @return Sun flux units of in
  */
-DMatrix Sun::get_flux(const QSpectralFluxDensity& in) {
-    return this->flux_flam * flam.to(in) * this->distance_conversion;;
+DMatrix Sun::get_flux(const QSpectralFluxDensity& in) const {
+    return *(this->flux_flam) * (flam.to(in) * this->distance_conversion);
+}
+
+/**
+ * @brief Get the Sun spectrum at the object distance (shared data, no copy)
+ *
+ * The distance scaling is carried by the flux unit.
+ *
+ * @return Sun spectrum in nm and flam
+ */
+Spectrum Sun::get_spectrum() const {
+    return Spectrum(this->wavelength_nm, this->flux_flam, 1. * nm,
+                    this->distance_conversion * flam);
 }
 
 
@@ -0,0 +1,253 @@
+/**
+ * @defgroup TEMPLATES Template banks
+ * @brief Best-fit amplitudes and chi2 of many stars against many templates.
+ *
+ * Model comparison (blackbodies, white dwarf atmospheres, main sequence
+ * templates, ...) fits every star with every template SED \f$T_k\f$ scaled by
+ * a free amplitude. With \f$w_{ib} = 1/\sigma_{ib}^2\f$ (zero for missing
+ * bands) the amplitude is profiled out in closed form:
+ *
+ * \f[
+ * S_{ik} = \sum_b w_{ib} f_{ib} T_{kb}, \qquad
+ * Q_{ik} = \sum_b w_{ib} T_{kb}^2, \qquad
+ * a_{ik} = S_{ik} / Q_{ik}, \qquad
+ * \chi^2_{ik} = \sum_b w_{ib} f_{ib}^2 - S_{ik}^2 / Q_{ik},
+ * \f]
+ *
+ * so that \f$S\f$ and \f$Q\f$ are two matrix products of the whitened star
+ * matrices \f$(w f)\f$ and \f$w\f$ with the template fluxes \f$T\f$ and
+ * \f$T^2\f$ (`blas::gemm_abt`). A `TemplateBank` stores the band fluxes of
+ * the templates through a `PhotometricSystem` once; `match` processes the
+ * stars by blocks of star and template rows sized to stay in cache, keeps the
+ * `top_k` lowest chi2 per star, and splits the star blocks over worker
+ * threads. Amplitudes are constrained to be non negative. The blocks are
+ * small products: run a multithreaded BLAS with a single thread (e.g.
+ * `OPENBLAS_NUM_THREADS=1`) when using several workers.
+ *
+ * A band is missing for a star when its flux or uncertainty is not finite or
+ * its uncertainty is not positive.
+ *
+ * ```cpp
+ * cphot::TemplateBank bank(system, templates);            // SpectrumBatch
+ * std::vector<cphot::TemplateMatch> best = bank.match(flux, flux_error, 3);
+ * // best[i * 3 + j]: j-th best template of star i
+ * ```
+ */
+#pragma once
+#include "blas.hpp"
+#include "parallel.hpp"
+#include "photometric_system.hpp"
+#include "spectrum.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <xtensor/xarray.hpp>
+
+namespace cphot {
+
+using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
+
+/**
+ * @ingroup TEMPLATES
+ * @brief Fit of a star by one template
+ */
+struct TemplateMatch {
+    std::size_t index = 0;                                        ///< template index
+    double amp = std::numeric_limits<double>::quiet_NaN();        ///< best-fit amplitude
+    double chi2 = std::numeric_limits<double>::infinity();        ///< chi2 at the best amplitude
+};
+
+/**
+ * @ingroup TEMPLATES
+ * @brief Band fluxes of a set of templates and their chi2 against stars
+ */
+class TemplateBank {
+    private:
+        DMatrix flux;                   ///< template band fluxes in flam (n_templates, n_bands)
+        DMatrix flux2;                  ///< squared band fluxes (n_templates, n_bands)
+        std::vector<double> zero_mags;  ///< zero points of the bands
+
+        static constexpr std::size_t star_block = 64;        ///< stars per block
+        static constexpr std::size_t template_block = 256;   ///< templates per block
+
+        void initialize();
+
+    public:
+        TemplateBank(const PhotometricSystem& system, const SpectrumBatch& templates);
+        TemplateBank(const PhotometricSystem& system, const DMatrix& band_flux);
+
+        std::vector<TemplateMatch> match(const DMatrix& star_flux,
+                                         const DMatrix& star_flux_error,
+                                         std::size_t top_k = 1,
+                                         std::size_t n_threads = 0) const;
+        std::vector<TemplateMatch> match_magnitudes(const DMatrix& mags,
+                                                    const DMatrix& mag_errors,
+                                                    std::size_t top_k = 1,
+                                                    std::size_t n_threads = 0) const;
+
+        const DMatrix& get_flux() const { return this->flux; }
+        std::size_t n_templates() const { return this->flux.shape()[0]; }
+        std::size_t n_bands() const { return this->flux.shape()[1]; }
+};
+
+/**
+ * @brief Construct a new Template Bank object from template spectra
+ *
+ * @param system      bands of the stars
+ * @param templates   template SEDs
+ */
+TemplateBank::TemplateBank(const PhotometricSystem& system, const SpectrumBatch& templates)
+    : zero_mags(system.get_zero_mags()) {
+    const std::size_t n_templates = templates.n_spectra();
+    this->flux = DMatrix::from_shape({n_templates, system.size()});
+    for (std::size_t k = 0; k < n_templates; ++k) {
+        const DMatrix band_flux = system.get_flux(templates.get_spectrum(k));
+        std::copy(band_flux.begin(), band_flux.end(), this->flux.data() + k * system.size());
+    }
+    this->initialize();
+}
+
+/**
+ * @brief Construct a new Template Bank object from precomputed band fluxes
+ *
+ * @param system      bands of the stars
+ * @param band_flux   template band fluxes in flam (n_templates, system.size())
+ * @throw std::runtime_error if the shape does not match the system
+ */
+TemplateBank::TemplateBank(const PhotometricSystem& system, const DMatrix& band_flux)
+    : flux(band_flux), zero_mags(system.get_zero_mags()) {
+    if ((band_flux.dimension() != 2) || (band_flux.shape()[1] != system.size())) {
+        throw std::runtime_error("TemplateBank: band fluxes must be of shape (n_templates, "
+                                 + std::to_string(system.size()) + ")");
+    }
+    this->initialize();
+}
+
+/**
+ * @brief Squared template fluxes for the normalization products
+ */
+void TemplateBank::initialize(){
+    this->flux2 = DMatrix::from_shape(this->flux.shape());
+    for (std::size_t i = 0; i < this->flux.size(); ++i) {
+        this->flux2.data()[i] = this->flux.data()[i] * this->flux.data()[i];
+    }
+}
+
+/**
+ * @brief Best templates of every star
+ *
+ * @param star_flux         star band fluxes in flam (n_stars, n_bands)
+ * @param star_flux_error   uncertainties in flam (n_stars, n_bands)
+ * @param top_k             number of templates to keep per star
+ * @param n_threads         number of threads (0 for the hardware concurrency)
+ * @return matches (n_stars * top_k), sorted by increasing chi2 for each star.
+ *         Stars without valid bands get infinite chi2.
+ * @throw std::runtime_error if the shapes do not match the bands
+ */
+std::vector<TemplateMatch> TemplateBank::match(const DMatrix& star_flux,
+                                               const DMatrix& star_flux_error,
+                                               std::size_t top_k,
+                                               std::size_t n_threads) const {
+    const std::size_t nb = this->n_bands();
+    const std::size_t nt = this->n_templates();
+    if ((star_flux.dimension() != 2) || (star_flux.shape()[1] != nb) ||
+        (star_flux_error.shape() != star_flux.shape())) {
+        throw std::runtime_error("TemplateBank: star fluxes and errors must be of shape (n_stars, "
+                                 + std::to_string(nb) + ")");
+    }
+    const std::size_t n_stars = star_flux.shape()[0];
+    top_k = std::min(top_k, nt);
+    std::vector<TemplateMatch> result(n_stars * top_k);
+    if ((n_stars == 0) || (top_k == 0)) { return result; }
+
+    const std::size_t n_blocks = (n_stars + star_block - 1) / star_block;
+    parallel_for(n_blocks, [&](std::size_t block){
+        const std::size_t first = block * star_block;
+        const std::size_t ns = std::min(star_block, n_stars - first);
+
+        // whitened stars: wf = f / sigma^2 and w = 1 / sigma^2
+        std::vector<double> wf(ns * nb), w(ns * nb), ff(ns, 0.);
+        std::vector<std::size_t> n_valid(ns, 0);
+        for (std::size_t i = 0; i < ns; ++i) {
+            for (std::size_t b = 0; b < nb; ++b) {
+                const double f = star_flux(first + i, b);
+                const double s = star_flux_error(first + i, b);
+                const bool valid = std::isfinite(f) && std::isfinite(s) && (s > 0);
+                const double wb = valid ? 1. / (s * s) : 0.;
+                w[i * nb + b] = wb;
+                wf[i * nb + b] = valid ? wb * f : 0.;
+                ff[i] += valid ? wb * f * f : 0.;
+                n_valid[i] += valid;
+            }
+        }
+
+        std::vector<double> S(ns * template_block), Q(ns * template_block);
+        for (std::size_t t0 = 0; t0 < nt; t0 += template_block) {
+            const std::size_t nk = std::min(template_block, nt - t0);
+            blas::gemm_abt(static_cast<int>(ns), static_cast<int>(nk), static_cast<int>(nb),
+                           wf.data(), this->flux.data() + t0 * nb, S.data());
+            blas::gemm_abt(static_cast<int>(ns), static_cast<int>(nk), static_cast<int>(nb),
+                           w.data(), this->flux2.data() + t0 * nb, Q.data());
+            for (std::size_t i = 0; i < ns; ++i) {
+                if (n_valid[i] == 0) { continue; }
+                TemplateMatch * best = result.data() + (first + i) * top_k;
+                for (std::size_t k = 0; k < nk; ++k) {
+                    const double s = S[i * nk + k];
+                    const double q = Q[i * nk + k];
+                    const bool positive = (s > 0) && (q > 0);
+                    const double chi2 = positive ? std::max(ff[i] - s * s / q, 0.) : ff[i];
+                    if (!(chi2 < best[top_k - 1].chi2)) { continue; }
+                    // insert in the sorted top_k list
+                    std::size_t j = top_k - 1;
+                    while ((j > 0) && (chi2 < best[j - 1].chi2)) {
+                        best[j] = best[j - 1];
+                        --j;
+                    }
+                    best[j].index = t0 + k;
+                    best[j].amp = positive ? s / q : 0.;
+                    best[j].chi2 = chi2;
+                }
+            }
+        }
+    }, n_threads);
+    return result;
+}
+
+/**
+ * @brief Best templates of every star from magnitudes
+ *
+ * Magnitudes are in the systems of the `PhotometricSystem` of the bank;
+ * uncertainties are propagated to first order.
+ *
+ * @param mags         star magnitudes (n_stars, n_bands), NaN if missing
+ * @param mag_errors   uncertainties (n_stars, n_bands)
+ * @param top_k        number of templates to keep per star
+ * @param n_threads    number of threads (0 for the hardware concurrency)
+ * @return matches (n_stars * top_k), amplitudes relative to the templates in flam
+ */
+std::vector<TemplateMatch> TemplateBank::match_magnitudes(const DMatrix& mags,
+                                                          const DMatrix& mag_errors,
+                                                          std::size_t top_k,
+                                                          std::size_t n_threads) const {
+    const std::size_t nb = this->n_bands();
+    if ((mags.dimension() != 2) || (mags.shape()[1] != nb) || (mag_errors.shape() != mags.shape())) {
+        throw std::runtime_error("TemplateBank: magnitudes and errors must be of shape (n_stars, "
+                                 + std::to_string(nb) + ")");
+    }
+    const double alpha = 0.4 * std::log(10.);
+    DMatrix flux = DMatrix::from_shape(mags.shape());
+    DMatrix flux_error = DMatrix::from_shape(mags.shape());
+    for (std::size_t i = 0; i < mags.shape()[0]; ++i) {
+        for (std::size_t b = 0; b < nb; ++b) {
+            const double f = std::exp(-alpha * (mags(i, b) + this->zero_mags[b]));
+            flux(i, b) = f;
+            flux_error(i, b) = alpha * f * mag_errors(i, b);
+        }
+    }
+    return this->match(flux, flux_error, top_k, n_threads);
+}
+
+} // namespace cphot
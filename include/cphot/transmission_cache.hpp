@@ -0,0 +1,260 @@
+/**
+ * @defgroup CACHE Transmission cache
+ * @brief LRU cache of filter integration weights per spectrum wavelength grid.
+ *
+ * Production runs integrate millions of spectra that share a handful of
+ * wavelength grids (e.g. model atmosphere grids). For a given grid, the
+ * interpolated transmission and the trapezoid weights of a filter do not
+ * depend on the flux. A `TransmissionCache` stores these normalized weights
+ * per grid, so that `cphot::Filter::get_flux` reduces to a dot product on
+ * repeated grids.
+ *
+ * Grids are looked up by a `GridFingerprint`: size, end points, wavelength
+ * unit and a hash of at most 64 values sampled with a constant stride, so
+ * that a lookup costs O(1) whatever the size of the grid. Each entry also
+ * keeps the grid values its weights depend on (the filter window and its
+ * neighbours). They are compared on a hit, outside the lock, so that a
+ * fingerprint collision recomputes the weights instead of returning those of
+ * another grid.
+ *
+ * The cache is bounded (least recently used entries are evicted), thread
+ * safe, and counts hits, misses and evictions for tuning.
+ *
+ * ```cpp
+ * filter.set_transmission_cache_size(16);   // 0 disables the cache
+ * filter.get_flux(wavelength, flux, nm, flam);
+ * cphot::TransmissionCacheStats stats = filter.get_transmission_cache_stats();
+ * ```
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cphot {
+
+/**
+ * @ingroup CACHE
+ * @brief Cheap identifier of a wavelength grid
+ */
+struct GridFingerprint {
+    std::size_t size = 0;      ///< number of points
+    double first = 0;          ///< first value
+    double last = 0;           ///< last value
+    double unit = 0;           ///< conversion factor of the grid unit to nm
+    std::uint64_t hash = 0;    ///< hash of sampled values
+
+    bool operator==(const GridFingerprint& other) const {
+        return (this->size == other.size) && (this->first == other.first)
+            && (this->last == other.last) && (this->unit == other.unit)
+            && (this->hash == other.hash);
+    }
+};
+
+/**
+ * @ingroup CACHE
+ * @brief Fingerprint of a wavelength grid
+ *
+ * The hash covers at most 64 values, sampled with a constant stride (and the
+ * last value): it is cheap for large grids, and collisions are caught by
+ * `TransmissionCache::get`.
+ *
+ * @param x       grid values (n)
+ * @param n       number of points
+ * @param unit    conversion factor of the grid unit to nm
+ * @return GridFingerprint
+ */
+GridFingerprint make_grid_fingerprint(const double * x, std::size_t n, double unit){
+    GridFingerprint fp;
+    fp.size = n;
+    fp.unit = unit;
+    if (n == 0) { return fp; }
+    fp.first = x[0];
+    fp.last = x[n - 1];
+    // FNV-1a over the bit patterns of the sampled values
+    constexpr std::size_t n_samples = 64;
+    const std::size_t stride = std::max<std::size_t>(1, n / n_samples);
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < n; i += stride) {
+        std::uint64_t bits;
+        std::memcpy(&bits, x + i, sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ULL;
+    }
+    fp.hash = hash;
+    return fp;
+}
+
+/**
+ * @ingroup CACHE
+ * @brief Normalized integration weights of a filter on a given grid
+ *
+ * The integrated flux is \f$\sum_i w_i f_{start + i}\f$; empty weights mean
+ * no overlap (null flux).
+ */
+struct CachedWeights {
+    std::size_t start = 0;          ///< first grid index of the weights
+    std::vector<double> weights;    ///< normalized weights
+    std::size_t window_start = 0;   ///< first grid index of window (set by the cache)
+    std::vector<double> window;     ///< grid values the weights depend on (set by the cache)
+};
+
+/**
+ * @ingroup CACHE
+ * @brief Usage counters of a transmission cache
+ */
+struct TransmissionCacheStats {
+    std::size_t hits = 0;         ///< lookups served from the cache
+    std::size_t misses = 0;       ///< lookups that computed new weights
+    std::size_t evictions = 0;    ///< entries dropped to respect the capacity
+    std::size_t size = 0;         ///< current number of entries
+    std::size_t capacity = 0;     ///< maximum number of entries
+};
+
+/**
+ * @ingroup CACHE
+ * @brief Thread safe LRU cache of integration weights keyed by grid fingerprint
+ */
+class TransmissionCache {
+    private:
+        struct FingerprintHash {
+            std::size_t operator()(const GridFingerprint& fp) const {
+                return static_cast<std::size_t>(fp.hash ^ (fp.size * 0x9e3779b97f4a7c15ULL));
+            }
+        };
+        using Entry = std::pair<GridFingerprint, std::shared_ptr<const CachedWeights>>;
+
+        mutable std::mutex mutex;
+        std::list<Entry> entries;    ///< most recently used first
+        std::unordered_map<GridFingerprint, std::list<Entry>::iterator, FingerprintHash> index;
+        std::atomic<std::size_t> capacity {0};
+        std::atomic<std::size_t> hits {0};
+        std::atomic<std::size_t> misses {0};
+        std::size_t evictions = 0;
+
+        void evict();
+
+    public:
+        TransmissionCache(std::size_t capacity = 0) : capacity(capacity) {}
+
+        /**
+         * @brief Get the weights of a grid, computing them on a miss
+         *
+         * An entry is only returned if its window equals the values of `x`
+         * on [window_start, window_end), compared outside the lock; a
+         * fingerprint collision counts as a miss and replaces the entry.
+         *
+         * @param key            fingerprint of the grid
+         * @param x              grid values (key.size)
+         * @param window_start   first grid index the weights depend on
+         * @param window_end     end of the grid indices the weights depend on
+         * @param compute        callable returning CachedWeights, called outside the lock
+         * @return shared weights
+         */
+        template <typename Func>
+        std::shared_ptr<const CachedWeights> get(const GridFingerprint& key, const double * x,
+                                                 std::size_t window_start, std::size_t window_end,
+                                                 Func&& compute){
+            std::shared_ptr<const CachedWeights> found;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                auto it = this->index.find(key);
+                if (it != this->index.end()) {
+                    this->entries.splice(this->entries.begin(), this->entries, it->second);
+                    found = it->second->second;
+                }
+            }
+            const std::size_t n_window = window_end - window_start;
+            if (found && (found->window_start == window_start) && (found->window.size() == n_window)
+                && (std::memcmp(found->window.data(), x + window_start, n_window * sizeof(double)) == 0)) {
+                ++this->hits;
+                return found;
+            }
+            ++this->misses;
+            CachedWeights computed = compute();
+            computed.window_start = window_start;
+            computed.window.assign(x + window_start, x + window_end);
+            auto value = std::make_shared<const CachedWeights>(std::move(computed));
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->capacity.load() > 0) {
+                auto it = this->index.find(key);
+                if (it != this->index.end()) {
+                    this->entries.erase(it->second);
+                    this->index.erase(it);
+                }
+                this->entries.emplace_front(key, value);
+                this->index[key] = this->entries.begin();
+                this->evict();
+            }
+            return value;
+        }
+
+        void set_capacity(std::size_t capacity);
+        std::size_t get_capacity() const;
+        TransmissionCacheStats get_stats() const;
+        void clear();
+};
+
+/**
+ * @brief Drop the least recently used entries above the capacity
+ */
+void TransmissionCache::evict(){
+    while (this->entries.size() > this->capacity.load()) {
+        this->index.erase(this->entries.back().first);
+        this->entries.pop_back();
+        ++this->evictions;
+    }
+}
+
+/**
+ * @brief Set the maximum number of grids (0 disables the cache)
+ *
+ * @param capacity   maximum number of entries
+ */
+void TransmissionCache::set_capacity(std::size_t capacity){
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->capacity = capacity;
+    this->evict();
+}
+
+/**
+ * @brief Maximum number of grids
+ */
+std::size_t TransmissionCache::get_capacity() const {
+    return this->capacity.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Usage counters
+ */
+TransmissionCacheStats TransmissionCache::get_stats() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    TransmissionCacheStats s;
+    s.hits = this->hits.load();
+    s.misses = this->misses.load();
+    s.evictions = this->evictions;
+    s.size = this->entries.size();
+    s.capacity = this->capacity.load();
+    return s;
+}
+
+/**
+ * @brief Drop all the entries and reset the counters
+ */
+void TransmissionCache::clear(){
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->entries.clear();
+    this->index.clear();
+    this->hits = 0;
+    this->misses = 0;
+    this->evictions = 0;
+}
+
+} // namespace cphot
@@ -14,7 +14,9 @@
 #include "votable.hpp"
 #include <xtensor/xadapt.hpp>
 #include <xtensor/xarray.hpp>
-#include <cphot/hardcoded_data/vega_data.hpp>
+#include <memory>
+#include "reference_spectra.hpp"
+#include "spectrum.hpp"
 
 namespace cphot {
 
@@ -27,6 +29,9 @@ using DMatrix = xt::xarray<double, xt::layout_type::row_major>;
  * find the Vega synthetic spectrum (Bohlin 2007) in order to compute fluxes and
  * magnitudes in given filters
  *
+ * The data are shared and immutable: copies of a Vega object (and all default
+ * constructed objects) point to the same arrays.
+ *
  * @ingroup VEGA
  **/
 class Vega {
@@ -41,26 +46,29 @@ class Vega {
              const QSpectralFluxDensity& flux_unit);
         Vega();
 
-        DMatrix get_wavelength();
-        DMatrix get_wavelength(const QLength& in);
-        DMatrix get_flux();
-        DMatrix get_flux(const QSpectralFluxDensity& in);
+        const DMatrix& get_wavelength() const;
+        DMatrix get_wavelength(const QLength& in) const;
+        const DMatrix& get_flux() const;
+        DMatrix get_flux(const QSpectralFluxDensity& in) const;
+        Spectrum get_spectrum() const;
 
     private:
-        DMatrix wavelength_nm;    ///< Wavelength in nm
-        DMatrix flux_flam;        ///< flux in flam
+        std::shared_ptr<const DMatrix> wavelength_nm;    ///< Wavelength in nm
+        std::shared_ptr<const DMatrix> flux_flam;        ///< flux in flam
 
 };
 
 /**
  * @brief Construct a new Vega object from hardcoded data
+ *
+ * The object shares the reference spectrum of the registry (no copy).
+ *
+ * @see `cphot::get_reference_spectrum`
  */
 Vega::Vega() {
-    std::vector<std::size_t> shape = { cphot_vega::wavelength_nm.size() };
-    DMatrix xt_wave = xt::adapt(cphot_vega::wavelength_nm, shape);
-    DMatrix xt_flux = xt::adapt(cphot_vega::flux_flam, shape);
-    this->wavelength_nm = xt_wave;
-    this->flux_flam = xt_flux;
+    const ReferenceSpectrum& ref = get_reference_spectrum("vega");
+    this->wavelength_nm = ref.wavelength_nm;
+    this->flux_flam = ref.flux_flam;
 }
 
 /**
@@ -75,8 +83,8 @@ Vega::Vega(const DMatrix& wavelength,
            const DMatrix& flux,
            const QLength& wavelength_unit,
            const QSpectralFluxDensity& flux_unit) {
-    this->wavelength_nm = wavelength * wavelength_unit.to(nm);
-    this->flux_flam = flux * flux_unit.to(flam);
+    this->wavelength_nm = std::make_shared<const DMatrix>(wavelength * wavelength_unit.to(nm));
+    this->flux_flam = std::make_shared<const DMatrix>(flux * flux_unit.to(flam));
 }
 
 /**
@@ -92,11 +100,10 @@ Vega::Vega(const std::vector<double>& wavelength,
            const QLength& wavelength_unit,
            const QSpectralFluxDensity& flux_unit) {
 
-    std::vector<std::size_t> shape = { wavelength.size() };
-    DMatrix xt_wave = xt::adapt(wavelength, shape);
-    DMatrix xt_flux = xt::adapt(flux, shape);
-    this->wavelength_nm = xt_wave * wavelength_unit.to(nm);
-    this->flux_flam = xt_flux * flux_unit.to(flam);
+    ReferenceSpectrum data = make_reference_spectrum(wavelength, flux,
+                                                     wavelength_unit, flux_unit);
+    this->wavelength_nm = data.wavelength_nm;
+    this->flux_flam = data.flux_flam;
 }
 
 /**
@@ -124,8 +131,8 @@ Vega vega_from_votable(const std::string& infile){
  *
  * @return Vega wavelength in nm
  */
-DMatrix Vega::get_wavelength() {
-    return this->wavelength_nm;
+const DMatrix& Vega::get_wavelength() const {
+    return *(this->wavelength_nm);
 }
 
 /**
@@ -134,8 +141,8 @@ DMatrix Vega::get_wavelength() {
  * @param in  requested units for the wavelength
  * @return Vega wavelength units of in
  */
-DMatrix Vega::get_wavelength(const QLength& in) {
-    return this->wavelength_nm * nm.to(in);
+DMatrix Vega::get_wavelength(const QLength& in) const {
+    return *(this->wavelength_nm) * nm.to(in);
 }
 
 /**
@@ -143,8 +150,8 @@ DMatrix Vega::get_wavelength(const QLength& in) {
  *
  * @return Vega flux in flam
  */
-DMatrix Vega::get_flux() {
-    return this->flux_flam;
+const DMatrix& Vega::get_flux() const {
+    return *(this->flux_flam);
 }
 
 /**
@@ -153,8 +160,17 @@ DMatrix Vega::get_flux() {
  * @param in  requested units for the flux
  * @return Vega flux units of in
  */
-DMatrix Vega::get_flux(const QSpectralFluxDensity& in) {
-    return this->flux_flam * flam.to(in);
+DMatrix Vega::get_flux(const QSpectralFluxDensity& in) const {
+    return *(this->flux_flam) * flam.to(in);
+}
+
+/**
+ * @brief Get the Vega spectrum (shared data, no copy)
+ *
+ * @return Vega spectrum in nm and flam
+ */
+Spectrum Vega::get_spectrum() const {
+    return Spectrum(this->wavelength_nm, this->flux_flam, 1. * nm, 1. * flam);
 }
 
 } // namespace cphot
\ No newline at end of file
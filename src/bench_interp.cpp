@@ -0,0 +1,69 @@
+/**
+ * @file bench_interp.cpp
+ * @brief Microbenchmark of the sorted-grid interpolation kernel
+ *
+ * Compares `xt::interp` with `cphot::interp_sorted` when interpolating a
+ * passband definition on the Vega wavelength grid (and the reverse), which is
+ * what `Filter` does to compute its properties or to resample itself.
+ */
+#include <chrono>
+#include <iostream>
+#include <xtensor/xarray.hpp>
+#include <xtensor/xbuilder.hpp>
+#include <xtensor/xmath.hpp>
+#include <cphot/interpolation.hpp>
+#include <cphot/vega.hpp>
+
+/**
+ * @brief time a function call repeated n times
+ *
+ * @param fn        function to call
+ * @param n_repeat  number of repetitions
+ * @return average time per call in microseconds
+ */
+template <typename Func>
+double timeit(Func fn, std::size_t n_repeat){
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < n_repeat; ++i){ fn(); }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(stop - start).count() / n_repeat;
+}
+
+int main(){
+    const std::size_t n_repeat = 200;
+    cphot::Vega vega;
+    const cphot::DMatrix& vega_wavelength = vega.get_wavelength();   // nm
+
+    // a triangle passband with 1000 definition points
+    cphot::DMatrix filt_wave = xt::linspace<double>(330., 1030., 1000);
+    cphot::DMatrix filt_trans = 1. - xt::abs(filt_wave - 680.) / 350.;
+
+    double checksum = 0;
+    double t_xt = timeit([&](){
+        cphot::DMatrix r = xt::interp(vega_wavelength, filt_wave, filt_trans, 0., 0.);
+        checksum += r[0]; }, n_repeat);
+    double t_cphot = timeit([&](){
+        cphot::DMatrix r = cphot::interp_sorted(vega_wavelength, filt_wave, filt_trans, 0., 0.);
+        checksum += r[0]; }, n_repeat);
+
+    std::cout << "Interpolating a passband (" << filt_wave.size() << " points) on the "
+              << "Vega grid (" << vega_wavelength.size() << " points)\n"
+              << "    xt::interp:           " << t_xt << " us/call\n"
+              << "    cphot::interp_sorted: " << t_cphot << " us/call\n"
+              << "    speed-up:             " << t_xt / t_cphot << "\n";
+
+    const cphot::DMatrix& vega_flux = vega.get_flux();
+    t_xt = timeit([&](){
+        cphot::DMatrix r = xt::interp(filt_wave, vega_wavelength, vega_flux, 0., 0.);
+        checksum += r[0]; }, n_repeat);
+    t_cphot = timeit([&](){
+        cphot::DMatrix r = cphot::interp_sorted(filt_wave, vega_wavelength, vega_flux, 0., 0.);
+        checksum += r[0]; }, n_repeat);
+
+    std::cout << "Interpolating Vega on a passband grid\n"
+              << "    xt::interp:           " << t_xt << " us/call\n"
+              << "    cphot::interp_sorted: " << t_cphot << " us/call\n"
+              << "    speed-up:             " << t_xt / t_cphot << "\n"
+              << "(checksum " << checksum << ")\n";
+    return 0;
+}
@@ -5,17 +5,12 @@
  * @date 2021-11-23
  *
  */
-/*
-#include "rquantities.hpp"
-#include "rapidcsv.hpp"
-#include "blackbody.hpp"
-#include "helpers.hpp"
-#include "prettyprint.hpp"
-*/
 #include <cpr/cpr.h>
 #include "cphot/votable.hpp"
 #include "cphot/filter.hpp"
 #include "cphot/io.hpp"
+#include "cphot/library.hpp"
+#include "cphot/blackbody_fit.hpp"
 
 
 std::string download_svo_filter(std::string id){
@@ -29,34 +24,34 @@ std::string download_svo_filter(std::string id){
 
 int main() {
 
-/*
-rapidcsv::Document doc("data/blackbody-stars-clean.csv");
-
-std::vector<std::string> ignore = {
-    "SDSSName", "R.A.(J2000)", "Decl.(J2000)", "Teff",
-    "Teff_error", "amp", "amp_error", "theta", "theta_error",
-    "chi^2/dof", "source_id",
-    };
-
-std::vector<std::string> columns;
-for (const auto& p: doc.GetColumnNames()){
-    if (! contains(ignore, p)){ columns.push_back(p); }
+// catalog bands and the corresponding library filters
+std::vector<std::string> columns = {
+    "GALEX_FUV", "GALEX_NUV", "SDSS_u", "SDSS_g", "SDSS_r", "SDSS_i", "SDSS_z", "WISE_W1"};
+std::vector<std::string> filter_names = {
+    "GALEX_FUV", "GALEX_NUV", "SDSS_u", "SDSS_g", "SDSS_r", "SDSS_i", "SDSS_z", "WISE_RSR_W1"};
+std::vector<cphot::PhotometricUnit> units(columns.size(), cphot::PhotometricUnit::ABmag);
+units.back() = cphot::PhotometricUnit::Vegamag;
+
+std::string filename = "pyphot_library.hdf5";
+cphot::download_pyphot_hdf5library(filename);
+cphot::HDF5Library lib(filename);
+std::vector<cphot::Filter> filters;
+for (const auto& name: filter_names){ filters.push_back(lib.load_filter(name)); }
+
+cphot::BlackbodyTable table = cphot::BlackbodyTable::load_or_build(filters, "blackbody_table.txt");
+cphot::BlackbodyFitter fitter(table, filters, units);
+
+cphot::DMatrix values, errors;
+cphot::read_catalog_photometry("data/blackbody-stars-clean.csv", columns, values, errors);
+std::vector<cphot::BlackbodyFit> fits = fitter.fit(values, errors);
+
+std::cout << "Teff,Teff_error,amp,amp_error,chi^2/dof,converged\n";
+for (const auto& fit: fits){
+    std::cout << fit.teff << "," << fit.teff_error << ","
+              << fit.amp << "," << fit.amp_error << ","
+              << ((fit.dof() > 0) ? fit.chi2 / fit.dof() : std::nan(""))
+              << "," << fit.converged << "\n";
 }
-std::cout << columns << "\n";
-
-std::vector<float> col = doc.GetColumn<float>("GALEX_FUV");
-std::cout << col << "\n";
-//std::cout << doc.GetColumnNames() << "\n";
-*/
-
-// cphot::Filter Bessell_J = cphot::download_svo_filter("Generic/Bessell_JHKLM.J");
-// Bessell_J.info();
-
-cphot::Filter gaia_G = cphot::get_filter("data/passbands/GAIA.GAIA3.G.xml");
-
-std::cout << gaia_G;
-
-gaia_G.info();
 
 std::cout << "done.\n";
 return 0;
@@ -5,9 +5,26 @@
  *
  */
 #include "testlib.hpp"
+#include <blackbody.hpp>
 #include <cphot/rquantities.hpp>
+#include <cphot/blackbody_fit.hpp>
+#include <cphot/blackbody_mcmc.hpp>
+#include <cphot/blackbody_table.hpp>
+#include <cphot/conversions.hpp>
+#include <cphot/extinction.hpp>
 #include <cphot/filter.hpp>
 #include <cphot/io.hpp>
+#include <cphot/interpolation.hpp>
+#include <cphot/photometric_system.hpp>
+#include <cphot/photometry_plan.hpp>
+#include <cphot/redshift.hpp>
+#include <cphot/quadrature.hpp>
+#include <cphot/rebin.hpp>
+#include <cphot/spectrum.hpp>
+#include <cphot/template_bank.hpp>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 
 /**
  * @brief Testing unit conversions
@@ -91,8 +108,895 @@ void test_svo_energy_dtype(){
     EXPECT_NEAR(filt.get_Vega_zero_Jy().to(Jy), 1033.691278249937, 1e-5);
 }
 
+/**
+ * @brief Testing the cached zero points against a direct integration of Vega
+ */
+void test_zero_points(){
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    cphot::Filter filt(filt_wave, filt_trans, nm, "photon", "triangle");
+    cphot::Filter copy = filt;
+
+    // copies share one set of zero points computed once
+    const cphot::ZeroPoints& zp = filt.get_zero_points();
+    EXPECT_NEAR(double(&zp == &copy.get_zero_points()), 1., 0.);
+    EXPECT_NEAR(double(&zp == &filt.get_zero_points()), 1., 0.);
+
+    const cphot::Vega vega;
+    double vega_flam = filt.get_flux(vega.get_wavelength(), vega.get_flux(), nm, flam).to(flam);
+    EXPECT_NEAR(zp.Vega_flam / vega_flam, 1., 1e-15);
+    EXPECT_NEAR(zp.Vega_mag, -2.5 * std::log10(vega_flam), 1e-12);
+    EXPECT_NEAR(copy.get_Vega_zero_flux().to(flam) / vega_flam, 1., 1e-15);
+    EXPECT_NEAR(copy.get_Vega_zero_mag(), -2.5 * std::log10(vega_flam), 1e-12);
+    EXPECT_NEAR(copy.get_AB_zero_mag(), zp.AB_mag, 0.);
+    EXPECT_NEAR(copy.get_ST_zero_mag(), 21.1, 1e-15);
+}
+
+/**
+ * @brief Testing the sorted-grid interpolation against xt::interp
+ */
+void test_interp_sorted(){
+    cphot::DMatrix xp = {1., 2., 4., 5., 8.};
+    cphot::DMatrix fp = {0., 1., 3., -1., 2.};
+    // points before, on, between and after the definition
+    cphot::DMatrix x = {-1., 0.5, 1., 1.5, 2., 3.9, 4., 4.2, 7., 8., 8.5, 10.};
+
+    cphot::DMatrix expected = xt::interp(x, xp, fp, -2., 7.);
+    cphot::DMatrix result = cphot::interp_sorted(x, xp, fp, -2., 7.);
+    for (std::size_t i = 0; i < x.size(); ++i){
+        EXPECT_NEAR(result[i], expected[i], 1e-12);
+    }
+}
+
+/**
+ * @brief Testing the regular grid fast paths against explicit wavelengths
+ */
+void test_regular_grids(){
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    cphot::Filter filt(filt_wave, filt_trans, nm, "photon", "triangle");
+
+    cphot::UniformGrid grid = cphot::UniformGrid::linspace(300., 800., 5001);
+    cphot::DMatrix wavelength = grid.values();
+    cphot::DMatrix flux = 1. / xt::square(wavelength);
+    EXPECT_NEAR(filt.get_flux(grid, flux, nm, flam).to(flam),
+                filt.get_flux(wavelength, flux, nm, flam).to(flam), 1e-15);
+
+    cphot::LogUniformGrid log_grid = cphot::LogUniformGrid::logspace(300., 800., 5001);
+    wavelength = log_grid.values();
+    double block[300];
+    log_grid.values(1234, 1534, block);
+    for (std::size_t i = 0; i < 300; ++i) {
+        EXPECT_NEAR(wavelength[1234 + i] / log_grid[1234 + i], 1., 1e-14);
+        EXPECT_NEAR(block[i] / log_grid[1234 + i], 1., 1e-14);
+    }
+    EXPECT_NEAR(wavelength[5000], 800., 1e-10);
+    flux = 1. / xt::square(wavelength);
+    EXPECT_NEAR(filt.get_flux(log_grid, flux, nm, flam).to(flam),
+                filt.get_flux(wavelength, flux, nm, flam).to(flam), 1e-15);
+
+    // grids starting and ending inside the filter: half trapezoids at the ends
+    cphot::UniformGrid inner = cphot::UniformGrid::linspace(430., 570., 1001);
+    cphot::DMatrix inner_wave = inner.values();
+    cphot::DMatrix inner_flux = 1. / xt::square(inner_wave);
+    EXPECT_NEAR(filt.get_flux(inner, inner_flux, nm, flam).to(flam)
+                / filt.get_flux(inner_wave, inner_flux, nm, flam).to(flam), 1., 1e-13);
+    cphot::LogUniformGrid log_inner = cphot::LogUniformGrid::logspace(430., 570., 1001);
+    inner_wave = log_inner.values();
+    inner_flux = 1. / xt::square(inner_wave);
+    EXPECT_NEAR(filt.get_flux(log_inner, inner_flux, nm, flam).to(flam)
+                / filt.get_flux(inner_wave, inner_flux, nm, flam).to(flam), 1., 1e-13);
+
+    // fewer than 2 points have no step
+    for (std::size_t n : {0, 1}) {
+        bool thrown = false;
+        try {
+            cphot::UniformGrid::linspace(300., 800., n);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        EXPECT_NEAR(double(thrown), 1., 0.);
+        thrown = false;
+        try {
+            cphot::LogUniformGrid::logspace(300., 800., n);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        EXPECT_NEAR(double(thrown), 1., 0.);
+    }
+
+    cphot::UniformGrid detected(0., 1., 1);
+    EXPECT_NEAR(double(cphot::detect_uniform_grid(grid.values(), detected)), 1., 0.);
+    EXPECT_NEAR(double(cphot::detect_uniform_grid(wavelength, detected)), 0., 0.);
+}
+
+/**
+ * @brief Testing the batch photometry against Filter::get_flux
+ */
+void test_photometry_plan(){
+    std::vector<cphot::Filter> filters = {
+        cphot::download_svo_filter("GAIA/GAIA3.G"),
+        cphot::download_svo_filter("2MASS/2MASS.H")
+    };
+    cphot::Vega vega;
+    const cphot::DMatrix& wavelength = vega.get_wavelength(nm);
+    const cphot::DMatrix& flux = vega.get_flux(flam);
+
+    // two spectra: Vega and twice Vega
+    const std::size_t n_wave = wavelength.size();
+    cphot::DMatrix spectra = xt::zeros<double>({std::size_t(2), n_wave});
+    for (std::size_t i = 0; i < n_wave; ++i){
+        spectra(0, i) = flux[i];
+        spectra(1, i) = 2. * flux[i];
+    }
+
+    cphot::PhotometryPlan plan(wavelength, nm, filters);
+    cphot::DMatrix result = plan.get_flux(spectra);
+
+    for (std::size_t m = 0; m < filters.size(); ++m){
+        double expected = filters[m].get_flux(wavelength, flux, nm, flam).to(flam);
+        EXPECT_NEAR(result(0, m) / expected, 1., 1e-10);
+        EXPECT_NEAR(result(1, m) / expected, 2., 1e-10);
+    }
+}
+
+
+/**
+ * @brief Testing the filter quadrature rules against Filter::get_flux
+ */
+void test_quadrature_rule(){
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    cphot::Filter filt(filt_wave, filt_trans, nm, "photon", "triangle");
+
+    cphot::QuadratureRule rule = cphot::QuadratureRule::with_tolerance(filt, 1e-8);
+    EXPECT_NEAR(rule.get_max_error(), 0., 1e-8);
+    double sum = 0.;
+    for (double w : rule.get_weights()) { sum += w; }
+    EXPECT_NEAR(sum, 1., 1e-12);
+
+    cphot::UniformGrid grid = cphot::UniformGrid::linspace(400., 600., 200001);
+    cphot::DMatrix flux = 1. / xt::square(grid.values());
+    EXPECT_NEAR(rule.integrate([](double lam){ return 1. / (lam * lam); }),
+                filt.get_flux(grid, flux, nm, flam).to(flam), 1e-13);
+
+    // fixed number of nodes: exact for polynomials up to degree 2K - 1
+    cphot::QuadratureRule fixed = cphot::QuadratureRule::with_nodes(filt, 4);
+    EXPECT_NEAR(double(fixed.size()), 4., 0.);
+    const double degree7 = filt.get_flux(grid, xt::pow(grid.values() / 500., 7.), nm, flam).to(flam);
+    EXPECT_NEAR(fixed.integrate([](double lam){ return std::pow(lam / 500., 7.); }) / degree7, 1., 1e-9);
+    for (double node : fixed.get_nodes()) {
+        EXPECT_NEAR(double((node > 400.) && (node < 600.)), 1., 0.);
+    }
+}
+
+/**
+ * @brief Testing the transmission simplification
+ */
+void test_filter_simplify(){
+    cphot::DMatrix filt_wave = xt::linspace<double>(400., 600., 2001);
+    cphot::DMatrix filt_trans = xt::exp(-xt::square((filt_wave - 500.) / 30.));
+    cphot::Filter filt(filt_wave, filt_trans, nm, "photon", "gaussian");
+
+    cphot::SimplifyReport report;
+    cphot::Filter simplified = filt.simplify(1e-4, report);
+    EXPECT_NEAR(double(report.n_points), 2001., 0.);
+    EXPECT_NEAR(double(report.n_simplified), double(simplified.get_transmission().size()), 0.);
+    EXPECT_NEAR(double(report.n_simplified < 200), 1., 0.);
+    EXPECT_NEAR(report.max_error, 0., 1e-4);
+    EXPECT_NEAR(simplified.get_Vega_zero_mag(), filt.get_Vega_zero_mag(), 1e-4);
+}
+
+/**
+ * @brief Testing the single sweep photometric system against Filter::get_flux
+ */
+void test_photometric_system(){
+    std::vector<cphot::Filter> filters;
+    std::vector<cphot::MagSystem> systems;
+    for (double center : {800., 450., 520., 350.}) {
+        cphot::DMatrix filt_wave = xt::linspace<double>(center - 80., center + 80., 161);
+        cphot::DMatrix filt_trans = xt::exp(-xt::square((filt_wave - center) / 30.));
+        filters.emplace_back(filt_wave, filt_trans, nm, "photon", "band");
+        systems.push_back((center < 500.) ? cphot::MagSystem::AB : cphot::MagSystem::Vega);
+    }
+    cphot::PhotometricSystem system(filters, systems);
+
+    cphot::DMatrix wavelength = xt::linspace<double>(3000., 10000., 3001);
+    cphot::DMatrix flux = 1e-10 * xt::exp(-wavelength / 6000.);
+    cphot::DMatrix mags = system.magnitudes(wavelength, flux, angstrom, flam);
+    for (std::size_t m = 0; m < filters.size(); ++m) {
+        double f = filters[m].get_flux(wavelength, flux, angstrom, flam).to(flam);
+        double zp = (systems[m] == cphot::MagSystem::AB) ? filters[m].get_AB_zero_mag()
+                                                         : filters[m].get_Vega_zero_mag();
+        EXPECT_NEAR(mags[m], -2.5 * std::log10(f) - zp, 1e-12);
+    }
+
+    // overlapping bands, grids starting or ending inside a band, no overlap
+    for (const auto& grid : {cphot::DMatrix(xt::linspace<double>(4000., 7000., 1234)),
+                             cphot::DMatrix(xt::linspace<double>(2000., 4700., 517)),
+                             cphot::DMatrix(xt::linspace<double>(9000., 12000., 11))}) {
+        cphot::DMatrix grid_flux = 1e-10 * xt::exp(-grid / 6000.);
+        cphot::DMatrix fluxes = system.get_flux(grid, grid_flux, angstrom, flam);
+        for (std::size_t m = 0; m < filters.size(); ++m) {
+            double f = filters[m].get_flux(grid, grid_flux, angstrom, flam).to(flam);
+            EXPECT_NEAR(fluxes[m], f, 1e-14 * f);
+        }
+    }
+}
+
+/**
+ * @brief Testing the redshift grid photometry against shifted spectra
+ */
+void test_redshifted_flux(){
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    std::vector<cphot::Filter> filters;
+    filters.emplace_back(filt_wave, filt_trans, nm, "photon", "triangle");
+    filters.emplace_back(filt_wave, filt_trans, nm, "energy", "triangle");
+
+    cphot::DMatrix wavelength = xt::linspace<double>(100., 1000., 90001);
+    cphot::DMatrix flux = 1e-10 * xt::exp(-wavelength / 300.);
+    cphot::DMatrix redshifts = {0., 0.2, 1.};
+    cphot::DMatrix flux_z = cphot::get_redshifted_flux(wavelength, flux, nm, flam,
+                                                      filters, redshifts);
+    for (std::size_t iz = 0; iz < redshifts.size(); ++iz) {
+        cphot::DMatrix shifted_wave = wavelength * (1. + redshifts[iz]);
+        cphot::DMatrix shifted_flux = flux / (1. + redshifts[iz]);
+        for (std::size_t m = 0; m < filters.size(); ++m) {
+            double ref = filters[m].get_flux(shifted_wave, shifted_flux, nm, flam).to(flam);
+            EXPECT_NEAR(flux_z.data()[iz * filters.size() + m] / ref, 1., 1e-7);
+        }
+    }
+
+    cphot::PhotometricSystem system(filters, cphot::MagSystem::AB);
+    cphot::DMatrix kcorr = cphot::get_kcorrections(wavelength, flux, nm, flam,
+                                                   system, redshifts);
+    EXPECT_NEAR(kcorr.data()[0], 0., 1e-12);
+    EXPECT_NEAR(kcorr.data()[2], -2.5 * std::log10(flux_z.data()[2] / flux_z.data()[0]), 1e-12);
+}
+
+/**
+ * @brief Testing the extinction laws and the reddened photometry over A_V grids
+ */
+void test_extinction(){
+    EXPECT_NEAR(cphot::ccm89(549., 3.1), 1., 1e-2);
+    EXPECT_NEAR(cphot::Fitzpatrick99(3.1)(549.), 1., 2e-2);
+    EXPECT_NEAR(cphot::Fitzpatrick99(3.1)(440.) - cphot::Fitzpatrick99(3.1)(549.), 1. / 3.1, 1e-2);
+
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    std::vector<cphot::Filter> filters;
+    filters.emplace_back(filt_wave, filt_trans, nm, "photon", "triangle");
+    cphot::ExtinctionPlan plan(filters, cphot::ExtinctionLaw::CCM89, 3.1);
+
+    cphot::DMatrix wavelength = xt::linspace<double>(300., 700., 4001);
+    cphot::DMatrix flux = 1. / xt::square(wavelength);
+    cphot::DMatrix av = xt::linspace<double>(0., 2., 5);
+    cphot::DMatrix av_single = {1.5};
+    cphot::DMatrix fluxes = plan.band_flux(wavelength, flux, nm, flam, av);
+    cphot::DMatrix fluxes_single = plan.band_flux(wavelength, flux, nm, flam, av_single);
+    EXPECT_NEAR(fluxes(0, 0), filters[0].get_flux(wavelength, flux, nm, flam).to(flam), 1e-18);
+    EXPECT_NEAR(fluxes(3, 0) / fluxes_single(0, 0), 1., 1e-12);
+
+    // blackbody table against a dense integration, on and between the nodes
+    cphot::DMatrix teff = xt::exp(xt::linspace<double>(std::log(3000.), std::log(30000.), 41));
+    cphot::BlackbodyExtinctionTable table(filters, teff, av, cphot::ExtinctionLaw::CCM89, 3.1);
+    const double bound = table.get_max_error()[0];
+    EXPECT_NEAR(double((bound > 0) && (bound < 1e-2)), 1., 0.);
+    cphot::DMatrix dense = xt::linspace<double>(400., 600., 200001);
+    for (double t : {teff[7], 4321., 17777.}) {
+        cphot::DMatrix bb = bb_flux(dense, 1., t);
+        cphot::DMatrix reference = plan.band_flux(dense, bb, nm, flam, av_single);
+        EXPECT_NEAR(table.get_flux(t, 1.5)[0] / reference(0, 0), 1., bound);
+        EXPECT_NEAR(table.get_flux(t, 1.5, 2.)[0] / reference(0, 0), 2., 2. * bound);
+    }
+}
+
+/**
+ * @brief Testing the fused flux and gradient integration against finite differences
+ */
+void test_flux_gradient(){
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    cphot::Filter filt(filt_wave, filt_trans, nm, "photon", "triangle");
+
+    cphot::DMatrix wavelength = xt::linspace<double>(300., 700., 4001);
+    const double amp = 2e-20;
+    const double teff = 6500.;
+    const double dt = 1e-2;
+    cphot::DMatrix flux_gradient, gradient, unused;
+    cphot::DMatrix flux = bb_flux_gradient(wavelength, amp, teff, flux_gradient);
+    double f = filt.get_flux(wavelength, flux, flux_gradient, nm, flam, gradient).to(flam);
+    EXPECT_NEAR(f / filt.get_flux(wavelength, flux, nm, flam).to(flam), 1., 1e-14);
+    EXPECT_NEAR(gradient[0] * amp / f, 1., 1e-14);
+
+    cphot::DMatrix flux_p = bb_flux_gradient(wavelength, amp, teff + dt, unused);
+    cphot::DMatrix flux_m = bb_flux_gradient(wavelength, amp, teff - dt, unused);
+    double df_dteff = (filt.get_flux(wavelength, flux_p, nm, flam).to(flam)
+                       - filt.get_flux(wavelength, flux_m, nm, flam).to(flam)) / (2. * dt);
+    EXPECT_NEAR(gradient[1] / df_dteff, 1., 1e-6);
+}
 
+/**
+ * @brief Testing that filter properties are computed on first read and shared by copies
+ */
+void test_lazy_properties(){
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    cphot::Filter filt(filt_wave, filt_trans, nm, "photon", "triangle");
+    EXPECT_NEAR(double(filt.has_properties()), 0., 0.);
+    EXPECT_NEAR(double(filt.has_vega_properties()), 0., 0.);
+    EXPECT_NEAR(double(filt.has_zero_points()), 0., 0.);
+
+    cphot::Filter resampled = filt.reinterp(xt::linspace<double>(400., 600., 401));
+    EXPECT_NEAR(double(resampled.has_properties()), 0., 0.);
+    EXPECT_NEAR(double(resampled.has_vega_properties()), 0., 0.);
+    EXPECT_NEAR(double(resampled.has_zero_points()), 0., 0.);
+    EXPECT_NEAR(double(filt.has_properties()), 0., 0.);
+
+    // SED independent properties do not pull in Vega
+    cphot::Filter copy = filt;
+    double lpivot = filt.get_lpivot().to(nm);
+    EXPECT_NEAR(double(copy.has_properties()), 1., 0.);
+    EXPECT_NEAR(double(copy.has_vega_properties()), 0., 0.);
+    EXPECT_NEAR(double(copy.has_zero_points()), 0., 0.);
+    EXPECT_NEAR(copy.get_lpivot().to(nm), lpivot, 0.);
+
+    double leff = copy.get_leff().to(nm);
+    EXPECT_NEAR(double(filt.has_vega_properties()), 1., 0.);
+    EXPECT_NEAR(filt.get_leff().to(nm), leff, 0.);
+    EXPECT_NEAR(double(filt.has_zero_points()), 0., 0.);
+    EXPECT_NEAR(double(resampled.has_properties()), 0., 0.);
+}
+
+/**
+ * @brief Testing the cached integration weights against the direct integration
+ */
+void test_transmission_cache(){
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    cphot::Filter filt(filt_wave, filt_trans, nm, "photon", "triangle");
+
+    std::vector<cphot::DMatrix> grids {xt::linspace<double>(3000., 7000., 4001),
+                                       xt::linspace<double>(3500., 6500., 1001),
+                                       xt::linspace<double>(2000., 8000., 3001)};
+    std::vector<double> reference;
+    for (const auto& grid : grids) {
+        reference.push_back(filt.get_flux(grid, 1. / xt::square(grid), angstrom, flam).to(flam));
+    }
+
+    filt.set_transmission_cache_size(2);
+    for (std::size_t k = 0; k < 6; ++k) {
+        const cphot::DMatrix& grid = grids[k % 3];
+        double flux = filt.get_flux(grid, 1. / xt::square(grid), angstrom, flam).to(flam);
+        EXPECT_NEAR(flux / reference[k % 3], 1., 1e-12);
+    }
+    cphot::TransmissionCacheStats stats = filt.get_transmission_cache_stats();
+    EXPECT_NEAR(double(stats.misses), 6., 0.);
+    EXPECT_NEAR(double(stats.evictions), 4., 0.);
+    EXPECT_NEAR(double(stats.size), 2., 0.);
+
+    filt.get_flux(grids[2], 1. / xt::square(grids[2]), angstrom, flam);
+    EXPECT_NEAR(double(filt.get_transmission_cache_stats().hits), 1., 0.);
+
+    // same size and end points, one moved interior point: no stale weights
+    cphot::DMatrix moved = grids[2];
+    moved[1001] += 1.;
+    cphot::Filter uncached(filt_wave, filt_trans, nm, "photon", "triangle");
+    double expected = uncached.get_flux(moved, 1. / xt::square(moved), angstrom, flam).to(flam);
+    double flux = filt.get_flux(moved, 1. / xt::square(moved), angstrom, flam).to(flam);
+    EXPECT_NEAR(flux / expected, 1., 1e-12);
+
+    // a point moved outside the filter window does not change the weights: hit
+    cphot::DMatrix outside = moved;
+    outside[10] += 1.;
+    const std::size_t hits = filt.get_transmission_cache_stats().hits;
+    flux = filt.get_flux(outside, 1. / xt::square(outside), angstrom, flam).to(flam);
+    EXPECT_NEAR(flux / expected, 1., 1e-12);
+    EXPECT_NEAR(double(filt.get_transmission_cache_stats().hits), double(hits + 1), 0.);
+}
+
+/**
+ * @brief Testing the spectrum batches and single precision spectra against Filter::get_flux
+ */
+void test_spectrum(){
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    cphot::Filter filt(filt_wave, filt_trans, nm, "photon", "triangle");
+
+    cphot::DMatrix wave = xt::linspace<double>(3000., 7000., 801);
+    cphot::DMatrix fluxes = cphot::DMatrix::from_shape({3, wave.size()});
+    for (std::size_t k = 0; k < 3; ++k) {
+        for (std::size_t i = 0; i < wave.size(); ++i) {
+            fluxes(k, i) = std::pow(wave[i] / 5000., double(k) - 2.);
+        }
+    }
+    cphot::SpectrumBatch batch(wave, fluxes, angstrom, Jy);
+    cphot::DMatrix batch_flux = filt.get_flux(batch);
+    cphot::PhotometryPlan plan(wave * 0.1, nm, {filt});
+    cphot::DMatrix plan_flux = plan.get_flux(batch);
+    for (std::size_t k = 0; k < 3; ++k) {
+        cphot::Spectrum spectrum = batch.get_spectrum(k);
+        cphot::DMatrix row = spectrum.get_flux();
+        double reference = filt.get_flux(wave, row, angstrom, Jy).to(Jy);
+        EXPECT_NEAR(filt.get_flux(spectrum).to(Jy) / reference, 1., 1e-12);
+        EXPECT_NEAR(batch_flux[k] / reference, 1., 1e-12);
+        EXPECT_NEAR(plan_flux(k, 0) / reference, 1., 1e-12);
+    }
+
+    // single precision storage, double accumulation (docs/cphot_precision.md)
+    cphot::FSpectrumBatch float_batch = batch.astype<float>();
+    cphot::DMatrix float_flux = filt.get_flux(float_batch);
+    for (std::size_t k = 0; k < 3; ++k) {
+        EXPECT_NEAR(float_flux[k] / batch_flux[k], 1., 1e-9);
+        EXPECT_NEAR(filt.get_flux(float_batch.get_spectrum(k)).to(Jy) / batch_flux[k], 1., 1e-9);
+    }
+    cphot::Filter gaia_g = cphot::get_filter("data/passbands/GAIA.GAIA3.G.xml");
+    cphot::Spectrum vega_g = cphot::Vega().get_spectrum();
+    EXPECT_NEAR(gaia_g.get_flux(vega_g.astype<float>()).to(flam)
+                / gaia_g.get_flux(vega_g).to(flam), 1., 0.);
+    cphot::DMatrix bb_wave = xt::linspace<double>(100., 1200., 20001);
+    for (double teff = 3000.; teff <= 50000.; teff *= 1.2) {
+        cphot::Spectrum bb(bb_wave, bb_flux(bb_wave, 1., teff), nm, flam);
+        EXPECT_NEAR(gaia_g.get_flux(bb.astype<float>()).to(flam)
+                    / gaia_g.get_flux(bb).to(flam), 1., 1e-9);
+    }
+
+    // reference spectra share their data
+    cphot::Vega vega;
+    cphot::Spectrum vega_spectrum = vega.get_spectrum();
+    EXPECT_NEAR(double(&vega_spectrum.get_flux() == &vega.get_flux()), 1., 0.);
+    EXPECT_NEAR(filt.get_flux(vega_spectrum).to(flam)
+                / filt.get_flux(vega.get_wavelength(), vega.get_flux(), nm, flam).to(flam), 1., 1e-12);
+}
+
+/**
+ * @brief Testing the flux conserving rebinning, its threads and single precision storage
+ */
+void test_rebin(){
+    cphot::DMatrix in_wave = xt::linspace<double>(4000., 6000., 2001);
+    cphot::DMatrix out_wave = xt::linspace<double>(4100., 5900., 91);
+    cphot::DMatrix flux = cphot::DMatrix::from_shape({4, in_wave.size()});
+    for (std::size_t k = 0; k < 4; ++k) {
+        for (std::size_t i = 0; i < in_wave.size(); ++i) {
+            flux(k, i) = (1. + k) * std::exp(-0.5 * std::pow((in_wave[i] - 5000.) / (50. * (k + 1)), 2));
+        }
+    }
+    cphot::RebinPlan plan(in_wave, out_wave, angstrom);
+    cphot::DMatrix serial = plan.rebin(flux, 1);
+    cphot::DMatrix threaded = plan.rebin(flux, 4);
+    cphot::DMatrix in_edges = cphot::bin_edges(in_wave);
+    cphot::DMatrix out_edges = cphot::bin_edges(out_wave);
+    for (std::size_t k = 0; k < 4; ++k) {
+        // integral over the output range
+        double in_total = 0.;
+        double out_total = 0.;
+        for (std::size_t i = 0; i < in_wave.size(); ++i) {
+            const double lo = std::max(in_edges[i], out_edges[0]);
+            const double hi = std::min(in_edges[i + 1], out_edges[out_wave.size()]);
+            if (hi > lo) { in_total += flux(k, i) * (hi - lo); }
+        }
+        for (std::size_t j = 0; j < out_wave.size(); ++j) {
+            out_total += serial(k, j) * (out_edges[j + 1] - out_edges[j]);
+            EXPECT_NEAR(threaded(k, j), serial(k, j), 0.);
+        }
+        EXPECT_NEAR(out_total / in_total, 1., 1e-12);
+    }
+
+    // single precision storage: only the rounding of the values to float
+    cphot::SpectrumBatch batch(in_wave, flux, angstrom, flam);
+    cphot::FSpectrumBatch float_rebinned = plan.rebin(batch.astype<float>());
+    for (std::size_t k = 0; k < 4; ++k) {
+        for (std::size_t j = 0; j < out_wave.size(); ++j) {
+            if (serial(k, j) < 1e-30) { continue; }
+            EXPECT_NEAR(float_rebinned.row(k)[j] / serial(k, j), 1., 1.2e-7);
+        }
+    }
+
+    // identity on the same grid, fill outside the input range
+    cphot::DMatrix single = 1. / xt::square(in_wave);
+    cphot::DMatrix same = cphot::rebin(in_wave, single, in_wave);
+    EXPECT_NEAR(same[1000] / single[1000], 1., 1e-12);
+    cphot::DMatrix wide = cphot::rebin(in_wave, single,
+                                       xt::linspace<double>(3000., 7000., 5), -1.);
+    EXPECT_NEAR(wide[0], -1., 0.);
+}
+
+/**
+ * @brief Testing the vectorized unit conversions of band fluxes and magnitudes
+ */
+void test_bulk_conversions(){
+    cphot::DMatrix filt_wave = {400., 450., 500., 550., 600.};
+    cphot::DMatrix filt_trans = {0., 0.5, 1., 0.5, 0.};
+    cphot::Filter filt(filt_wave, filt_trans, nm, "photon", "triangle");
+    cphot::BandConverter converter(filt);
+    using unit = cphot::PhotometricUnit;
+
+    // 3631 Jy is AB magnitude 0
+    cphot::DMatrix jy = {3631., 0., -1.};
+    cphot::DMatrix ab = converter.convert(jy, unit::Jy, unit::ABmag);
+    EXPECT_NEAR(ab[0], 0., 1e-3);
+    EXPECT_NEAR(double(std::isnan(ab[1]) && std::isnan(ab[2])), 1., 0.);
 
+    // scalar definition and round trip through all the units with errors
+    cphot::DMatrix mag = xt::linspace<double>(5., 25., 1001);
+    cphot::DMatrix err = xt::ones<double>({mag.size()}) * 0.01;
+    cphot::DMatrix flam_err;
+    cphot::DMatrix flam = converter.convert(mag, err, unit::Vegamag, unit::flam, flam_err);
+    const double zp = filt.get_Vega_zero_mag();
+    cphot::DMatrix vega = converter.convert(
+        converter.convert(converter.convert(flam, unit::flam, unit::fnu), unit::fnu, unit::STmag),
+        unit::STmag, unit::Vegamag);
+    for (std::size_t i = 0; i < mag.size(); ++i) {
+        EXPECT_NEAR(flam[i] / std::pow(10., -0.4 * (mag[i] + zp)), 1., 1e-13);
+        EXPECT_NEAR(flam_err[i] / flam[i], 0.4 * std::log(10.) * 0.01, 1e-15);
+        EXPECT_NEAR(vega[i], mag[i], 1e-12);
+    }
+    cphot::DMatrix back_err;
+    converter.convert(flam, flam_err, unit::flam, unit::Vegamag, back_err);
+    EXPECT_NEAR(back_err[500], 0.01, 1e-15);
+}
+
+/**
+ * @brief Testing the (Teff, wavelength) blackbody grids against Planck's law
+ */
+void test_blackbody_grid(){
+    cphot::DMatrix wavelength = xt::linspace<double>(100., 100000., 2000);
+    cphot::DMatrix teff = {1000., 3000., 5800., 20000., 50000.};
+    cphot::DMatrix amp = {1., 2., 0.5, 1e-3, 1e-20};
+    cphot::DMatrix grid = bb_flux(wavelength, amp, teff);
+    for (std::size_t t = 0; t < teff.size(); ++t) {
+        for (std::size_t i = 0; i < wavelength.size(); ++i) {
+            const double lam = wavelength[i];
+            // Planck's law with the 2015 SI constants, in flam for lam in nm
+            const double reference = amp[t] * 1.1910429723971884e22 / std::pow(lam, 5)
+                                     / std::expm1(1.4387768775039337e7 / (lam * teff[t]));
+            EXPECT_NEAR(grid(t, i) / reference, 1., 1e-13);
+        }
+    }
+    // broadcast amplitude and scalar overloads
+    cphot::DMatrix single = bb_flux(wavelength, 3., 5800.);
+    cphot::DMatrix broadcast = bb_flux(wavelength, cphot::DMatrix({3.}), teff);
+    EXPECT_NEAR(single[100] / broadcast(2, 100), 1., 1e-15);
+    EXPECT_NEAR(bb_flux_function(wavelength[100], 3., 5800.) / single[100], 1., 1e-13);
+    // no temperature: empty grid
+    cphot::DMatrix none = bb_flux(wavelength, cphot::DMatrix::from_shape({0}),
+                                  cphot::DMatrix::from_shape({0}));
+    EXPECT_NEAR(double(none.size()), 0., 0.);
+}
+
+/**
+ * @brief Testing the tabulated blackbody band fluxes, their slopes and cache files against Filter::get_flux
+ */
+void test_blackbody_table(){
+    cphot::DMatrix box_wave = xt::linspace<double>(1500., 2500., 201);
+    cphot::DMatrix box_trans = xt::ones<double>({201});
+    std::vector<cphot::Filter> filters = {
+        cphot::get_filter("data/passbands/GAIA.GAIA3.G.xml"),
+        cphot::Filter(box_wave, box_trans, nm, "energy", "box")
+    };
+    cphot::BlackbodyTable table(filters, 1e-6, 1000., 200000.);
+    EXPECT_NEAR(table.get_teff_max(), 200000., 1e-6);
+    for (double teff : {1000., 1234.5, 5800., 31415.9, 200000.}) {
+        for (std::size_t m = 0; m < filters.size(); ++m) {
+            const cphot::DMatrix& wave = filters[m].get_wavelength();
+            const double reference = filters[m].get_flux(wave, bb_flux(wave, 2., teff),
+                                                         nm, flam).to(flam);
+            double dflux_dteff;
+            const double flux = table.get_flux(m, teff, 2., dflux_dteff);
+            EXPECT_NEAR(flux / reference, 1., 1e-6);
+            // finite difference of the exact band flux
+            const double dt = 1e-4 * teff;
+            const double upper = filters[m].get_flux(wave, bb_flux(wave, 2., teff + dt), nm, flam).to(flam);
+            const double lower = filters[m].get_flux(wave, bb_flux(wave, 2., teff - dt), nm, flam).to(flam);
+            EXPECT_NEAR(dflux_dteff * 2. * dt / (upper - lower), 1., 1e-4);
+        }
+    }
+    // cache round trip
+    const std::string path = "test_blackbody_table.txt";
+    std::remove(path.c_str());
+    cphot::BlackbodyTable built = cphot::BlackbodyTable::load_or_build(filters, path, 1e-6, 1000., 200000.);
+    cphot::BlackbodyTable cached = cphot::BlackbodyTable::load(path);
+    EXPECT_NEAR(double(cached.n_teff()), double(built.n_teff()), 0.);
+    EXPECT_NEAR(cached.get_fluxes(7777.)[1] / built.get_fluxes(7777.)[1], 1., 1e-15);
+
+    // corrupted caches: load throws before allocating, load_or_build rebuilds
+    std::stringstream saved;
+    saved << std::ifstream(path).rdbuf();
+    const std::string text = saved.str();
+    const std::size_t line1 = text.find('\n') + 1;
+    const std::size_t line2 = text.find('\n', line1) + 1;
+    std::istringstream header(text.substr(line1, line2 - line1));
+    std::string log_min, log_max, n_nodes, rel_tol, nf;
+    header >> log_min >> log_max >> n_nodes >> rel_tol >> nf;
+    const std::string head = text.substr(0, line1);
+    const std::string body = text.substr(line2);
+    for (const std::string& corrupted : {
+            head + log_min + " " + log_max + " 18446744073709551615 " + rel_tol + " " + nf + "\n" + body,
+            head + log_min + " " + log_max + " " + n_nodes + " " + rel_tol + " 1000000000000\n" + body,
+            head + log_max + " " + log_min + " " + n_nodes + " " + rel_tol + " " + nf + "\n" + body,
+            text.substr(0, text.size() / 2)}) {
+        std::ofstream(path) << corrupted;
+        bool thrown = false;
+        try {
+            cphot::BlackbodyTable::load(path);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        EXPECT_NEAR(double(thrown), 1., 0.);
+        cphot::BlackbodyTable rebuilt = cphot::BlackbodyTable::load_or_build(filters, path, 1e-6, 1000., 200000.);
+        EXPECT_NEAR(rebuilt.get_fluxes(7777.)[1] / built.get_fluxes(7777.)[1], 1., 1e-15);
+    }
+    std::remove(path.c_str());
+
+    // unreachable tolerance: no silent table at the node limit, nothing cached
+    bool thrown = false;
+    try {
+        cphot::BlackbodyTable::load_or_build(filters, path, 0., 1000., 200000.);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    EXPECT_NEAR(double(thrown), 1., 0.);
+    EXPECT_NEAR(double(std::ifstream(path).good()), 0., 0.);
+}
+
+/**
+ * @brief Testing the blackbody fits on noiseless stars and their uncertainties
+ */
+void test_blackbody_fit(){
+    std::vector<cphot::Filter> filters = {cphot::get_filter("data/passbands/GAIA.GAIA3.G.xml")};
+    for (double center : {200., 350., 1200., 2500.}) {
+        cphot::DMatrix box_wave = xt::linspace<double>(0.9 * center, 1.1 * center, 101);
+        cphot::DMatrix box_trans = xt::ones<double>({101});
+        filters.push_back(cphot::Filter(box_wave, box_trans, nm, "photon",
+                                        "box" + std::to_string(int(center))));
+    }
+    const std::size_t nb = filters.size();
+    std::vector<cphot::PhotometricUnit> units(nb, cphot::PhotometricUnit::ABmag);
+    units[0] = cphot::PhotometricUnit::flam;
+    cphot::BlackbodyTable table(filters, 1e-7, 2000., 100000.);
+    cphot::BlackbodyFitter fitter(table, filters, units);
+
+    // noiseless stars with 1% uncertainties, one band missing in the second
+    cphot::DMatrix teff = {4321., 12345., 60000.};
+    cphot::DMatrix amp = {3e-21, 1e-22, 5e-24};
+    cphot::DMatrix values = cphot::DMatrix::from_shape({teff.size(), nb});
+    cphot::DMatrix errors = cphot::DMatrix::from_shape({teff.size(), nb});
+    for (std::size_t i = 0; i < teff.size(); ++i) {
+        for (std::size_t m = 0; m < nb; ++m) {
+            const cphot::DMatrix& wave = filters[m].get_wavelength();
+            const double f = filters[m].get_flux(wave, bb_flux(wave, amp[i], teff[i]), nm, flam).to(flam);
+            values(i, m) = (m == 0) ? f : -2.5 * std::log10(f) - filters[m].get_AB_zero_mag();
+            errors(i, m) = (m == 0) ? 0.01 * f : 0.01;
+        }
+    }
+    values(1, 2) = std::numeric_limits<double>::quiet_NaN();
+    std::vector<cphot::BlackbodyFit> fits = fitter.fit(values, errors, 2);
+    for (std::size_t i = 0; i < teff.size(); ++i) {
+        EXPECT_NEAR(double(fits[i].converged), 1., 0.);
+        EXPECT_NEAR(fits[i].teff / teff[i], 1., 1e-5);
+        EXPECT_NEAR(fits[i].amp / amp[i], 1., 1e-5);
+        EXPECT_NEAR(fits[i].chi2, 0., 1e-6);
+    }
+    EXPECT_NEAR(double(fits[1].n_bands), double(nb - 1), 0.);
+    // teff_error against the curvature of the chi2 profiled over the amplitude:
+    // var(log T) = 2 / (d2 chi2 / dlogT2)
+    for (std::size_t i = 0; i < teff.size(); ++i) {
+        std::vector<double> flux(nb), flux_error(nb);
+        fitter.to_flux(&values(i, 0), &errors(i, 0), flux.data(), flux_error.data());
+        auto profiled_chi2 = [&](double log_teff){
+            double s = 0., q = 0., ff = 0.;
+            for (std::size_t m = 0; m < nb; ++m) {
+                if (!std::isfinite(flux[m])) { continue; }
+                const double model = table.get_flux(m, std::exp(log_teff));
+                const double w = 1. / (flux_error[m] * flux_error[m]);
+                s += w * flux[m] * model;
+                q += w * model * model;
+                ff += w * flux[m] * flux[m];
+            }
+            return ff - s * s / q;
+        };
+        const double log_teff = std::log(fits[i].teff);
+        const double h = 1e-3;
+        const double curvature = (profiled_chi2(log_teff + h) - 2. * profiled_chi2(log_teff)
+                                  + profiled_chi2(log_teff - h)) / (h * h);
+        EXPECT_NEAR(fits[i].teff_error / (fits[i].teff * std::sqrt(2. / curvature)), 1., 1e-3);
+    }
+    // amplitude profiled out: same solutions and uncertainties
+    cphot::BlackbodyFitter profiled(table, filters, units, cphot::BlackbodyFitMethod::VariableProjection);
+    std::vector<cphot::BlackbodyFit> profiled_fits = profiled.fit(values, errors, 2);
+    for (std::size_t i = 0; i < teff.size(); ++i) {
+        EXPECT_NEAR(double(profiled_fits[i].converged), 1., 0.);
+        EXPECT_NEAR(profiled_fits[i].teff / teff[i], 1., 1e-5);
+        EXPECT_NEAR(profiled_fits[i].amp / amp[i], 1., 1e-5);
+        EXPECT_NEAR(profiled_fits[i].teff_error / fits[i].teff_error, 1., 1e-4);
+    }
+    // star hotter than the table: ends on the edge and is not converged
+    cphot::DMatrix hot_values = cphot::DMatrix::from_shape({1, nb});
+    cphot::DMatrix hot_errors = cphot::DMatrix::from_shape({1, nb});
+    for (std::size_t m = 0; m < nb; ++m) {
+        const cphot::DMatrix& wave = filters[m].get_wavelength();
+        const double f = filters[m].get_flux(wave, bb_flux(wave, 1e-24, 300000.), nm, flam).to(flam);
+        hot_values(0, m) = (m == 0) ? f : -2.5 * std::log10(f) - filters[m].get_AB_zero_mag();
+        hot_errors(0, m) = (m == 0) ? 0.001 * f : 0.001;
+    }
+    for (const cphot::BlackbodyFitter* f : {&fitter, &profiled}) {
+        const cphot::BlackbodyFit hot = f->fit(hot_values, hot_errors)[0];
+        EXPECT_NEAR(double(hot.at_bound), 1., 0.);
+        EXPECT_NEAR(double(hot.converged), 0., 0.);
+        EXPECT_NEAR(hot.teff, 100000., 1e-3);
+    }
+}
+
+/**
+ * @brief Testing the template bank matches against a brute force chi2
+ */
+void test_template_bank(){
+    std::vector<cphot::Filter> filters = {cphot::get_filter("data/passbands/GAIA.GAIA3.G.xml")};
+    for (double center : {250., 400., 900., 1600.}) {
+        cphot::DMatrix box_wave = xt::linspace<double>(0.9 * center, 1.1 * center, 101);
+        cphot::DMatrix box_trans = xt::ones<double>({101});
+        filters.push_back(cphot::Filter(box_wave, box_trans, nm, "photon",
+                                        "box" + std::to_string(int(center))));
+    }
+    cphot::PhotometricSystem system(filters, cphot::MagSystem::AB);
+    const std::size_t nb = system.size();
+
+    // 300 blackbody templates (more than one block of templates)
+    const std::size_t nt = 300;
+    cphot::DMatrix wavelength = xt::linspace<double>(100., 3000., 3000);
+    cphot::DMatrix teff = cphot::DMatrix::from_shape({nt});
+    for (std::size_t k = 0; k < nt; ++k) { teff[k] = std::pow(10., 3.3 + 1.4 * k / (nt - 1)); }
+    cphot::SpectrumBatch templates(wavelength, bb_flux(wavelength, cphot::DMatrix({1e-20}), teff), nm, flam);
+    cphot::TemplateBank bank(system, templates);
+
+    // stars: scaled templates with deterministic perturbations and missing bands
+    const std::size_t n_stars = 100;
+    cphot::DMatrix flux = cphot::DMatrix::from_shape({n_stars, nb});
+    cphot::DMatrix flux_error = cphot::DMatrix::from_shape({n_stars, nb});
+    for (std::size_t i = 0; i < n_stars; ++i) {
+        const std::size_t k = (37 * i) % nt;
+        for (std::size_t b = 0; b < nb; ++b) {
+            const double f = 2.5 * bank.get_flux()(k, b);
+            flux_error(i, b) = 0.05 * f;
+            flux(i, b) = f * (1. + 0.03 * std::sin(3. * i + b));
+        }
+        if (i % 3 == 0) { flux(i, i % nb) = std::numeric_limits<double>::quiet_NaN(); }
+        if (i % 5 == 0) { flux_error(i, (i + 1) % nb) = 0.; }
+    }
+    const std::size_t top_k = 3;
+    std::vector<cphot::TemplateMatch> best = bank.match(flux, flux_error, top_k, 2);
+
+    // brute force chi2 over all templates
+    for (std::size_t i = 0; i < n_stars; ++i) {
+        std::vector<double> chi2(nt);
+        std::vector<double> amps(nt);
+        for (std::size_t k = 0; k < nt; ++k) {
+            double s = 0, q = 0, ff = 0;
+            for (std::size_t b = 0; b < nb; ++b) {
+                if (!std::isfinite(flux(i, b)) || !(flux_error(i, b) > 0)) { continue; }
+                const double w = 1. / (flux_error(i, b) * flux_error(i, b));
+                s += w * flux(i, b) * bank.get_flux()(k, b);
+                q += w * bank.get_flux()(k, b) * bank.get_flux()(k, b);
+                ff += w * flux(i, b) * flux(i, b);
+            }
+            amps[k] = s / q;
+            chi2[k] = ff - s * s / q;
+        }
+        std::vector<std::size_t> order(nt);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b){ return chi2[a] < chi2[b]; });
+        for (std::size_t j = 0; j < top_k; ++j) {
+            const cphot::TemplateMatch& m = best[i * top_k + j];
+            EXPECT_NEAR(double(m.index), double(order[j]), 0.);
+            EXPECT_NEAR(m.amp / amps[order[j]], 1., 1e-10);
+            EXPECT_NEAR(m.chi2, chi2[order[j]], 1e-8 * (1. + chi2[order[j]]));
+        }
+    }
+    // same through AB magnitudes
+    cphot::DMatrix mags = cphot::DMatrix::from_shape({1, nb});
+    cphot::DMatrix mag_errors = cphot::DMatrix::from_shape({1, nb});
+    for (std::size_t b = 0; b < nb; ++b) {
+        mags(0, b) = -2.5 * std::log10(0.1 * bank.get_flux()(42, b)) - filters[b].get_AB_zero_mag();
+        mag_errors(0, b) = 0.01;
+    }
+    std::vector<cphot::TemplateMatch> mag_best = bank.match_magnitudes(mags, mag_errors);
+    EXPECT_NEAR(double(mag_best[0].index), 42., 0.);
+    EXPECT_NEAR(mag_best[0].amp, 0.1, 1e-10);
+}
+
+/**
+ * @brief Testing the blackbody posterior sampler, its random streams, degenerate fits and posterior files
+ */
+void test_blackbody_mcmc(){
+    // Philox4x32-10 known answer (Random123)
+    const auto r = cphot::rng::philox4x32({{0, 0, 0, 0}}, {{0, 0}});
+    EXPECT_NEAR(double(r[0]), double(0x6627e8d5u), 0.);
+    EXPECT_NEAR(double(r[3]), double(0x9b00dbd8u), 0.);
+
+    std::vector<cphot::Filter> filters;
+    for (double center : {200., 350., 600., 1200., 2500.}) {
+        cphot::DMatrix box_wave = xt::linspace<double>(0.9 * center, 1.1 * center, 101);
+        cphot::DMatrix box_trans = xt::ones<double>({101});
+        filters.push_back(cphot::Filter(box_wave, box_trans, nm, "photon",
+                                        "box" + std::to_string(int(center))));
+    }
+    const std::size_t nb = filters.size();
+    std::vector<cphot::PhotometricUnit> units(nb, cphot::PhotometricUnit::flam);
+    cphot::BlackbodyTable table(filters, 1e-6, 2000., 100000.);
+    cphot::BlackbodyFitter fitter(table, filters, units, cphot::BlackbodyFitMethod::VariableProjection);
+
+    cphot::DMatrix teff = {5000., 15000., 40000.};
+    cphot::DMatrix values = cphot::DMatrix::from_shape({teff.size(), nb});
+    cphot::DMatrix errors = cphot::DMatrix::from_shape({teff.size(), nb});
+    for (std::size_t i = 0; i < teff.size(); ++i) {
+        for (std::size_t m = 0; m < nb; ++m) {
+            const double f = table.get_flux(m, teff[i], 1e-22);
+            values(i, m) = f * (1. + 0.02 * std::sin(5. * i + m));
+            errors(i, m) = 0.02 * f;
+        }
+    }
+    std::vector<cphot::BlackbodyFit> fits = fitter.fit(values, errors);
+    cphot::BlackbodySampler sampler(fitter, 32, 1500, 300);
+    std::vector<cphot::BlackbodyPosterior> posteriors = sampler.sample(values, errors, 1);
+    for (std::size_t i = 0; i < teff.size(); ++i) {
+        const cphot::BlackbodyPosterior& p = posteriors[i];
+        EXPECT_NEAR(double(p.chain.size()), double(2 * sampler.n_samples()), 0.);
+        EXPECT_NEAR(p.acceptance, 0.6, 0.25);
+        // nearly gaussian posterior: median and width close to the best fit
+        EXPECT_NEAR(p.teff[1] / fits[i].teff, 1., 0.5 * fits[i].teff_error / fits[i].teff);
+        EXPECT_NEAR(0.5 * (p.teff[2] - p.teff[0]) / fits[i].teff_error, 1., 0.2);
+    }
+    // counter based streams: same chains with any number of threads
+    std::vector<cphot::BlackbodyPosterior> parallel = sampler.sample(values, errors, 3);
+    EXPECT_NEAR(double(parallel[2].chain[777]), double(posteriors[2].chain[777]), 0.);
+    EXPECT_NEAR(parallel[1].teff[1], posteriors[1].teff[1], 0.);
+
+    // degenerate fit (two identical bands): no finite uncertainty to start from
+    std::vector<cphot::Filter> twins = {filters[2], filters[2]};
+    std::vector<cphot::PhotometricUnit> twin_units(2, cphot::PhotometricUnit::flam);
+    cphot::BlackbodyTable twin_table(twins, 1e-6, 2000., 100000.);
+    cphot::BlackbodyFitter twin_fitter(twin_table, twins, twin_units);
+    const double f6000 = twin_table.get_flux(0, 6000., 1e-22);
+    const double twin_flux[2] = {f6000, 1.01 * f6000};
+    const double twin_error[2] = {0.02 * f6000, 0.02 * f6000};
+    const cphot::BlackbodyFit twin_fit = twin_fitter.fit_flux(twin_flux, twin_error);
+    EXPECT_NEAR(double(std::isfinite(twin_fit.teff_error)), 0., 0.);
+    cphot::BlackbodySampler twin_sampler(twin_fitter, 8, 200, 50);
+    const cphot::BlackbodyPosterior twin = twin_sampler.sample_flux(twin_flux, twin_error, 0);
+    EXPECT_NEAR(double(twin.acceptance > 0), 1., 0.);
+    for (std::size_t l = 0; l < 3; ++l) {
+        EXPECT_NEAR(double(std::isfinite(twin.teff[l]) && std::isfinite(twin.amp[l])), 1., 0.);
+    }
+    EXPECT_NEAR(double((twin.teff[0] < twin_fit.teff) && (twin_fit.teff < twin.teff[2])), 1., 0.);
+
+    // binary round trip
+    const std::string path = "test_blackbody_mcmc.bin";
+    cphot::write_posteriors(path, posteriors);
+    std::vector<cphot::BlackbodyPosterior> stored = cphot::read_posteriors(path);
+    EXPECT_NEAR(double(stored.size()), 3., 0.);
+    EXPECT_NEAR(stored[0].amp[2], posteriors[0].amp[2], 0.);
+    EXPECT_NEAR(double(stored[2].chain.back()), double(posteriors[2].chain.back()), 0.);
+
+    // corrupted counts are rejected before allocating
+    for (std::uint64_t count : {std::uint64_t(4), std::uint64_t(1) << 62}) {
+        for (std::streamoff offset : {8, 16}) {
+            cphot::write_posteriors(path, posteriors);
+            std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(offset);
+            file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            file.close();
+            bool thrown = false;
+            try {
+                cphot::read_posteriors(path);
+            } catch (const std::runtime_error&) {
+                thrown = true;
+            }
+            EXPECT_NEAR(double(thrown), 1., 0.);
+        }
+    }
+    std::remove(path.c_str());
+}
 
 int main() {
     std::cout << "Testing units..." << std::endl;
@@ -101,5 +1005,45 @@ int main() {
     test_svo_energy_dtype();
     std::cout << "Testing SVO photon filter..." << std::endl;
     test_svo_photon_dtype();
+    std::cout << "Testing cached zero points..." << std::endl;
+    test_zero_points();
+    std::cout << "Testing sorted interpolation..." << std::endl;
+    test_interp_sorted();
+    std::cout << "Testing regular wavelength grids..." << std::endl;
+    test_regular_grids();
+    std::cout << "Testing batch photometry plan..." << std::endl;
+    test_photometry_plan();
+    std::cout << "Testing filter quadrature rules..." << std::endl;
+    test_quadrature_rule();
+    std::cout << "Testing filter simplification..." << std::endl;
+    test_filter_simplify();
+    std::cout << "Testing photometric system..." << std::endl;
+    test_photometric_system();
+    std::cout << "Testing redshifted photometry..." << std::endl;
+    test_redshifted_flux();
+    std::cout << "Testing extinction..." << std::endl;
+    test_extinction();
+    std::cout << "Testing flux gradients..." << std::endl;
+    test_flux_gradient();
+    std::cout << "Testing lazy filter properties..." << std::endl;
+    test_lazy_properties();
+    std::cout << "Testing transmission cache..." << std::endl;
+    test_transmission_cache();
+    std::cout << "Testing spectrum containers..." << std::endl;
+    test_spectrum();
+    std::cout << "Testing flux conserving rebinning..." << std::endl;
+    test_rebin();
+    std::cout << "Testing bulk magnitude conversions..." << std::endl;
+    test_bulk_conversions();
+    std::cout << "Testing blackbody grids..." << std::endl;
+    test_blackbody_grid();
+    std::cout << "Testing blackbody lookup tables..." << std::endl;
+    test_blackbody_table();
+    std::cout << "Testing blackbody fits..." << std::endl;
+    test_blackbody_fit();
+    std::cout << "Testing blackbody posterior sampling..." << std::endl;
+    test_blackbody_mcmc();
+    std::cout << "Testing template bank chi2..." << std::endl;
+    test_template_bank();
     return 0;
 }